@@ -127,6 +127,16 @@ void atomic::spinlock::release(void)
 
 #endif
 
+void atomic::protect(const volatile void *object)
+{
+    Mutex::protect((const void *)object);
+}
+
+void atomic::release(const volatile void *object)
+{
+    Mutex::release((const void *)object);
+}
+
 #ifdef SIMULATED
 const bool atomic::simulated = true;
 #else
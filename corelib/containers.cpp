@@ -283,6 +283,228 @@ bool Buffer::put(void *dbuf, timeout_t timeout)
 }
 
 
+RingBuffer::RingBuffer(size_t osize, size_t c, unsigned m) :
+Conditional()
+{
+    size_t slots = 1;
+
+    assert(osize > 0 && c > 0);
+
+    while(slots < c)
+        slots <<= 1;
+
+    // each cell is a sequence number followed by a copy of the object...
+    objsize = osize;
+    cellsize = sizeof(atomic::value<size_t>) + osize;
+    cellsize = ((cellsize + sizeof(size_t) - 1) / sizeof(size_t)) * sizeof(size_t);
+    mask = slots - 1;
+    mode = m;
+
+    cells = (caddr_t)malloc(cellsize * slots);
+    crit(cells != NULL, "ring alloc failed");
+
+    for(size_t pos = 0; pos < slots; ++pos)
+        ((atomic::value<size_t> *)(cells + pos * cellsize))->set(pos, atomic::RELAXED);
+}
+
+RingBuffer::~RingBuffer()
+{
+    if(cells)
+        free(cells);
+    cells = NULL;
+}
+
+// a cell is free to fill when its sequence equals the fill position,
+// and full when it is one past...
+bool RingBuffer::enqueue(const void *data)
+{
+    size_t pos = head.get(atomic::RELAXED), seq;
+    atomic::value<size_t> *cell;
+
+    for(;;) {
+        cell = (atomic::value<size_t> *)(cells + (pos & mask) * cellsize);
+        seq = cell->get(atomic::ACQUIRE);
+        if(seq == pos) {
+            if(mode & SINGLE_PRODUCER) {
+                head.set(pos + 1, atomic::RELAXED);
+                break;
+            }
+            if(head.cas(pos, pos + 1, atomic::RELAXED))
+                break;
+        }
+        else if((ssize_t)(seq - pos) < 0)
+            return false;
+        else
+            pos = head.get(atomic::RELAXED);
+    }
+
+    memcpy((caddr_t)cell + sizeof(atomic::value<size_t>), data, objsize);
+    cell->set(pos + 1, atomic::RELEASE);
+    return true;
+}
+
+bool RingBuffer::dequeue(void *data)
+{
+    size_t pos = tail.get(atomic::RELAXED), seq;
+    atomic::value<size_t> *cell;
+
+    for(;;) {
+        cell = (atomic::value<size_t> *)(cells + (pos & mask) * cellsize);
+        seq = cell->get(atomic::ACQUIRE);
+        if(seq == pos + 1) {
+            if(mode & SINGLE_CONSUMER) {
+                tail.set(pos + 1, atomic::RELAXED);
+                break;
+            }
+            if(tail.cas(pos, pos + 1, atomic::RELAXED))
+                break;
+        }
+        else if((ssize_t)(seq - (pos + 1)) < 0)
+            return false;
+        else
+            pos = tail.get(atomic::RELAXED);
+    }
+
+    memcpy(data, (caddr_t)cell + sizeof(atomic::value<size_t>), objsize);
+    cell->set(pos + mask + 1, atomic::RELEASE);
+    return true;
+}
+
+// waiters count themselves before their last try, so either they see
+// our change or we see them...
+void RingBuffer::notify(void)
+{
+    atomic::fence();
+    if(waiting.get(atomic::RELAXED)) {
+        lock();
+        broadcast();
+        unlock();
+    }
+}
+
+unsigned RingBuffer::count(void) const
+{
+    size_t first = tail.get(atomic::RELAXED);
+    size_t last = head.get(atomic::RELAXED);
+
+    if((ssize_t)(last - first) < 0)
+        return 0;
+
+    return (unsigned)(last - first);
+}
+
+void RingBuffer::put(const void *data)
+{
+    put(data, Timer::inf);
+}
+
+bool RingBuffer::put(const void *data, timeout_t timeout)
+{
+    struct timespec ts;
+    bool rtn = true;
+
+    assert(data != NULL);
+
+    if(enqueue(data)) {
+        notify();
+        return true;
+    }
+
+    if(!timeout)
+        return false;
+
+    if(timeout != Timer::inf)
+        set(&ts, timeout);
+
+    lock();
+    ++waiting;
+    while(rtn && !enqueue(data)) {
+        if(timeout == Timer::inf)
+            wait();
+        else
+            rtn = wait(&ts);
+    }
+    --waiting;
+    unlock();
+
+    if(rtn)
+        notify();
+    return rtn;
+}
+
+void RingBuffer::copy(void *data)
+{
+    copy(data, Timer::inf);
+}
+
+bool RingBuffer::copy(void *data, timeout_t timeout)
+{
+    struct timespec ts;
+    bool rtn = true;
+
+    assert(data != NULL);
+
+    if(dequeue(data)) {
+        notify();
+        return true;
+    }
+
+    if(!timeout)
+        return false;
+
+    if(timeout != Timer::inf)
+        set(&ts, timeout);
+
+    lock();
+    ++waiting;
+    while(rtn && !dequeue(data)) {
+        if(timeout == Timer::inf)
+            wait();
+        else
+            rtn = wait(&ts);
+    }
+    --waiting;
+    unlock();
+
+    if(rtn)
+        notify();
+    return rtn;
+}
+
+unsigned RingBuffer::push(const void *list, unsigned count)
+{
+    const char *data = (const char *)list;
+    unsigned total = 0;
+
+    assert(list != NULL || !count);
+
+    while(total < count && enqueue(data)) {
+        data += objsize;
+        ++total;
+    }
+
+    if(total)
+        notify();
+    return total;
+}
+
+unsigned RingBuffer::pull(void *list, unsigned count)
+{
+    caddr_t data = (caddr_t)list;
+    unsigned total = 0;
+
+    assert(list != NULL || !count);
+
+    while(total < count && dequeue(data)) {
+        data += objsize;
+        ++total;
+    }
+
+    if(total)
+        notify();
+    return total;
+}
+
 Buffer::operator bool()
 {
     bool rtn = false;
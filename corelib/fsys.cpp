@@ -779,6 +779,39 @@ ssize_t fsys::write(const void *buf, size_t len)
     return rtn;
 }
 
+ssize_t fsys::writev(const struct iovec *iov, unsigned count)
+{
+    assert(iov != NULL);
+
+#ifdef  __PTH__
+    ssize_t rtn = pth_writev(fd, iov, count);
+#else
+    ssize_t rtn = ::writev(fd, iov, count);
+#endif
+
+    if(rtn < 0)
+        error = remapError();
+    return rtn;
+}
+
+ssize_t fsys::writev(const bufpager& buffer)
+{
+    struct iovec iov[16];
+    unsigned count;
+    size_t total = 0;
+    ssize_t rtn;
+
+    while(0 != (count = buffer.gather(iov, 16, total))) {
+        rtn = writev(iov, count);
+        if(rtn < 0)
+            return -1;
+        if(!rtn)
+            break;
+        total += rtn;
+    }
+    return (ssize_t)total;
+}
+
 fd_t fsys::null(void)
 {
     return ::open("/dev/null", O_RDWR);
@@ -20,6 +20,7 @@
 #include <ucommon/linked.h>
 #include <ucommon/string.h>
 #include <ucommon/thread.h>
+#include <ctype.h>
 
 namespace ucommon {
 
@@ -528,6 +529,261 @@ NamedObject *NamedObject::map(NamedObject **idx, const char *id, unsigned max)
     return find(idx[keyindex(id, max)], id);
 }
 
+static unsigned namehash(const char *id)
+{
+    unsigned key = 2166136261u;
+
+    while(*id) {
+        key ^= (unsigned char)tolower(*(id++));
+        key *= 16777619u;
+    }
+    return key;
+}
+
+NamedTable::NamedTable(unsigned max)
+{
+    size = 8;
+    while(size < max)
+        size <<= 1;
+
+    table = prior = NULL;
+    used = members = 0;
+    priorsize = moved = 0;
+}
+
+NamedTable::~NamedTable()
+{
+    clear();
+}
+
+void NamedTable::clear(void)
+{
+    if(table)
+        delete[] table;
+    if(prior)
+        delete[] prior;
+    table = prior = NULL;
+    used = members = 0;
+    priorsize = moved = 0;
+}
+
+void NamedTable::purge(void)
+{
+    NamedObject *node = skip(NULL), *next;
+
+    while(node) {
+        next = skip(node);
+        node->release();
+        node = next;
+    }
+    clear();
+}
+
+// an empty slot has no hash, a removed slot keeps a hash to continue probes...
+NamedTable::slot_t *NamedTable::find(slot_t *list, unsigned max, const char *id, unsigned key) const
+{
+    unsigned pos = key & (max - 1);
+    unsigned probes = max;
+
+    while(probes--) {
+        if(!list[pos].node) {
+            if(!list[pos].hash)
+                return NULL;
+        }
+        else if(list[pos].hash == key && list[pos].node->equal(id))
+            return &list[pos];
+        pos = (pos + 1) & (max - 1);
+    }
+    return NULL;
+}
+
+void NamedTable::place(NamedObject *node, unsigned key)
+{
+    unsigned pos = key & (size - 1);
+
+    while(table[pos].node)
+        pos = (pos + 1) & (size - 1);
+
+    if(!table[pos].hash)
+        ++used;
+
+    table[pos].hash = key;
+    table[pos].node = node;
+}
+
+void NamedTable::migrate(unsigned count)
+{
+    slot_t *sp;
+
+    while(prior && count--) {
+        sp = &prior[moved++];
+        if(sp->node) {
+            place(sp->node, sp->hash);
+            sp->node = NULL;
+            sp->hash = 1;
+        }
+        if(moved >= priorsize) {
+            delete[] prior;
+            prior = NULL;
+            priorsize = moved = 0;
+        }
+    }
+}
+
+void NamedTable::grow(void)
+{
+    migrate(priorsize);
+
+    prior = table;
+    priorsize = size;
+    moved = 0;
+
+    // removed slots are dropped, so only double if really filling up...
+    if(members * 2 >= size)
+        size *= 2;
+
+    table = new slot_t[size];
+    memset(table, 0, sizeof(slot_t) * size);
+    used = 0;
+}
+
+NamedObject *NamedTable::add(NamedObject *node, char *id)
+{
+    assert(node != NULL);
+    assert(id != NULL && *id != 0);
+
+    unsigned key = namehash(id);
+    NamedObject *old;
+    slot_t *sp = NULL;
+
+    if(!table) {
+        table = new slot_t[size];
+        memset(table, 0, sizeof(slot_t) * size);
+    }
+
+    migrate(8);
+
+    node->clearId();
+    node->Id = id;
+
+    sp = find(table, size, id, key);
+    if(!sp && prior)
+        sp = find(prior, priorsize, id, key);
+
+    if(sp) {
+        old = sp->node;
+        sp->node = node;
+        return old;
+    }
+
+    if((used + 1) * 4 > size * 3)
+        grow();
+
+    place(node, key);
+    ++members;
+    return NULL;
+}
+
+NamedObject *NamedTable::map(const char *id) const
+{
+    assert(id != NULL && *id != 0);
+
+    unsigned key;
+    slot_t *sp;
+
+    if(!table)
+        return NULL;
+
+    key = namehash(id);
+    sp = find(table, size, id, key);
+    if(!sp && prior)
+        sp = find(prior, priorsize, id, key);
+
+    if(sp)
+        return sp->node;
+
+    return NULL;
+}
+
+NamedObject *NamedTable::remove(const char *id)
+{
+    assert(id != NULL && *id != 0);
+
+    unsigned key;
+    slot_t *sp;
+    NamedObject *node;
+
+    if(!table)
+        return NULL;
+
+    key = namehash(id);
+    sp = find(table, size, id, key);
+    if(!sp && prior)
+        sp = find(prior, priorsize, id, key);
+
+    if(!sp)
+        return NULL;
+
+    node = sp->node;
+    sp->node = NULL;
+    sp->hash = 1;
+    --members;
+    return node;
+}
+
+NamedObject *NamedTable::skip(NamedObject *node) const
+{
+    slot_t *sp;
+    unsigned key, pos = 0;
+    bool moving = false;
+
+    if(!table)
+        return NULL;
+
+    if(node) {
+        key = namehash(node->Id);
+        sp = find(table, size, node->Id, key);
+        if(sp && sp->node == node)
+            pos = (unsigned)(sp - table) + 1;
+        else if(prior && NULL != (sp = find(prior, priorsize, node->Id, key)) && sp->node == node) {
+            pos = (unsigned)(sp - prior) + 1;
+            moving = true;
+        }
+        else
+            return NULL;
+    }
+
+    if(!moving) {
+        while(pos < size) {
+            if(table[pos].node)
+                return table[pos].node;
+            ++pos;
+        }
+        pos = 0;
+    }
+
+    while(prior && pos < priorsize) {
+        if(prior[pos].node)
+            return prior[pos].node;
+        ++pos;
+    }
+    return NULL;
+}
+
+NamedObject **NamedTable::index(void) const
+{
+    NamedObject **op = new NamedObject *[members + 1];
+    unsigned pos = 0;
+    NamedObject *node = skip(NULL);
+
+    while(node) {
+        op[pos++] = node;
+        node = skip(node);
+    }
+    op[pos] = NULL;
+    return op;
+}
+
 NamedObject *NamedObject::find(NamedObject *root, const char *id)
 {
     assert(id != NULL && *id != 0);
@@ -1194,4 +1450,145 @@ LinkedObject *ObjectStack::pull(void)
     return obj;
 }
 
+// the fifo always holds at least this placeholder, so producers never
+// have to test for an empty list...
+class __LOCAL fifo_stub : public LinkedObject
+{
+public:
+    inline fifo_stub() : LinkedObject() {}
+};
+
+AtomicFifo::AtomicFifo()
+{
+    stub = new fifo_stub();
+    stub->Next = NULL;
+    head.set(stub, atomic::RELAXED);
+    tail = stub;
+}
+
+AtomicFifo::~AtomicFifo()
+{
+    delete stub;
+}
+
+atomic::pointer<LinkedObject> *AtomicFifo::link(LinkedObject *object)
+{
+    return reinterpret_cast<atomic::pointer<LinkedObject> *>(&object->Next);
+}
+
+void AtomicFifo::push(LinkedObject *object)
+{
+    LinkedObject *prior;
+
+    assert(object != NULL);
+
+    link(object)->set(NULL, atomic::RELAXED);
+    prior = head.exchange(object, atomic::ACQ_REL);
+    link(prior)->set(object, atomic::RELEASE);
+}
+
+LinkedObject *AtomicFifo::pull(void)
+{
+    LinkedObject *first = tail;
+    LinkedObject *next = link(first)->get(atomic::ACQUIRE);
+
+    if(first == stub) {
+        if(!next)
+            return NULL;
+        tail = first = next;
+        next = link(next)->get(atomic::ACQUIRE);
+    }
+
+    if(next) {
+        tail = next;
+        first->Next = NULL;
+        return first;
+    }
+
+    // a producer has swapped head but not yet linked behind first...
+    if(first != head.get(atomic::ACQUIRE))
+        return NULL;
+
+    // requeue the placeholder so first may be taken as the last object
+    push(stub);
+    next = link(first)->get(atomic::ACQUIRE);
+    if(next) {
+        tail = next;
+        first->Next = NULL;
+        return first;
+    }
+    return NULL;
+}
+
+LinkedObject *AtomicFifo::drain(unsigned limit)
+{
+    LinkedObject *list = NULL, *last = NULL, *object;
+    unsigned count = 0;
+
+    while(!limit || count < limit) {
+        object = pull();
+        if(!object)
+            break;
+        if(last)
+            last->Next = object;
+        else
+            list = object;
+        last = object;
+        ++count;
+    }
+    return list;
+}
+
+bool AtomicFifo::is_empty(void) const
+{
+    return tail == stub && !reinterpret_cast<atomic::pointer<LinkedObject> *>(&stub->Next)->get(atomic::ACQUIRE);
+}
+
+PushStack::PushStack()
+{
+}
+
+void PushStack::lock(void)
+{
+    while(pulling.set())
+        Thread::yield();
+}
+
+void PushStack::push(LinkedObject *object)
+{
+    LinkedObject *top = root.get(atomic::RELAXED);
+
+    assert(object != NULL);
+
+    do {
+        object->Next = top;
+    } while(!root.cas(top, object, atomic::RELEASE));
+}
+
+LinkedObject *PushStack::pull(void)
+{
+    LinkedObject *top;
+
+    // only pullers remove, so top stays valid while we hold the flag...
+    lock();
+    top = root.get(atomic::ACQUIRE);
+    while(top && !root.cas(top, top->Next, atomic::ACQUIRE)) {
+    }
+    pulling.clear();
+
+    if(top)
+        top->Next = NULL;
+    return top;
+}
+
+LinkedObject *PushStack::drain(void)
+{
+    LinkedObject *list;
+
+    lock();
+    list = root.exchange(NULL, atomic::ACQUIRE);
+    pulling.clear();
+    return list;
+}
+
 } // namespace ucommon
@@ -157,7 +157,7 @@ MappedMemory::MappedMemory(const char *fn, size_t len)
 
     erase = true;
     String::set(idname, sizeof(idname), fn);
-    create(fn, size);
+    create(fn, len);
 }
 
 MappedMemory::MappedMemory(const char *fn)
@@ -512,6 +512,7 @@ ReusableAllocator(), MappedMemory(name,  osize * count)
     assert(osize > 0 && count > 0);
 
     objsize = osize;
+    unit = osize;
     reading = 0;
 }
 
@@ -521,6 +522,7 @@ ReusableAllocator(), MappedMemory()
     assert(osize > 0);
 
     objsize = osize;
+    unit = osize;
     reading = 0;
 }
 
@@ -543,8 +545,15 @@ ReusableObject *MappedReuse::request(void)
         obj = freelist;
         freelist = next(obj);
     }
-    else if(used + objsize <= size)
+    else if(used + objsize <= size) {
         obj = (ReusableObject *)sbrk(objsize);
+        stats.reserve(objsize);
+    }
+
+    if(obj)
+        stats.alloc(objsize, objsize);
+    else
+        ++stats.faults;
     unlock();
     return obj;
 }
@@ -560,6 +569,7 @@ void MappedReuse::removeLocked(ReusableObject *obj)
 
     obj->retain();
     obj->enlist((LinkedObject **)&freelist);
+    stats.release(objsize);
 }
 
 ReusableObject *MappedReuse::getLocked(void)
@@ -570,8 +580,15 @@ ReusableObject *MappedReuse::getLocked(void)
         obj = freelist;
         freelist = next(obj);
     }
-    else if(used + objsize <= size)
+    else if(used + objsize <= size) {
         obj = (ReusableObject *)sbrk(objsize);
+        stats.reserve(objsize);
+    }
+
+    if(obj)
+        stats.alloc(objsize, objsize);
+    else
+        ++stats.faults;
 
     return obj;
 }
@@ -597,6 +614,7 @@ ReusableObject *MappedReuse::getTimed(timeout_t timeout)
         --waiting;
     }
     if(!rtn) {
+        ++stats.faults;
         unlock();
         return NULL;
     }
@@ -604,8 +622,15 @@ ReusableObject *MappedReuse::getTimed(timeout_t timeout)
         obj = freelist;
         freelist = next(obj);
     }
-    else if(used + objsize <= size)
+    else if(used + objsize <= size) {
         obj = (ReusableObject *)sbrk(objsize);
+        stats.reserve(objsize);
+    }
+
+    if(obj)
+        stats.alloc(objsize, objsize);
+    else
+        ++stats.faults;
     unlock();
     return obj;
 }
@@ -28,11 +28,49 @@
 #include <limits.h>
 #include <string.h>
 #include <stdio.h>
+#ifdef  HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#ifdef  HAVE_SETLOCALE
+#include <locale.h>
+#endif
+
+#if defined(HAVE_SYS_MMAN_H) && !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS   MAP_ANON
+#endif
+
+#define HUGEPAGE_SIZE   (2l * 1024l * 1024l)
 
 namespace ucommon {
 
+static unsigned sizeclass(size_t size)
+{
+    unsigned sc = 0;
+
+    while(size >>= 1)
+        ++sc;
+
+    if(sc > 31)
+        sc = 31;
+
+    return sc;
+}
+
+static unsigned strhash(const char *text)
+{
+    unsigned key = 2166136261u;
+
+    while(*text) {
+        key ^= (unsigned char)*(text++);
+        key *= 16777619u;
+    }
+    return key;
+}
+
 extern "C" {
 
+    static void shard_release(void *obj);
+
     static int ncompare(const void *o1, const void *o2)
     {
         assert(o1 != NULL);
@@ -43,6 +81,193 @@ extern "C" {
     }
 }
 
+typedef struct {
+    uint64_t key;
+    StringPager::member *node;
+} sortkey_t;
+
+// byte order sort is only valid when collation is plain byte order...
+static bool collating(void)
+{
+#if defined(HAVE_STRCOLL) && defined(HAVE_SETLOCALE)
+    const char *locale = setlocale(LC_COLLATE, NULL);
+    if(locale && strcmp(locale, "C") && strcmp(locale, "POSIX"))
+        return true;
+    return false;
+#elif defined(HAVE_STRCOLL)
+    return true;
+#else
+    return false;
+#endif
+}
+
+// pack up to 8 leading bytes so keys compare like strcmp...
+static uint64_t sortprefix(const char *text)
+{
+    uint64_t key = 0;
+    unsigned pos = 0;
+
+    while(pos < 8 && text[pos]) {
+        key |= ((uint64_t)(unsigned char)text[pos]) << (56 - pos * 8);
+        ++pos;
+    }
+    return key;
+}
+
+// a key with a non-zero last byte means the text goes on past the key...
+static bool sortless(const sortkey_t& k1, const sortkey_t& k2, size_t depth)
+{
+    if(k1.key != k2.key)
+        return k1.key < k2.key;
+
+    if(!(k1.key & 0xff))
+        return false;
+
+    return strcmp(k1.node->get() + depth + 8, k2.node->get() + depth + 8) < 0;
+}
+
+static void sortsmall(sortkey_t *list, size_t count, size_t depth)
+{
+    sortkey_t item;
+    size_t pos, ins;
+
+    for(pos = 1; pos < count; ++pos) {
+        item = list[pos];
+        ins = pos;
+        while(ins && sortless(item, list[ins - 1], depth)) {
+            list[ins] = list[ins - 1];
+            --ins;
+        }
+        list[ins] = item;
+    }
+}
+
+// one stable counting pass on a key byte, false if nothing would move...
+static bool sortpass(sortkey_t *from, sortkey_t *to, size_t count, unsigned shift)
+{
+    size_t buckets[256];
+    size_t pos, total = 0, tmp;
+
+    memset(buckets, 0, sizeof(buckets));
+    for(pos = 0; pos < count; ++pos)
+        ++buckets[(from[pos].key >> shift) & 0xff];
+
+    for(pos = 0; pos < 256; ++pos) {
+        if(buckets[pos] == count)
+            return false;
+        tmp = buckets[pos];
+        buckets[pos] = total;
+        total += tmp;
+    }
+
+    for(pos = 0; pos < count; ++pos)
+        to[buckets[(from[pos].key >> shift) & 0xff]++] = from[pos];
+
+    return true;
+}
+
+// radix sort on 8 byte prefixes, then descend into runs of equal prefix...
+static void sortkeys(sortkey_t *list, sortkey_t *tmp, size_t count, size_t depth)
+{
+    sortkey_t *src = list, *dest = tmp, *swap;
+    size_t pos = 0, end, item;
+    unsigned shift;
+
+    if(count < 32) {
+        sortsmall(list, count, depth);
+        return;
+    }
+
+    for(shift = 0; shift < 64; shift += 8) {
+        if(sortpass(src, dest, count, shift)) {
+            swap = src;
+            src = dest;
+            dest = swap;
+        }
+    }
+
+    if(src != list)
+        memcpy(list, src, sizeof(sortkey_t) * count);
+
+    while(pos < count) {
+        end = pos + 1;
+        while(end < count && list[end].key == list[pos].key)
+            ++end;
+        if(end - pos > 1 && (list[pos].key & 0xff)) {
+            for(item = pos; item < end; ++item)
+                list[item].key = sortprefix(list[item].node->get() + depth + 8);
+            sortkeys(list + pos, tmp + pos, end - pos, depth + 8);
+        }
+        pos = end;
+    }
+}
+
+memstats::memstats()
+{
+    histogram = false;
+    clear();
+}
+
+void memstats::clear(void)
+{
+    allocs = faults = 0;
+    requested = used = peak = reserved = 0;
+    pages = 0;
+    memset(sizes, 0, sizeof(sizes));
+}
+
+void memstats::alloc(size_t request, size_t size)
+{
+    ++allocs;
+    requested += request;
+    used += size;
+    if(used > peak)
+        peak = used;
+
+    if(histogram) {
+        unsigned sc = sizeclass(request);
+        if(sc >= SIZES)
+            sc = SIZES - 1;
+        ++sizes[sc];
+    }
+}
+
+unsigned memstats::utilization(void) const
+{
+    if(!reserved || !used)
+        return 0;
+
+    return (unsigned)((used * 100) / reserved);
+}
+
+unsigned memstats::fragmentation(void) const
+{
+    if(!reserved)
+        return 0;
+
+    return 100 - utilization();
+}
+
+memstats& memstats::operator+=(const memstats& add)
+{
+    allocs += add.allocs;
+    faults += add.faults;
+    requested += add.requested;
+    used += add.used;
+
+    // peaks of separate allocators need not coincide, so the combined
+    // peak is only known to be at least the largest one or what is in use
+    if(add.peak > peak)
+        peak = add.peak;
+    if(used > peak)
+        peak = used;
+    reserved += add.reserved;
+    pages += add.pages;
+    for(unsigned pos = 0; pos < SIZES; ++pos)
+        sizes[pos] += add.sizes[pos];
+    return *this;
+}
+
 memalloc::memalloc(size_t ps)
 {
 #ifdef  HAVE_SYSCONF
@@ -79,7 +304,10 @@ memalloc::memalloc(size_t ps)
     pagesize = ps;
     count = 0;
     limit = 0;
-    page = NULL;
+    page = tail = active = spare = NULL;
+    memset(avail, 0, sizeof(avail));
+    regions = NULL;
+    mapping = 0;
 }
 
 memalloc::~memalloc()
@@ -87,34 +315,39 @@ memalloc::~memalloc()
     memalloc::purge();
 }
 
-unsigned memalloc::utilization(void) const
-{
-    unsigned long used = 0, alloc = 0;
-    page_t *mp = page;
-
-    while(mp) {
-        alloc += pagesize;
-        used += mp->used;
-        mp = mp->next;
-    }
-
-    if(!used)
-        return 0;
-
-    alloc /= 100;
-    used /= alloc;
-    return used;
-}
 
 void memalloc::purge(void)
 {
     page_t *next;
+    region_t *rnext;
+
+    // pages carved from mapped regions are released with the region
+    if(regions)
+        page = spare = NULL;
+
     while(page) {
         next = page->next;
         free(page);
         page = next;
     }
+    while(spare) {
+        next = spare->next;
+        free(spare);
+        spare = next;
+    }
+    while(regions) {
+        rnext = regions->next;
+#ifdef  HAVE_SYS_MMAN_H
+        munmap(regions->base, regions->size);
+#endif
+        free(regions);
+        regions = rnext;
+    }
+    tail = active = NULL;
+    memset(avail, 0, sizeof(avail));
     count = 0;
+    stats.used = stats.reserved = 0;
+    stats.pages = 0;
 }
 
 void memalloc::fault(void) const
@@ -129,41 +362,230 @@ memalloc::page_t *memalloc::pager(void)
     void *addr;
 #endif
 
-    if(limit && count >= limit)
-        fault();
+    // re-use pages kept from a rewind first...
+    if(spare) {
+        npage = spare;
+        spare = npage->next;
+        goto init;
+    }
 
-#ifdef  HAVE_POSIX_MEMALIGN
-    if(align && !posix_memalign(&addr, align, pagesize)) {
-        npage = (page_t *)addr;
-        goto use;
+    if(limit && count >= limit) {
+        ++stats.faults;
+        fault();
     }
-#endif
-    npage = (page_t *)malloc(pagesize);
 
+    if(mapping & HUGEPAGES)
+        npage = carve();
+    else {
 #ifdef  HAVE_POSIX_MEMALIGN
-use:
+        if(align && !posix_memalign(&addr, align, pagesize))
+            npage = (page_t *)addr;
+        else
 #endif
-    if(!npage)
+        npage = (page_t *)malloc(pagesize);
+    }
+
+    if(!npage) {
+        ++stats.faults;
         fault();
+        return NULL;
+    }
 
     ++count;
+    stats.reserve(pagesize);
+
+init:
     npage->used = sizeof(page_t);
-    npage->next = page;
-    page = npage;
+    npage->avail = NULL;
+    npage->next = NULL;
+    if(tail)
+        tail->next = npage;
+    else
+        page = npage;
+    tail = npage;
     if((size_t)(npage) % sizeof(void *))
         npage->used += sizeof(void *) - ((size_t)(npage) % sizeof(void
 *));
+    stats.used += npage->used;
     return npage;
 }
 
+memalloc::region_t *memalloc::region(size_t size)
+{
+#if defined(HAVE_SYS_MMAN_H) && defined(MAP_ANONYMOUS)
+    caddr_t base = (caddr_t)MAP_FAILED;
+    region_t *rp;
+
+    size = ((size + HUGEPAGE_SIZE - 1) / HUGEPAGE_SIZE) * HUGEPAGE_SIZE;
+
+#ifdef  MAP_HUGETLB
+    base = (caddr_t)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+
+    // fall back to transparent huge pages if none are reserved...
+    if(base == (caddr_t)MAP_FAILED) {
+        base = (caddr_t)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(base == (caddr_t)MAP_FAILED)
+            return NULL;
+#ifdef  MADV_HUGEPAGE
+        madvise(base, size, MADV_HUGEPAGE);
+#endif
+    }
+
+    if(mapping & PREFAULT) {
+        for(size_t pos = 0; pos < size; pos += 4096)
+            base[pos] = 0;
+    }
+
+    // a region that cannot be locked is as good as one never mapped...
+    if((mapping & LOCKED) && mlock(base, size)) {
+        munmap(base, size);
+        return NULL;
+    }
+
+    rp = (region_t *)malloc(sizeof(region_t));
+    if(!rp) {
+        munmap(base, size);
+        return NULL;
+    }
+
+    rp->base = base;
+    rp->size = size;
+    rp->used = 0;
+    rp->next = regions;
+    regions = rp;
+    return rp;
+#else
+    return NULL;
+#endif
+}
+
+memalloc::page_t *memalloc::carve(void)
+{
+    region_t *rp = regions;
+    page_t *p;
+
+    if(!rp || rp->used + pagesize > rp->size) {
+        rp = region(pagesize);
+        if(!rp)
+            return NULL;
+    }
+
+    p = (page_t *)(rp->base + rp->used);
+    rp->used += pagesize;
+    return p;
+}
+
+bool memalloc::backing(unsigned options, size_t reserve)
+{
+    if(page || spare)
+        return false;
+
+#if !defined(HAVE_SYS_MMAN_H) || !defined(MAP_ANONYMOUS)
+    if(options & HUGEPAGES)
+        return false;
+#endif
+
+    mapping = options;
+    if((mapping & HUGEPAGES) && reserve && !regions && !region(reserve)) {
+        mapping = 0;
+        return false;
+    }
+    return true;
+}
+
+memalloc::mark_t memalloc::mark(void)
+{
+    mark_t point;
+
+    point.page = tail;
+    point.active = active;
+    point.inuse = stats.used;
+    if(active)
+        point.used = active->used;
+    else
+        point.used = 0;
+
+    // older page tails cannot be rolled back, so keep them out of reach
+    memcpy(point.avail, avail, sizeof(avail));
+    memset(avail, 0, sizeof(avail));
+    return point;
+}
+
+void memalloc::rewind(const mark_t& point)
+{
+    page_t *next = page;
+
+    if(point.page)
+        next = point.page->next;
+
+    // pages acquired since the mark are kept for re-use...
+    if(next) {
+        tail->next = spare;
+        spare = next;
+    }
+
+    if(point.page)
+        point.page->next = NULL;
+    else
+        page = NULL;
+
+    tail = point.page;
+    active = point.active;
+    if(active)
+        active->used = point.used;
+    stats.used = point.inuse;
+
+    // only pages retired since the mark are indexed, and those are now
+    // either spare or the restored active page...
+    memcpy(avail, point.avail, sizeof(avail));
+}
+
+void memalloc::retire(page_t *p)
+{
+    size_t remains = pagesize - p->used;
+
+    // pages with no usable space left are simply dropped from the index
+    if(remains < sizeof(void *))
+        return;
+
+    unsigned sc = sizeclass(remains);
+    p->avail = avail[sc];
+    avail[sc] = p;
+}
+
+memalloc::page_t *memalloc::fit(size_t size)
+{
+    unsigned sc = sizeclass(size);
+    page_t *p = avail[sc];
+
+    // pages in the request's own class may still be too small...
+    if(p && size <= pagesize - p->used) {
+        avail[sc] = p->avail;
+        return p;
+    }
+
+    // any page in a higher class always fits
+    while(++sc < 32) {
+        p = avail[sc];
+        if(p) {
+            avail[sc] = p->avail;
+            return p;
+        }
+    }
+    return NULL;
+}
+
 void *memalloc::_alloc(size_t size)
 {
     assert(size > 0);
 
     caddr_t mem;
-    page_t *p = page;
+    page_t *p = active;
+    size_t request = size;
 
     if(size > (pagesize - sizeof(page_t))) {
+        ++stats.faults;
         fault();
         return NULL;
     }
@@ -171,16 +593,28 @@ void *memalloc::_alloc(size_t size)
     while(size % sizeof(void *))
         ++size;
 
-    while(p) {
-        if(size <= pagesize - p->used)
-            break;
-        p = p->next;
-    }
-    if(!p)
+    if(!p || size > pagesize - p->used) {
+        p = fit(size);
+        if(p) {
+            mem = ((caddr_t)(p)) + p->used;
+            p->used += size;
+            stats.alloc(request, size);
+            retire(p);
+            return mem;
+        }
+
         p = pager();
+        if(!p)
+            return NULL;
+
+        if(active)
+            retire(active);
+        active = p;
+    }
 
     mem = ((caddr_t)(p)) + p->used;
     p->used += size;
+    stats.alloc(request, size);
     return mem;
 }
 
@@ -223,10 +657,37 @@ void mempager::purge(void)
     pthread_mutex_unlock(&mutex);
 }
 
+memalloc::mark_t mempager::mark(void)
+{
+    mark_t point;
+
+    pthread_mutex_lock(&mutex);
+    point = memalloc::mark();
+    pthread_mutex_unlock(&mutex);
+    return point;
+}
+
+void mempager::rewind(const mark_t& point)
+{
+    pthread_mutex_lock(&mutex);
+    memalloc::rewind(point);
+    pthread_mutex_unlock(&mutex);
+}
+
 void mempager::dealloc(void *mem)
 {
 }
 
+memstats mempager::statistics(void)
+{
+    memstats copy;
+
+    pthread_mutex_lock(&mutex);
+    copy = stats;
+    pthread_mutex_unlock(&mutex);
+    return copy;
+}
+
 void *mempager::_alloc(size_t size)
 {
     assert(size > 0);
@@ -238,6 +699,221 @@ void *mempager::_alloc(size_t size)
     return mem;
 }
 
+class __LOCAL shardpager::shard : public mempager
+{
+public:
+    shard *next, *reuse;
+    shardpager *owner;
+
+    shard(shardpager *pager, size_t ps, unsigned max);
+
+    void release(void);
+};
+
+shardpager::shard::shard(shardpager *pager, size_t ps, unsigned max) :
+mempager(ps)
+{
+    owner = pager;
+    limit = max;
+    reuse = NULL;
+    next = pager->list;
+    pager->list = this;
+}
+
+void shardpager::shard::release(void)
+{
+    // thread exited, offer sub-arena to the next new thread...
+    pthread_mutex_lock(&owner->mutex);
+    reuse = owner->idle;
+    owner->idle = this;
+    pthread_mutex_unlock(&owner->mutex);
+}
+
+extern "C" {
+
+    static void shard_release(void *obj)
+    {
+        if(obj)
+            (static_cast<shardpager::shard *>(obj))->release();
+    }
+}
+
+shardpager::shardpager(size_t ps, unsigned max)
+{
+    pagesize = ps;
+    limit = max;
+    count = 0;
+    sizes = false;
+    list = idle = NULL;
+    pthread_mutex_init(&mutex, NULL);
+#if defined(_MSTHREADS_)
+    key = TlsAlloc();
+    keyed = (key != TLS_OUT_OF_INDEXES);
+#elif defined(__PTH__)
+    keyed = (pth_key_create(&key, &shard_release) != 0);
+#else
+    keyed = (pthread_key_create(&key, &shard_release) == 0);
+#endif
+}
+
+shardpager::~shardpager()
+{
+    shard *next;
+
+    if(keyed) {
+#if defined(_MSTHREADS_)
+        TlsFree(key);
+#elif defined(__PTH__)
+        pth_key_delete(key);
+#else
+        pthread_key_delete(key);
+#endif
+    }
+
+    while(list) {
+        next = list->next;
+        delete list;
+        list = next;
+    }
+    pthread_mutex_destroy(&mutex);
+}
+
+shardpager::shard *shardpager::local(void)
+{
+    shard *sp;
+
+    // out of thread keys, so all threads share one locked sub-arena...
+    if(!keyed) {
+        pthread_mutex_lock(&mutex);
+        sp = list;
+        if(!sp) {
+            sp = new shard(this, pagesize, limit);
+            sp->histogram(sizes);
+            ++count;
+        }
+        pthread_mutex_unlock(&mutex);
+        return sp;
+    }
+
+#if defined(_MSTHREADS_)
+    sp = (shard *)TlsGetValue(key);
+#elif defined(__PTH__)
+    sp = (shard *)pth_key_getdata(key);
+#else
+    sp = (shard *)pthread_getspecific(key);
+#endif
+
+    if(sp)
+        return sp;
+
+    pthread_mutex_lock(&mutex);
+    sp = idle;
+    if(sp)
+        idle = sp->reuse;
+    else {
+        sp = new shard(this, pagesize, limit);
+        sp->histogram(sizes);
+        ++count;
+    }
+    pthread_mutex_unlock(&mutex);
+
+#if defined(_MSTHREADS_)
+    TlsSetValue(key, sp);
+#elif defined(__PTH__)
+    pth_key_setdata(key, sp);
+#else
+    pthread_setspecific(key, sp);
+#endif
+    return sp;
+}
+
+unsigned shardpager::pages(void)
+{
+    unsigned total = 0;
+    shard *sp;
+
+    pthread_mutex_lock(&mutex);
+    sp = list;
+    while(sp) {
+        total += sp->pages();
+        sp = sp->next;
+    }
+    pthread_mutex_unlock(&mutex);
+    return total;
+}
+
+unsigned shardpager::utilization(void)
+{
+    unsigned long used = 0, total = 0;
+    unsigned paged;
+    shard *sp;
+
+    pthread_mutex_lock(&mutex);
+    sp = list;
+    while(sp) {
+        paged = sp->pages();
+        used += (unsigned long)sp->utilization() * paged;
+        total += paged;
+        sp = sp->next;
+    }
+    pthread_mutex_unlock(&mutex);
+
+    if(!total)
+        return 0;
+
+    return (unsigned)(used / total);
+}
+
+memstats shardpager::statistics(void)
+{
+    memstats total;
+    shard *sp;
+
+    pthread_mutex_lock(&mutex);
+    sp = list;
+    total.histogram = sizes;
+    while(sp) {
+        total += sp->statistics();
+        sp = sp->next;
+    }
+    pthread_mutex_unlock(&mutex);
+    return total;
+}
+
+void shardpager::histogram(bool enable)
+{
+    shard *sp;
+
+    pthread_mutex_lock(&mutex);
+    sizes = enable;
+    sp = list;
+    while(sp) {
+        sp->histogram(enable);
+        sp = sp->next;
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+void shardpager::purge(void)
+{
+    shard *sp;
+
+    pthread_mutex_lock(&mutex);
+    sp = list;
+    while(sp) {
+        sp->purge();
+        sp = sp->next;
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+void *shardpager::_alloc(size_t size)
+{
+    assert(size > 0);
+
+    return local()->_alloc(size);
+}
+
 ObjectPager::member::member(LinkedObject **root) :
 LinkedObject(root)
 {
@@ -404,6 +1080,8 @@ memalloc(size)
     root = NULL;
     last = NULL;
     index = NULL;
+    hashed = NULL;
+    hashsize = hashcount = 0;
 }
 
 StringPager::StringPager(char **list, size_t size) :
@@ -412,9 +1090,99 @@ memalloc(size)
     members = 0;
     root = NULL;
     last = NULL;
+    index = NULL;
+    hashed = NULL;
+    hashsize = hashcount = 0;
     add(list);
 }
 
+StringPager::~StringPager()
+{
+    reset();
+}
+
+void StringPager::reset(void)
+{
+    if(hashed)
+        delete[] hashed;
+    hashed = NULL;
+    hashsize = hashcount = 0;
+}
+
+StringPager::member **StringPager::slot(const char *text)
+{
+    unsigned pos = strhash(text) & (hashsize - 1);
+
+    while(hashed[pos] && strcmp(hashed[pos]->text, text))
+        pos = (pos + 1) & (hashsize - 1);
+
+    return &hashed[pos];
+}
+
+void StringPager::rehash(unsigned size)
+{
+    member **prior = hashed;
+    unsigned pos = hashsize;
+
+    hashed = new member*[size];
+    memset(hashed, 0, sizeof(member *) * size);
+    hashsize = size;
+
+    while(pos--) {
+        if(prior[pos])
+            *slot(prior[pos]->text) = prior[pos];
+    }
+
+    if(prior)
+        delete[] prior;
+}
+
+void StringPager::insert(member *node)
+{
+    member **sp;
+
+    if((hashcount + 1) * 2 > hashsize)
+        rehash(hashsize * 2);
+
+    sp = slot(node->text);
+    if(!*sp) {
+        *sp = node;
+        ++hashcount;
+    }
+}
+
+const char *StringPager::find(const char *text)
+{
+    if(!text)
+        text = "";
+
+    if(!hashed) {
+        rehash(64);
+        linked_pointer<member> mp = root;
+        while(is(mp)) {
+            insert(*mp);
+            mp.next();
+        }
+    }
+
+    member *node = *slot(text);
+    if(node)
+        return node->text;
+
+    return NULL;
+}
+
+const char *StringPager::intern(const char *text)
+{
+    const char *str = find(text);
+
+    if(str)
+        return str;
+
+    add(text);
+    return last->text;
+}
+
 bool StringPager::filter(char *buffer, size_t size)
 {
     add(buffer);
@@ -520,6 +1288,7 @@ void StringPager::set(unsigned ind, const char *text)
     char *str = (char *)memalloc::_alloc(size);
     strcpy(str, text);
     list->text = str;
+    reset();
 }
 
 const char *StringPager::invalid(void) const
@@ -547,6 +1316,7 @@ void StringPager::clear(void)
     root = NULL;
     last = NULL;
     index = NULL;
+    reset();
 }
 
 const char *StringPager::pull(void)
@@ -565,6 +1335,7 @@ const char *StringPager::pull(void)
     else
         root = mem->Next;
     index = NULL;
+    reset();
     return result;
 }
 
@@ -585,6 +1356,8 @@ void StringPager::push(const char *text)
         last = node;
     ++members;
     index = NULL;
+    if(hashed)
+        insert(node);
 }
 
 const char *StringPager::pop(void)
@@ -595,6 +1368,7 @@ const char *StringPager::pop(void)
         return invalid();
 
     index = NULL;
+    reset();
 
     if(root == last) {
         out = last->text;
@@ -637,6 +1411,8 @@ void StringPager::add(const char *text)
     else
         node = new(mem) member(&root, str);
     last = node;
+    if(hashed)
+        insert(node);
 }
 
 void StringPager::set(char **list)
@@ -674,22 +1450,67 @@ void StringPager::sort(void)
     if(!members)
         return;
 
-    member **list = new member*[members];
     unsigned pos = 0;
     linked_pointer<member> mp = root;
 
+    if(collating()) {
+        member **list = new member*[members];
+
+        while(is(mp)) {
+            list[pos++] = *mp;
+            mp.next();
+        }
+
+        qsort(static_cast<void *>(list), members, sizeof(member *), &ncompare);
+        root = NULL;
+        last = list[members - 1];
+        while(pos)
+            list[--pos]->enlist(&root);
+
+        delete[] list;
+        index = NULL;
+        return;
+    }
+
+    sortkey_t *list = new sortkey_t[members * 2];
+
     while(is(mp)) {
-        list[pos++] = *mp;
+        list[pos].key = sortprefix(mp->get());
+        list[pos++].node = *mp;
         mp.next();
     }
 
-    qsort(static_cast<void *>(list), members, sizeof(member *), &ncompare);
+    sortkeys(list, list + members, members, 0);
     root = NULL;
+    last = list[members - 1].node;
     while(pos)
-        list[--pos]->enlist(&root);
+        list[--pos].node->enlist(&root);
+
+    delete[] list;
+    index = NULL;
+}
+
+StringPager::mark_t StringPager::mark(void)
+{
+    mark_t point;
+
+    point.pager = memalloc::mark();
+    point.root = root;
+    point.last = last;
+    point.members = members;
+    return point;
+}
 
-    delete list;
+void StringPager::rewind(const mark_t& point)
+{
+    memalloc::rewind(point.pager);
+    root = point.root;
+    last = point.last;
+    members = point.members;
     index = NULL;
+    reset();
+    if(last)
+        last->set(NULL);
 }
 
 char **StringPager::list(void)
@@ -787,7 +1608,7 @@ void autorelease::operator+=(LinkedObject *obj)
 }
 
 PagerObject::PagerObject() :
-LinkedObject(NULL), CountedObject()
+LinkedObject(), CountedObject()
 {
 }
 
@@ -807,23 +1628,203 @@ void PagerObject::release(void)
     CountedObject::release();
 }
 
+// objects a thread keeps for itself before giving half back...
+#define MAGAZINE    32
+
+class __LOCAL PagerPool::magazine
+{
+public:
+    magazine *next, *reuse;
+    PagerPool *owner;
+    LinkedObject *objects;
+    unsigned count;
+    memstats stats;
+
+    magazine(PagerPool *pool);
+
+    void release(void);
+};
+
+PagerPool::magazine::magazine(PagerPool *pool)
+{
+    owner = pool;
+    objects = NULL;
+    count = 0;
+    reuse = NULL;
+    stats.histogram = pool->stats.histogram;
+    next = pool->list;
+    pool->list = this;
+}
+
+void PagerPool::magazine::release(void)
+{
+    LinkedObject *obj;
+
+    // thread exited, free objects go back to the pool...
+    pthread_mutex_lock(&owner->mutex);
+    while(objects) {
+        obj = objects;
+        objects = obj->getNext();
+        obj->enlist(&owner->freelist);
+    }
+    count = 0;
+    reuse = owner->idle;
+    owner->idle = this;
+    pthread_mutex_unlock(&owner->mutex);
+}
+
+extern "C" {
+
+    static void magazine_release(void *obj)
+    {
+        if(obj)
+            (static_cast<PagerPool::magazine *>(obj))->release();
+    }
+}
+
 PagerPool::PagerPool()
 {
     freelist = NULL;
+    unit = 0;
+    list = idle = NULL;
     pthread_mutex_init(&mutex, NULL);
+#if defined(_MSTHREADS_)
+    key = TlsAlloc();
+    keyed = (key != TLS_OUT_OF_INDEXES);
+#elif defined(__PTH__)
+    keyed = (pth_key_create(&key, &magazine_release) != 0);
+#else
+    keyed = (pthread_key_create(&key, &magazine_release) == 0);
+#endif
 }
 
 PagerPool::~PagerPool()
 {
+    magazine *next;
+
+    if(keyed) {
+#if defined(_MSTHREADS_)
+        TlsFree(key);
+#elif defined(__PTH__)
+        pth_key_delete(key);
+#else
+        pthread_key_delete(key);
+#endif
+    }
+
+    while(list) {
+        next = list->next;
+        delete list;
+        list = next;
+    }
     pthread_mutex_destroy(&mutex);
 }
 
+PagerPool::magazine *PagerPool::local(void)
+{
+    magazine *mp;
+
+    // out of thread keys, so objects only go through the locked list...
+    if(!keyed)
+        return NULL;
+
+#if defined(_MSTHREADS_)
+    mp = (magazine *)TlsGetValue(key);
+#elif defined(__PTH__)
+    mp = (magazine *)pth_key_getdata(key);
+#else
+    mp = (magazine *)pthread_getspecific(key);
+#endif
+
+    if(mp)
+        return mp;
+
+    pthread_mutex_lock(&mutex);
+    mp = idle;
+    if(mp)
+        idle = mp->reuse;
+    else
+        mp = new magazine(this);
+    pthread_mutex_unlock(&mutex);
+
+#if defined(_MSTHREADS_)
+    TlsSetValue(key, mp);
+#elif defined(__PTH__)
+    pth_key_setdata(key, mp);
+#else
+    pthread_setspecific(key, mp);
+#endif
+    return mp;
+}
+
 void PagerPool::put(PagerObject *ptr)
 {
     assert(ptr != NULL);
 
+    magazine *mp = local();
+    LinkedObject *obj;
+
+    if(!mp) {
+        pthread_mutex_lock(&mutex);
+        ptr->enlist(&freelist);
+        stats.release(unit);
+        pthread_mutex_unlock(&mutex);
+        return;
+    }
+
+    // magazine is full, give back the half used longest ago...
+    if(mp->count >= MAGAZINE) {
+        LinkedObject *tail = mp->objects;
+        unsigned keep = MAGAZINE / 2;
+
+        while(--keep)
+            tail = tail->getNext();
+
+        obj = tail->getNext();
+        static_cast<PagerObject *>(tail)->Next = NULL;
+        mp->count = MAGAZINE / 2;
+
+        pthread_mutex_lock(&mutex);
+        while(obj) {
+            tail = obj->getNext();
+            obj->enlist(&freelist);
+            obj = tail;
+        }
+        pthread_mutex_unlock(&mutex);
+    }
+
+    ptr->enlist(&mp->objects);
+    ++mp->count;
+    mp->stats.release(unit);
+}
+
+memstats PagerPool::statistics(void)
+{
+    memstats copy;
+    magazine *mp;
+
+    pthread_mutex_lock(&mutex);
+    copy = stats;
+    mp = list;
+    while(mp) {
+        copy += mp->stats;
+        mp = mp->next;
+    }
+    pthread_mutex_unlock(&mutex);
+    return copy;
+}
+
+void PagerPool::histogram(bool enable)
+{
+    magazine *mp;
+
     pthread_mutex_lock(&mutex);
-    ptr->enlist(&freelist);
+    stats.histogram = enable;
+    mp = list;
+    while(mp) {
+        mp->stats.histogram = enable;
+        mp = mp->next;
+    }
     pthread_mutex_unlock(&mutex);
 }
 
@@ -831,13 +1832,42 @@ PagerObject *PagerPool::get(size_t size)
 {
     assert(size > 0);
 
-    PagerObject *ptr;
-    pthread_mutex_lock(&mutex);
-    ptr = static_cast<PagerObject *>(freelist);
-    if(ptr)
-        freelist = ptr->Next;
+    magazine *mp = local();
+    PagerObject *ptr = NULL;
+    LinkedObject *obj;
 
-    pthread_mutex_unlock(&mutex);
+    // magazine is empty, refill half of it from the pool...
+    if(!mp || !mp->objects) {
+        pthread_mutex_lock(&mutex);
+        if(!unit)
+            unit = size;
+        if(!mp) {
+            ptr = static_cast<PagerObject *>(freelist);
+            if(ptr)
+                freelist = ptr->Next;
+            else
+                stats.reserve(size);
+            stats.alloc(size, size);
+        }
+        while(mp && freelist && mp->count < MAGAZINE / 2) {
+            obj = freelist;
+            freelist = obj->getNext();
+            obj->enlist(&mp->objects);
+            ++mp->count;
+        }
+        pthread_mutex_unlock(&mutex);
+    }
+
+    if(mp) {
+        ptr = static_cast<PagerObject *>(mp->objects);
+        if(ptr) {
+            mp->objects = ptr->Next;
+            --mp->count;
+        }
+        else
+            mp->stats.reserve(size);
+        mp->stats.alloc(size, size);
+    }
 
     if(!ptr)
         ptr = new((caddr_t)(_alloc(size))) PagerObject;
@@ -848,30 +1878,35 @@ PagerObject *PagerPool::get(size_t size)
 }
 
 keyassoc::keydata::keydata(keyassoc *assoc, const char *kid, unsigned max, unsigned bufsize) :
-NamedObject(assoc->root, strdup(kid), max)
+NamedObject()
 {
     assert(assoc != NULL);
     assert(kid != NULL && *kid != 0);
-    assert(max > 1);
 
     String::set(text, bufsize, kid);
     data = NULL;
-    Id = text;
+    if(max)
+        NamedObject::add(assoc->root, text, max);
+    else
+        assoc->table.add(this, text);
 }
 
 keyassoc::keyassoc(unsigned pathmax, size_t strmax, size_t ps) :
 mempager(ps)
 {
-    assert(pathmax > 1);
-    assert(strmax > 1);
-    assert(ps > 1);
+    assert(pathmax != 1);
 
     paths = pathmax;
     keysize = strmax;
     keycount = 0;
 
-    root = (NamedObject **)_alloc(sizeof(NamedObject *) * pathmax);
-    memset(root, 0, sizeof(NamedObject *) * pathmax);
+    if(paths) {
+        root = (NamedObject **)_alloc(sizeof(NamedObject *) * pathmax);
+        memset(root, 0, sizeof(NamedObject *) * pathmax);
+    }
+    else
+        root = NULL;
+
     if(keysize) {
         list = (LinkedObject **)_alloc(sizeof(LinkedObject *) * (keysize / 8));
         memset(list, 0, sizeof(LinkedObject *) * (keysize / 8));
@@ -888,8 +1923,18 @@ keyassoc::~keyassoc()
 void keyassoc::purge(void)
 {
     mempager::purge();
+    table.clear();
     list = NULL;
     root = NULL;
+    keycount = 0;
+}
+
+keyassoc::keydata *keyassoc::find(const char *id)
+{
+    if(!paths)
+        return static_cast<keydata *>(table.map(id));
+
+    return static_cast<keydata *>(NamedObject::map(root, id, paths));
 }
 
 void *keyassoc::locate(const char *id)
@@ -899,7 +1944,7 @@ void *keyassoc::locate(const char *id)
     keydata *kd;
 
     _lock();
-    kd = static_cast<keydata *>(NamedObject::map(root, id, paths));
+    kd = find(id);
     _unlock();
     if(!kd)
         return NULL;
@@ -914,21 +1959,23 @@ void *keyassoc::remove(const char *id)
     keydata *kd;
     LinkedObject *obj;
     void *data;
-    unsigned path = NamedObject::keyindex(id, paths);
     unsigned size = strlen(id);
 
     if(!keysize || size >= keysize || !list)
         return NULL;
 
     _lock();
-    kd = static_cast<keydata *>(NamedObject::map(root, id, paths));
+    kd = find(id);
     if(!kd) {
         _unlock();
         return NULL;
     }
     data = kd->data;
     obj = static_cast<LinkedObject*>(kd);
-    obj->delist((LinkedObject**)(&root[path]));
+    if(paths)
+        obj->delist((LinkedObject**)(&root[NamedObject::keyindex(id, paths)]));
+    else
+        table.remove(id);
     obj->enlist(&list[size / 8]);
     --keycount;
     _unlock();
@@ -949,7 +1996,7 @@ void *keyassoc::allocate(const char *id, size_t dsize)
         return NULL;
 
     _lock();
-    kd = static_cast<keydata *>(NamedObject::map(root, id, paths));
+    kd = find(id);
     if(kd) {
         _unlock();
         return NULL;
@@ -987,7 +2034,7 @@ bool keyassoc::create(const char *id, void *data)
         return false;
 
     _lock();
-    kd = static_cast<keydata *>(NamedObject::map(root, id, paths));
+    kd = find(id);
     if(kd) {
         _unlock();
         return false;
@@ -1021,7 +2068,7 @@ bool keyassoc::assign(const char *id, void *data)
         return false;
 
     _lock();
-    kd = static_cast<keydata *>(NamedObject::map(root, id, paths));
+    kd = find(id);
     if(!kd) {
         caddr_t ptr = NULL;
         size /= 8;
@@ -1124,17 +2171,16 @@ void bufpager::put(const char *text, size_t iosize)
                     return;
                 }
 
-                page_t *p = page;
+                page_t *p = active;
                 unsigned size = 0;
 
-                while(p) {
+                if(p)
                     size = pagesize - p->used;
-                    if(size)
-                        break;
-                    p = p->next;
-                }
-                if(!p)
+                if(!size) {
                     p = pager();
+                    if(p)
+                        size = pagesize - p->used;
+                }
 
                 if(!p)
                     return;
@@ -1142,9 +2188,11 @@ void bufpager::put(const char *text, size_t iosize)
                 next->text = ((char *)(p)) + p->used;
                 next->used = 0;
                 next->size = size;
+                stats.used += pagesize - p->used;
                 p->used = pagesize;
             }
 
+            next->next = NULL;
             if(last)
                 last->next = next;
 
@@ -1195,17 +2243,16 @@ char *bufpager::request(size_t *iosize)
                 return NULL;
             }
 
-            page_t *p = page;
+            page_t *p = active;
             unsigned size = 0;
 
-            while(p) {
+            if(p)
                 size = pagesize - p->used;
-                if(size)
-                    break;
-                p = p->next;
-            }
-            if(!p)
+            if(!size) {
                 p = pager();
+                if(p)
+                    size = pagesize - p->used;
+            }
 
             if(!p) {
                 eom = true;
@@ -1215,9 +2262,11 @@ char *bufpager::request(size_t *iosize)
             next->text = ((char *)(p)) + p->used;
             next->used = 0;
             next->size = size;
+            stats.used += pagesize - p->used;
             p->used = pagesize;
         }
 
+        next->next = NULL;
         if(last)
             last->next = next;
 
@@ -1234,6 +2283,42 @@ void bufpager::update(size_t iosize)
     last->used += iosize;
 }
 
+unsigned bufpager::segments(void) const
+{
+    unsigned count = 0;
+    cpage_t *cpage = first;
+
+    while(cpage) {
+        if(cpage->used)
+            ++count;
+        cpage = cpage->next;
+    }
+    return count;
+}
+
+#ifndef _MSWINDOWS_
+unsigned bufpager::gather(struct iovec *iov, unsigned max, size_t offset) const
+{
+    unsigned count = 0;
+    cpage_t *cpage = first;
+
+    while(cpage && offset >= cpage->used) {
+        offset -= cpage->used;
+        cpage = cpage->next;
+    }
+
+    while(cpage && count < max) {
+        if(cpage->used > offset) {
+            iov[count].iov_base = cpage->text + offset;
+            iov[count++].iov_len = cpage->used - offset;
+        }
+        offset = 0;
+        cpage = cpage->next;
+    }
+    return count;
+}
+#endif
+
 size_t bufpager::get(char *text, size_t iosize)
 {
     if(!ccount)
@@ -1275,17 +2360,16 @@ void bufpager::add(const char *text)
                     return;
                 }
 
-                page_t *p = page;
+                page_t *p = active;
                 unsigned size = 0;
 
-                while(p) {
+                if(p)
                     size = pagesize - p->used;
-                    if(size)
-                        break;
-                    p = p->next;
-                }
-                if(!p)
+                if(!size) {
                     p = pager();
+                    if(p)
+                        size = pagesize - p->used;
+                }
 
                 if(!p) {
                     eom = true;
@@ -1295,9 +2379,11 @@ void bufpager::add(const char *text)
                 next->text = ((char *)(p)) + p->used;
                 next->used = 0;
                 next->size = size;
+                stats.used += pagesize - p->used;
                 p->used = pagesize;
             }
 
+            next->next = NULL;
             if(last)
                 last->next = next;
 
@@ -1379,17 +2465,16 @@ int bufpager::_putch(int code)
                 return EOF;
             }
 
-            page_t *p = page;
+            page_t *p = active;
             unsigned size = 0;
 
-            while(p) {
+            if(p)
                 size = pagesize - p->used;
-                if(size)
-                    break;
-                p = p->next;
-            }
-            if(!p)
+            if(!size) {
                 p = pager();
+                if(p)
+                    size = pagesize - p->used;
+            }
 
             if(!p) {
                 eom = true;
@@ -1399,9 +2484,11 @@ int bufpager::_putch(int code)
             next->text = ((char *)(p)) + p->used;
             next->used = 0;
             next->size = size;
+            stats.used += pagesize - p->used;
             p->used = pagesize;
         }
 
+        next->next = NULL;
         if(last)
             last->next = next;
 
@@ -1431,6 +2518,39 @@ void bufpager::rewind(void)
     current = first;
 }
 
+bufpager::mark_t bufpager::mark(void)
+{
+    mark_t point;
+
+    point.pager = memalloc::mark();
+    point.last = last;
+    point.used = 0;
+    if(last)
+        point.used = last->used;
+    point.count = ccount;
+    return point;
+}
+
+void bufpager::rewind(const mark_t& point)
+{
+    memalloc::rewind(point.pager);
+
+    // chunks released by reset() may live in pages given up by the rewind
+    freelist = NULL;
+    last = point.last;
+    if(last) {
+        last->used = point.used;
+        last->next = NULL;
+    }
+    else
+        first = NULL;
+
+    ccount = point.count;
+    eom = false;
+    cpos = 0;
+    current = first;
+}
+
 void bufpager::reset(void)
 {
     eom = false;
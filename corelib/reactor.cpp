@@ -0,0 +1,454 @@
+// Copyright (C) 2006-2014 David Sugar, Tycho Softworks.
+//
+// This file is part of GNU uCommon C++.
+//
+// GNU uCommon C++ is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// GNU uCommon C++ is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with GNU uCommon C++.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <ucommon-config.h>
+#include <ucommon/export.h>
+#include <ucommon/socket.h>
+#include <ucommon/thread.h>
+#include <ucommon/reactor.h>
+#ifdef  HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#include <errno.h>
+#include <string.h>
+
+#if defined(HAVE_SYS_EPOLL_H) && !defined(__PTH__)
+#include <sys/epoll.h>
+#define USE_EPOLL
+#endif
+
+#ifndef _MSWINDOWS_
+#include <sys/select.h>
+#define USE_WAKEUP
+#endif
+
+namespace ucommon {
+
+#ifdef  _MSWINDOWS_
+// without a wakeup pipe, posts and stops are seen within this interval
+#define REACTOR_INTERVAL    100
+#endif
+
+#define REACTOR_EVENTS      64
+
+struct reactor_event
+{
+    Reactor::handler *object;
+    unsigned events;
+};
+
+Reactor::notice::notice()
+{
+    next = NULL;
+}
+
+Reactor::notice::~notice()
+{
+}
+
+Reactor::handler::handler()
+{
+    reactor = NULL;
+    so = INVALID_SOCKET;
+    mask = 0;
+    next = prev = NULL;
+}
+
+Reactor::handler::~handler()
+{
+    detach();
+}
+
+bool Reactor::handler::attach(Reactor *rp, socket_t socket, unsigned events)
+{
+    detach();
+
+    if(!rp || socket == INVALID_SOCKET)
+        return false;
+
+    so = socket;
+    if(!rp->watch(this, events, true)) {
+        so = INVALID_SOCKET;
+        return false;
+    }
+
+    reactor = rp;
+    mask = events;
+    prev = NULL;
+    next = rp->handlers;
+    if(next)
+        next->prev = this;
+    rp->handlers = this;
+    ++rp->count;
+    return true;
+}
+
+bool Reactor::handler::wait(unsigned events)
+{
+    if(!reactor)
+        return false;
+
+    if(events == mask)
+        return true;
+
+    if(!reactor->watch(this, events, false))
+        return false;
+
+    mask = events;
+    return true;
+}
+
+void Reactor::handler::detach(void)
+{
+    if(!reactor)
+        return;
+
+    reactor->cancel(this);
+    if(prev)
+        prev->next = next;
+    else
+        reactor->handlers = next;
+    if(next)
+        next->prev = prev;
+    --reactor->count;
+    reactor = NULL;
+    next = prev = NULL;
+    so = INVALID_SOCKET;
+    mask = 0;
+}
+
+Reactor::Reactor() : TimerQueue()
+{
+    handlers = NULL;
+    first = last = NULL;
+    count = ready = 0;
+    limit = REACTOR_EVENTS;
+    sleeping = stopped = false;
+    wakeup[0] = wakeup[1] = INVALID_SOCKET;
+    backend = -1;
+    pending = new reactor_event[limit];
+
+#ifdef  USE_WAKEUP
+    // without a working wakeup a sleeping dispatch could never be stopped
+    int pair[2], flags;
+    bool piped = !::pipe(pair);
+    crit(piped, "reactor wakeup failed");
+    wakeup[0] = pair[0];
+    wakeup[1] = pair[1];
+    for(unsigned pos = 0; pos < 2; ++pos) {
+        flags = ::fcntl(pair[pos], F_GETFL);
+        piped = flags > -1 && !::fcntl(pair[pos], F_SETFL, flags | O_NONBLOCK) &&
+            !::fcntl(pair[pos], F_SETFD, FD_CLOEXEC);
+        crit(piped, "reactor wakeup failed");
+    }
+#endif
+
+#ifdef  USE_EPOLL
+    // if epoll cannot watch the wakeup, select with the pipe is used...
+    backend = ::epoll_create(REACTOR_EVENTS);
+    if(backend > -1) {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.ptr = NULL;
+        if(::fcntl(backend, F_SETFD, FD_CLOEXEC) ||
+            ::epoll_ctl(backend, EPOLL_CTL_ADD, wakeup[0], &ev)) {
+            ::close(backend);
+            backend = -1;
+        }
+    }
+#endif
+}
+
+Reactor::~Reactor()
+{
+    while(handlers)
+        handlers->detach();
+
+#ifdef  USE_EPOLL
+    if(backend > -1)
+        ::close(backend);
+#endif
+
+#ifdef  USE_WAKEUP
+    if(wakeup[0] != INVALID_SOCKET) {
+        ::close(wakeup[0]);
+        ::close(wakeup[1]);
+    }
+#endif
+
+    delete[] static_cast<reactor_event *>(pending);
+}
+
+void Reactor::modify(void)
+{
+}
+
+void Reactor::update(void)
+{
+    if(sleeping)
+        wake();
+}
+
+void Reactor::wake(void)
+{
+#ifdef  USE_WAKEUP
+    char buf = 0;
+    ssize_t result = 0;
+
+    // a full pipe already has a wakeup pending...
+    if(wakeup[1] != INVALID_SOCKET)
+        result = ::write(wakeup[1], &buf, 1);
+    (void)result;
+#endif
+}
+
+void Reactor::cancel(handler *object)
+{
+    reactor_event *list = static_cast<reactor_event *>(pending);
+
+    // a handler detached by an earlier callback may still be in the batch
+    for(unsigned pos = 0; pos < ready; ++pos) {
+        if(list[pos].object == object)
+            list[pos].object = NULL;
+    }
+
+#ifdef  USE_EPOLL
+    if(backend > -1) {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ::epoll_ctl(backend, EPOLL_CTL_DEL, object->so, &ev);
+    }
+#endif
+}
+
+bool Reactor::watch(handler *object, unsigned events, bool added)
+{
+#ifdef  USE_EPOLL
+    if(backend > -1) {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        if(events & INPUT)
+            ev.events |= EPOLLIN;
+        if(events & OUTPUT)
+            ev.events |= EPOLLOUT;
+        ev.data.ptr = object;
+        if(::epoll_ctl(backend, added ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, object->so, &ev))
+            return false;
+        return true;
+    }
+#endif
+
+    // select can only watch a fixed set of sockets...
+#ifdef  _MSWINDOWS_
+    if(added && count >= FD_SETSIZE)
+        return false;
+#else
+    if(object->so >= FD_SETSIZE)
+        return false;
+#endif
+
+    return true;
+}
+
+unsigned Reactor::select(timeout_t timeout)
+{
+    reactor_event *list = static_cast<reactor_event *>(pending);
+    unsigned total = 0;
+    int status;
+
+#ifdef  USE_EPOLL
+    if(backend > -1) {
+        struct epoll_event events[REACTOR_EVENTS];
+        handler *object;
+        unsigned mask;
+
+        status = ::epoll_wait(backend, events, REACTOR_EVENTS, timeout == Timer::inf ? -1 : (int)timeout);
+        for(int pos = 0; pos < status; ++pos) {
+            object = static_cast<handler *>(events[pos].data.ptr);
+            if(!object)
+                continue;
+            mask = 0;
+            if(events[pos].events & EPOLLIN)
+                mask |= INPUT;
+            if(events[pos].events & EPOLLOUT)
+                mask |= OUTPUT;
+            if(events[pos].events & EPOLLHUP)
+                mask |= HANGUP;
+            if(events[pos].events & EPOLLERR)
+                mask |= FAILED;
+            list[total].object = object;
+            list[total++].events = mask;
+        }
+        return total;
+    }
+#endif
+
+    struct timeval tv, *tvp = NULL;
+    fd_set inputs, outputs, errors;
+    socket_t high = 0;
+    handler *object;
+
+#ifdef  REACTOR_INTERVAL
+    if(timeout > REACTOR_INTERVAL)
+        timeout = REACTOR_INTERVAL;
+#endif
+
+    if(timeout != Timer::inf) {
+        tv.tv_sec = timeout / 1000;
+        tv.tv_usec = (timeout % 1000) * 1000;
+        tvp = &tv;
+    }
+
+    FD_ZERO(&inputs);
+    FD_ZERO(&outputs);
+    FD_ZERO(&errors);
+
+    if(wakeup[0] != INVALID_SOCKET) {
+        FD_SET(wakeup[0], &inputs);
+        high = wakeup[0];
+    }
+
+    for(object = handlers; object; object = object->next) {
+        if(!object->mask)
+            continue;
+        if(object->mask & INPUT)
+            FD_SET(object->so, &inputs);
+        if(object->mask & OUTPUT)
+            FD_SET(object->so, &outputs);
+        FD_SET(object->so, &errors);
+        if(object->so > high)
+            high = object->so;
+    }
+
+    status = ::select((int)(high + 1), &inputs, &outputs, &errors, tvp);
+    if(status < 1)
+        return 0;
+
+    if(count > limit) {
+        delete[] list;
+        limit = count;
+        list = new reactor_event[limit];
+        pending = list;
+    }
+
+    for(object = handlers; object && total < limit; object = object->next) {
+        unsigned mask = 0;
+        if(!object->mask)
+            continue;
+        if(FD_ISSET(object->so, &inputs))
+            mask |= INPUT;
+        if(FD_ISSET(object->so, &outputs))
+            mask |= OUTPUT;
+        if(FD_ISSET(object->so, &errors))
+            mask |= FAILED;
+        if(!mask)
+            continue;
+        list[total].object = object;
+        list[total++].events = mask;
+    }
+    return total;
+}
+
+unsigned Reactor::dispatch(timeout_t timeout)
+{
+    reactor_event *list;
+    unsigned total = 0;
+    notice *posted;
+    timeout_t next;
+
+    if(stopped)
+        return 0;
+
+    next = expire();
+    if(next < timeout)
+        timeout = next;
+
+    lock.acquire();
+    if(first || stopped)
+        timeout = 0;
+    sleeping = (timeout != 0);
+    lock.release();
+
+    ready = select(timeout);
+    sleeping = false;
+
+#ifdef  USE_WAKEUP
+    char buf[64];
+    while(wakeup[0] != INVALID_SOCKET && ::read(wakeup[0], buf, sizeof(buf)) > 0) {
+    }
+#endif
+
+    list = static_cast<reactor_event *>(pending);
+    for(unsigned pos = 0; pos < ready; ++pos) {
+        if(!list[pos].object)
+            continue;
+        ++total;
+        list[pos].object->ready(list[pos].events);
+    }
+    ready = 0;
+
+    expire();
+
+    lock.acquire();
+    posted = first;
+    first = last = NULL;
+    lock.release();
+
+    while(posted) {
+        notice *current = posted;
+        posted = posted->next;
+        current->next = NULL;
+        current->posted();
+        ++total;
+    }
+
+    return total;
+}
+
+void Reactor::run(void)
+{
+    while(!stopped)
+        dispatch();
+}
+
+void Reactor::stop(void)
+{
+    lock.acquire();
+    stopped = true;
+    if(sleeping)
+        wake();
+    lock.release();
+}
+
+void Reactor::post(notice *object)
+{
+    assert(object != NULL);
+
+    lock.acquire();
+    object->next = NULL;
+    if(last)
+        last->next = object;
+    else
+        first = object;
+    last = object;
+    if(sleeping)
+        wake();
+    lock.release();
+}
+
+} // namespace ucommon
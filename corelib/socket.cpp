@@ -2013,6 +2013,40 @@ size_t Socket::writes(const char *str)
     return writeto(str, strlen(str), NULL);
 }
 
+#ifndef _MSWINDOWS_
+ssize_t Socket::sendv(socket_t so, const struct iovec *iov, unsigned count, int flags)
+{
+    assert(iov != NULL);
+
+    struct msghdr msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = const_cast<struct iovec *>(iov);
+    msg.msg_iovlen = count;
+    return ::sendmsg(so, &msg, MSG_NOSIGNAL | flags);
+}
+
+size_t Socket::writev(const bufpager& buffer)
+{
+    struct iovec iov[16];
+    unsigned count;
+    size_t total = 0;
+    ssize_t result;
+
+    while(0 != (count = buffer.gather(iov, 16, total))) {
+        result = sendv(so, iov, count);
+        if(result < 0) {
+            ioerr = Socket::error();
+            break;
+        }
+        if(!result)
+            break;
+        total += result;
+    }
+    return total;
+}
+#endif
+
 size_t Socket::readline(char *data, size_t max)
 {
     assert(data != NULL);
@@ -3325,7 +3359,7 @@ unsigned Socket::copy(struct sockaddr *s1, const struct sockaddr *s2)
         return 0;
 
     socklen_t slen = len(s1);
-    if(len > 0) {
+    if(slen > 0) {
         memcpy(s1, s2, slen);
         return slen;
     }
@@ -0,0 +1,670 @@
+// Copyright (C) 2006-2014 David Sugar, Tycho Softworks.
+//
+// This file is part of GNU uCommon C++.
+//
+// GNU uCommon C++ is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// GNU uCommon C++ is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with GNU uCommon C++.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <ucommon-config.h>
+#include <ucommon/export.h>
+#include <ucommon/thread.h>
+#include <ucommon/tasks.h>
+#include <string.h>
+
+namespace ucommon {
+
+enum {TASK_IDLE = 0, TASK_QUEUED, TASK_DONE};
+
+#ifdef  HAVE_GCC_ATOMICS
+static inline unsigned task_add(volatile unsigned *value, int offset)
+{
+    return __sync_add_and_fetch(value, offset);
+}
+#endif
+
+// Chase-Lev deque, where only the owning worker pushes and pops at the
+// bottom while other workers steal from the top.  The ring never grows
+// since the pool bounds how many tasks can be queued at once.
+class __LOCAL task_deque
+{
+private:
+    Task **ring;
+    long mask;
+    volatile long top, bottom;
+#ifndef HAVE_GCC_ATOMICS
+    pthread_mutex_t mutex;
+#endif
+
+public:
+    task_deque(unsigned size);
+    ~task_deque();
+
+    bool push(Task *task);
+    Task *pop(void);
+    Task *steal(void);
+};
+
+// inbox for tasks submitted by threads outside of the pool...
+class __LOCAL task_inbox
+{
+private:
+    Task **ring;
+    unsigned mask, head, tail;
+    pthread_mutex_t mutex;
+
+public:
+    task_inbox(unsigned size);
+    ~task_inbox();
+
+    bool push(Task *task);
+    Task *pull(void);
+};
+
+class __LOCAL ThreadPool::worker : public JoinableThread
+{
+public:
+    ThreadPool *pool;
+    unsigned id;
+    task_deque deque;
+    task_inbox inbox;
+
+    worker(ThreadPool *owner, unsigned index, unsigned size);
+    ~worker();
+
+    void run(void);
+};
+
+static unsigned task_ring(unsigned size)
+{
+    unsigned ring = 2;
+
+    while(ring < size)
+        ring <<= 1;
+
+    return ring;
+}
+
+task_deque::task_deque(unsigned size)
+{
+    unsigned ring = task_ring(size);
+
+    this->ring = new Task *[ring];
+    mask = ring - 1;
+    top = bottom = 0;
+#ifndef HAVE_GCC_ATOMICS
+    pthread_mutex_init(&mutex, NULL);
+#endif
+}
+
+task_deque::~task_deque()
+{
+    delete[] ring;
+#ifndef HAVE_GCC_ATOMICS
+    pthread_mutex_destroy(&mutex);
+#endif
+}
+
+#ifdef  HAVE_GCC_ATOMICS
+
+bool task_deque::push(Task *task)
+{
+    long pos = bottom;
+
+    if(pos - top > mask)
+        return false;
+
+    ring[pos & mask] = task;
+    __sync_synchronize();
+    bottom = pos + 1;
+    return true;
+}
+
+Task *task_deque::pop(void)
+{
+    long pos = bottom - 1;
+    long first;
+    Task *task;
+
+    bottom = pos;
+    __sync_synchronize();
+    first = top;
+
+    if(first > pos) {
+        bottom = pos + 1;
+        return NULL;
+    }
+
+    task = ring[pos & mask];
+    if(first == pos) {
+        // last task, race any thief for it...
+        if(!__sync_bool_compare_and_swap(&top, first, first + 1))
+            task = NULL;
+        bottom = pos + 1;
+    }
+    return task;
+}
+
+Task *task_deque::steal(void)
+{
+    long first = top;
+    Task *task;
+
+    __sync_synchronize();
+    if(first >= bottom)
+        return NULL;
+
+    task = ring[first & mask];
+    if(!__sync_bool_compare_and_swap(&top, first, first + 1))
+        return NULL;
+
+    return task;
+}
+
+#else
+
+bool task_deque::push(Task *task)
+{
+    bool result = false;
+
+    pthread_mutex_lock(&mutex);
+    if(bottom - top <= mask) {
+        ring[bottom++ & mask] = task;
+        result = true;
+    }
+    pthread_mutex_unlock(&mutex);
+    return result;
+}
+
+Task *task_deque::pop(void)
+{
+    Task *task = NULL;
+
+    pthread_mutex_lock(&mutex);
+    if(bottom > top)
+        task = ring[--bottom & mask];
+    pthread_mutex_unlock(&mutex);
+    return task;
+}
+
+Task *task_deque::steal(void)
+{
+    Task *task = NULL;
+
+    pthread_mutex_lock(&mutex);
+    if(bottom > top)
+        task = ring[top++ & mask];
+    pthread_mutex_unlock(&mutex);
+    return task;
+}
+
+#endif
+
+task_inbox::task_inbox(unsigned size)
+{
+    unsigned ring = task_ring(size);
+
+    this->ring = new Task *[ring];
+    mask = ring - 1;
+    head = tail = 0;
+    pthread_mutex_init(&mutex, NULL);
+}
+
+task_inbox::~task_inbox()
+{
+    delete[] ring;
+    pthread_mutex_destroy(&mutex);
+}
+
+bool task_inbox::push(Task *task)
+{
+    bool result = false;
+
+    pthread_mutex_lock(&mutex);
+    if(tail - head <= mask) {
+        ring[tail++ & mask] = task;
+        result = true;
+    }
+    pthread_mutex_unlock(&mutex);
+    return result;
+}
+
+Task *task_inbox::pull(void)
+{
+    Task *task = NULL;
+
+    if(head == tail)
+        return NULL;
+
+    pthread_mutex_lock(&mutex);
+    if(head != tail)
+        task = ring[head++ & mask];
+    pthread_mutex_unlock(&mutex);
+    return task;
+}
+
+Task::Task()
+{
+    pool = NULL;
+    state = TASK_IDLE;
+}
+
+Task::~Task()
+{
+    assert(state != TASK_QUEUED);
+}
+
+bool Task::is_done(void) const
+{
+    return state == TASK_DONE;
+}
+
+bool Task::wait(timeout_t timeout)
+{
+    struct timespec ts;
+    bool result = true;
+
+    if(!pool || state == TASK_DONE)
+        return state != TASK_QUEUED;
+
+    if(timeout != Timer::inf)
+        ThreadPool::set(&ts, timeout);
+
+    pool->lock();
+#ifdef  HAVE_GCC_ATOMICS
+    task_add(&pool->joiners, 1);
+#else
+    ++pool->joiners;
+#endif
+    while(result && state != TASK_DONE) {
+        if(timeout == Timer::inf)
+            pool->waitBroadcast();
+        else
+            result = pool->waitBroadcast(&ts);
+    }
+#ifdef  HAVE_GCC_ATOMICS
+    task_add(&pool->joiners, -1);
+#else
+    --pool->joiners;
+#endif
+    pool->unlock();
+    return state == TASK_DONE;
+}
+
+ThreadPool::worker::worker(ThreadPool *owner, unsigned index, unsigned size) :
+JoinableThread(), deque(size), inbox(size)
+{
+    pool = owner;
+    id = index;
+}
+
+ThreadPool::worker::~worker()
+{
+    join();
+}
+
+void ThreadPool::worker::run(void)
+{
+    Task *task;
+
+    map();
+
+    for(;;) {
+        task = pool->take(this);
+        if(task)
+            pool->execute(task);
+        else if(!pool->park())
+            break;
+    }
+}
+
+ThreadPool::ThreadPool(unsigned size, unsigned limit, bool pin) :
+ConditionalAccess(), slots(limit ? limit : (size ? size : processors()) * 256)
+{
+    if(!size)
+        size = processors();
+
+    if(!limit)
+        limit = size * 256;
+
+    count = size;
+    capacity = limit;
+    pinned = pin;
+    next = queued = outstanding = sleepers = joiners = 0;
+    stopping = false;
+
+    workers = new worker *[count];
+    for(unsigned pos = 0; pos < count; ++pos) {
+        workers[pos] = new worker(this, pos, capacity);
+        if(pinned)
+            workers[pos]->affinity(cpumask(pos % processors()));
+    }
+
+    for(unsigned pos = 0; pos < count; ++pos)
+        workers[pos]->start();
+}
+
+ThreadPool::~ThreadPool()
+{
+    shutdown();
+}
+
+unsigned ThreadPool::processors(void)
+{
+    return Thread::processors();
+}
+
+bool ThreadPool::is_worker(void) const
+{
+    Thread *self = Thread::get();
+
+    for(unsigned pos = 0; pos < count; ++pos) {
+        if(self == workers[pos])
+            return true;
+    }
+    return false;
+}
+
+bool ThreadPool::submit(Task *task, timeout_t timeout)
+{
+    assert(task != NULL && task->state != TASK_QUEUED);
+
+    Thread *self = Thread::get();
+    worker *owner = NULL;
+    unsigned pos;
+
+    if(stopping)
+        return false;
+
+    for(pos = 0; pos < count; ++pos) {
+        if(self == workers[pos]) {
+            owner = workers[pos];
+            break;
+        }
+    }
+
+    // a worker never blocks on a full pool, since that could leave every
+    // worker waiting on the others, so it runs the task itself instead...
+    if(owner && !slots.wait(0)) {
+        task->pool = this;
+        task->state = TASK_QUEUED;
+#ifdef  HAVE_GCC_ATOMICS
+        task_add(&outstanding, 1);
+#else
+        lock();
+        ++outstanding;
+        unlock();
+#endif
+        execute(task, false);
+        return true;
+    }
+
+    if(!owner && !slots.wait(timeout))
+        return false;
+
+    task->pool = this;
+    task->state = TASK_QUEUED;
+
+    // counted before queueing so a fast thief never sees queued underflow
+#ifdef  HAVE_GCC_ATOMICS
+    task_add(&outstanding, 1);
+    task_add(&queued, 1);
+#else
+    lock();
+    ++outstanding;
+    ++queued;
+    unlock();
+#endif
+
+    // workers queue their own sub-tasks without touching shared state...
+    if(!owner || !owner->deque.push(task)) {
+#ifdef  HAVE_GCC_ATOMICS
+        pos = task_add(&next, 1) % count;
+#else
+        lock();
+        pos = next++ % count;
+        unlock();
+#endif
+        // room is assured since the pool limit bounds every inbox...
+        while(!workers[pos]->inbox.push(task))
+            pos = (pos + 1) % count;
+    }
+
+#ifdef  HAVE_GCC_ATOMICS
+    __sync_synchronize();
+#endif
+    if(sleepers) {
+        lock();
+        signal();
+        unlock();
+    }
+    return true;
+}
+
+Task *ThreadPool::take(worker *self)
+{
+    Task *task = self->deque.pop();
+    worker *victim;
+
+    if(!task)
+        task = self->inbox.pull();
+
+    for(unsigned pos = 1; !task && pos < count; ++pos) {
+        victim = workers[(self->id + pos) % count];
+        task = victim->deque.steal();
+        if(!task)
+            task = victim->inbox.pull();
+    }
+
+    if(task) {
+#ifdef  HAVE_GCC_ATOMICS
+        task_add(&queued, -1);
+#else
+        lock();
+        --queued;
+        unlock();
+#endif
+    }
+    return task;
+}
+
+bool ThreadPool::park(void)
+{
+    bool result;
+
+    lock();
+#ifdef  HAVE_GCC_ATOMICS
+    task_add(&sleepers, 1);
+#else
+    ++sleepers;
+#endif
+    if(!queued && !stopping)
+        waitSignal();
+#ifdef  HAVE_GCC_ATOMICS
+    task_add(&sleepers, -1);
+#else
+    --sleepers;
+#endif
+    result = queued || !stopping;
+    unlock();
+    return result;
+}
+
+void ThreadPool::execute(Task *task, bool slot)
+{
+    task->run();
+
+    // the task may be deleted once done is seen, so it is not touched after
+#ifdef  HAVE_GCC_ATOMICS
+    __sync_synchronize();
+    task->state = TASK_DONE;
+    task_add(&outstanding, -1);
+    if(joiners)
+        wakeup();
+#else
+    lock();
+    task->state = TASK_DONE;
+    --outstanding;
+    if(joiners)
+        broadcast();
+    unlock();
+#endif
+    if(slot)
+        slots.release();
+}
+
+void ThreadPool::wakeup(void)
+{
+    lock();
+    broadcast();
+    unlock();
+}
+
+void ThreadPool::drain(void)
+{
+    lock();
+#ifdef  HAVE_GCC_ATOMICS
+    task_add(&joiners, 1);
+#else
+    ++joiners;
+#endif
+    while(outstanding)
+        waitBroadcast();
+#ifdef  HAVE_GCC_ATOMICS
+    task_add(&joiners, -1);
+#else
+    --joiners;
+#endif
+    unlock();
+}
+
+void ThreadPool::shutdown(void)
+{
+    if(!workers)
+        return;
+
+    drain();
+
+    lock();
+    stopping = true;
+    for(unsigned pos = 0; pos < count; ++pos)
+        signal();
+    unlock();
+
+    for(unsigned pos = 0; pos < count; ++pos)
+        delete workers[pos];
+
+    delete[] workers;
+    workers = NULL;
+}
+
+class __LOCAL Parallel::helper : public Task
+{
+public:
+    Parallel *owner;
+
+    void run(void);
+};
+
+const size_t Parallel::chunksize = 65536;
+
+void Parallel::helper::run(void)
+{
+    owner->work();
+}
+
+Parallel::Parallel(ThreadPool *tp)
+{
+    pool = tp;
+    items = grain = parts = 0;
+    next = 0;
+}
+
+Parallel::~Parallel()
+{
+}
+
+size_t Parallel::chunking(size_t size, size_t grain)
+{
+    if(grain)
+        return grain;
+
+    if(!size || size >= chunksize)
+        return 1;
+
+    return chunksize / size;
+}
+
+void Parallel::work(void)
+{
+    size_t part, first, last;
+
+    for(;;) {
+#ifdef  HAVE_GCC_ATOMICS
+        part = __sync_fetch_and_add(&next, 1);
+#else
+        Mutex::protect(this);
+        part = next++;
+        Mutex::release(this);
+#endif
+        if(part >= parts)
+            break;
+
+        first = part * grain;
+        last = first + grain;
+        if(last > items)
+            last = items;
+        process(first, last, part);
+    }
+}
+
+void Parallel::dispatch(size_t count, size_t size)
+{
+    unsigned total = 0;
+    helper *helpers;
+
+    if(!count)
+        return;
+
+    if(!size)
+        size = 1;
+
+    items = count;
+    grain = size;
+    parts = partitions(count, size);
+    next = 0;
+
+    // the caller only waits on the pool when it cannot starve it...
+    if(!pool || parts < 2 || pool->is_worker()) {
+        work();
+        return;
+    }
+
+    total = pool->size();
+    if(total > parts - 1)
+        total = (unsigned)(parts - 1);
+
+    helpers = new helper[total];
+    for(unsigned pos = 0; pos < total; ++pos) {
+        helpers[pos].owner = this;
+        pool->submit(&helpers[pos]);
+    }
+
+    work();
+
+    for(unsigned pos = 0; pos < total; ++pos)
+        helpers[pos].wait();
+
+    delete[] helpers;
+}
+
+} // namespace ucommon
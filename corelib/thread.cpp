@@ -31,6 +31,27 @@
 static int realtime_policy = SCHED_FIFO;
 #endif
 
+#if defined(HAVE_LINUX_FUTEX_H) && !defined(__PTH__) && !defined(_MSTHREADS_)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#define USE_FUTEX
+#endif
+
+#if defined(__linux__) && !defined(__PTH__) && !defined(_MSTHREADS_)
+#include <sys/syscall.h>
+#include <stdio.h>
+#if defined(SYS_sched_setattr)
+#define USE_DEADLINE
+#ifndef SCHED_DEADLINE
+#define SCHED_DEADLINE  6
+#endif
+#endif
+#endif
+
+#if defined(HAVE_PTHREAD_SETAFFINITY_NP) && defined(CPU_SET) && !defined(__PTH__) && !defined(_MSTHREADS_)
+#define USE_AFFINITY
+#endif
+
 #undef  _POSIX_SPIN_LOCKS
 
 static unsigned max_sharing = 0;
@@ -42,70 +63,82 @@ extern int _posix_clocking;
 int _posix_clocking = CLOCK_REALTIME;
 #endif
 
-struct mutex_entry
+// Pointer locks are kept in a hashed table of cache line padded buckets.
+// Each bucket holds a chain of lock entries that are never freed, so the
+// chain can be walked without holding the bucket lock.  A hit bumps the
+// entry count and rechecks the pointer; the bucket lock is only taken to
+// claim an idle entry or to add a new one.  An idle entry is reclaimed by
+// swapping its zero count for a negative value, which makes any racing
+// lookup back off until the new pointer is published.
+
+#define LOCK_CACHELINE  64
+#define LOCK_RECLAIM    0x40000000l
+#define LOCK_DEFAULT    64
+
+class __LOCAL lock_entry
 {
-    pthread_mutex_t mutex;
-    struct mutex_entry *next;
-    const void *pointer;
-    unsigned count;
+public:
+    lock_entry *next;
+    const void *volatile pointer;
+    volatile long count;
+
+    lock_entry();
 };
 
-class __LOCAL rwlock_entry : public ThreadLock
+class __LOCAL mutex_entry : public lock_entry
 {
 public:
-    rwlock_entry();
-    rwlock_entry *next;
-    const void *object;
-    unsigned count;
+    pthread_mutex_t mutex;
+
+    mutex_entry();
 };
 
-class __LOCAL mutex_index : public Mutex
+class __LOCAL rwlock_entry : public lock_entry, public ThreadLock
 {
 public:
-    struct mutex_entry *list;
-
-    mutex_index();
+    rwlock_entry();
 };
 
-class __LOCAL rwlock_index : public Mutex
+class __LOCAL lock_index : public Mutex
 {
 public:
-    rwlock_entry *list;
+    lock_entry *volatile list;
+    volatile unsigned long contended;
+
+    lock_index();
 
-    rwlock_index();
+    static lock_index *create(unsigned size);
+
+    static size_t size(void);
 };
 
-static rwlock_index single_rwlock;
-static rwlock_index *rwlock_table = &single_rwlock;
-static mutex_index single_table;
-static mutex_index *mutex_table = &single_table;
-static unsigned mutex_indexing = 1;
-static unsigned rwlock_indexing = 1;
+static lock_index *rwlock_table = NULL;
+static lock_index *mutex_table = NULL;
+static unsigned mutex_indexing = 0;
+static unsigned rwlock_indexing = 0;
 
 #ifdef  __PTH__
 static pth_key_t threadmap;
+static pth_key_t slotmap;
+static pth_key_t selfmap;
 #else
 #ifdef  _MSTHREADS_
 static DWORD threadmap;
+static DWORD slotmap;
+static DWORD selfmap;
 #else
 static pthread_key_t threadmap;
+static pthread_key_t slotmap;
+static pthread_key_t selfmap;
 #endif
 #endif
 
-mutex_index::mutex_index() : Mutex()
-{
-    list = NULL;
-}
-
-rwlock_index::rwlock_index() : Mutex()
-{
-    list = NULL;
-}
-
-rwlock_entry::rwlock_entry() : ThreadLock()
-{
-    count = 0;
-}
+// small per thread slot numbers, reused when threads exit...
+static pthread_mutex_t slot_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned *slot_free = NULL;
+static unsigned slot_frees = 0;
+static unsigned slot_limit = 0;
+static unsigned slot_next = 0;
 
 #if !defined(_MSTHREADS_) && !defined(__PTH__)
 Conditional::attribute Conditional::attr;
@@ -133,71 +166,105 @@ inline pthread_t pthread_self(void)
 
 #endif
 
-static unsigned hash_address(const void *ptr, unsigned indexing)
-{
-    assert(ptr != NULL);
+extern "C" {
 
-    unsigned key = 0;
-    unsigned count = 0;
-    const unsigned char *addr = (unsigned char *)(&ptr);
+    static void slot_release(void *obj)
+    {
+        if(!obj)
+            return;
+
+        pthread_mutex_lock(&slot_lock);
+        if(slot_frees >= slot_limit) {
+            slot_limit = slot_limit ? slot_limit * 2 : 32;
+            slot_free = (unsigned *)realloc(slot_free, sizeof(unsigned) * slot_limit);
+            crit(slot_free != NULL, "thread slot alloc failed");
+        }
+        slot_free[slot_frees++] = (unsigned)((uintptr_t)obj - 1);
+        pthread_mutex_unlock(&slot_lock);
+    }
+}
 
-    if(indexing < 2)
-        return 0;
+static unsigned thread_slot(void)
+{
+    unsigned slot;
+    void *value;
 
-    // skip lead zeros if little endian...
-    while(count < sizeof(const void *) && *addr == 0) {
-        ++count;
-        ++addr;
-    }
+#if defined(_MSTHREADS_)
+    value = TlsGetValue(slotmap);
+#elif defined(__PTH__)
+    value = pth_key_getdata(slotmap);
+#else
+    value = pthread_getspecific(slotmap);
+#endif
 
-    while(count++ < sizeof(const void *) && *addr)
-        key = (key << 1) ^ *(addr++);
+    if(value)
+        return (unsigned)((uintptr_t)value - 1);
+
+    pthread_mutex_lock(&slot_lock);
+    if(slot_frees)
+        slot = slot_free[--slot_frees];
+    else
+        slot = slot_next++;
+    pthread_mutex_unlock(&slot_lock);
 
-    return key % indexing;
+    value = (void *)((uintptr_t)slot + 1);
+#if defined(_MSTHREADS_)
+    TlsSetValue(slotmap, value);
+#elif defined(__PTH__)
+    pth_key_setdata(slotmap, value);
+#else
+    pthread_setspecific(slotmap, value);
+#endif
+    return slot;
 }
 
-ReusableAllocator::ReusableAllocator() :
-Conditional()
+// library thread objects running in the current context, kept apart from
+// the user mapping of Thread::get() so placement knows it is in-thread...
+static Thread *thread_self(void)
 {
-    freelist = NULL;
-    waiting = 0;
+#if defined(_MSTHREADS_)
+    return (Thread *)TlsGetValue(selfmap);
+#elif defined(__PTH__)
+    return (Thread *)pth_key_getdata(selfmap);
+#else
+    return (Thread *)pthread_getspecific(selfmap);
+#endif
 }
 
-void ReusableAllocator::release(ReusableObject *obj)
+static void thread_enter(Thread *th)
 {
-    assert(obj != NULL);
-
-    LinkedObject **ru = (LinkedObject **)&freelist;
-
-    obj->retain();
-    obj->release();
-
-    lock();
-    obj->enlist(ru);
+#if defined(_MSTHREADS_)
+    TlsSetValue(selfmap, th);
+#elif defined(__PTH__)
+    pth_key_setdata(selfmap, th);
+#else
+    pthread_setspecific(selfmap, th);
+#endif
+}
 
-    if(waiting)
-        signal();
+#ifdef  USE_FUTEX
 
-    unlock();
-}
+// waits spin briefly before parking, but only when another cpu could
+// release us while we spin...
+static const unsigned futex_spinning = (sysconf(_SC_NPROCESSORS_ONLN) > 1) ? 100 : 0;
 
-void ConditionalAccess::limit_sharing(unsigned max)
+static inline unsigned futex_load(const unsigned *value)
 {
-    max_sharing = max;
+    return *(const volatile unsigned *)value;
 }
 
-void Conditional::set(struct timespec *ts, timeout_t msec)
+static inline void futex_relax(void)
 {
-    assert(ts != NULL);
-
-#if _POSIX_TIMERS > 0 && defined(POSIX_TIMERS)
-    clock_gettime(_posix_clocking, ts);
+#if defined(__i386__) || defined(__x86_64__)
+    __asm__ __volatile__("pause" ::: "memory");
 #else
-    timeval tv;
-    gettimeofday(&tv, NULL);
-    ts->tv_sec = tv.tv_sec;
-    ts->tv_nsec = tv.tv_usec * 1000l;
+    __sync_synchronize();
 #endif
+}
+
+static void futex_deadline(struct timespec *ts, timeout_t msec)
+{
+    clock_gettime(CLOCK_MONOTONIC, ts);
     ts->tv_sec += msec / 1000;
     ts->tv_nsec += (msec % 1000) * 1000000l;
     while(ts->tv_nsec >= 1000000000l) {
@@ -206,1599 +273,3464 @@ void Conditional::set(struct timespec *ts, timeout_t msec)
     }
 }
 
-Semaphore::Semaphore(unsigned limit) :
-Conditional()
+// park while word holds value, false only if the deadline expired...
+static bool futex_wait(unsigned *word, unsigned value, const struct timespec *deadline)
 {
-	waits = 0;
-	count = limit;
-	used = 0;
+    if(syscall(SYS_futex, word, FUTEX_WAIT_BITSET | FUTEX_PRIVATE_FLAG,
+        value, deadline, NULL, FUTEX_BITSET_MATCH_ANY) < 0 && errno == ETIMEDOUT)
+        return false;
+    return true;
 }
 
-Semaphore::Semaphore(unsigned limit, unsigned avail) :
-Conditional()
+static void futex_wake(unsigned *word, int count)
 {
-	assert(limit > 0);
-	assert(avail <= limit);
-
-	waits = 0;
-	count = limit;
-	used = limit - avail;
+    syscall(SYS_futex, word, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, count, NULL, NULL, 0);
 }
 
-void Semaphore::_share(void)
+static bool semaphore_take(unsigned *used, const unsigned *count)
 {
-    wait();
-}
+    unsigned current = futex_load(used), prior;
 
-void Semaphore::_unlock(void)
-{
-    release();
+    while(current < futex_load(count)) {
+        prior = __sync_val_compare_and_swap(used, current, current + 1);
+        if(prior == current)
+            return true;
+        current = prior;
+    }
+    return false;
 }
 
-bool Semaphore::wait(timeout_t timeout)
+static bool semaphore_wait(unsigned *used, unsigned *count, unsigned *waits, unsigned *sequence, const struct timespec *deadline, bool *busy)
 {
-    bool result = true;
-    struct timespec ts;
-    Conditional::set(&ts, timeout);
+    unsigned spin = futex_spinning, seq;
+    bool alive;
 
-    lock();
-    while(used >= count && result) {
-        ++waits;
-        result = Conditional::wait(&ts);
-        --waits;
-		if(!count)
-			break;
-    }
-    if(result && count)
-        ++used;
-    unlock();
-    return result;
-}
+    if(semaphore_take(used, count))
+        return true;
 
-void Semaphore::wait(void)
-{
-    lock();
-    if(used >= count) {
-        ++waits;
-        Conditional::wait();
-        --waits;
+    *busy = true;
+    while(spin-- && futex_load(count)) {
+        futex_relax();
+        if(semaphore_take(used, count))
+            return true;
     }
-	if(count)
-	    ++used;
-    unlock();
-}
 
-void Semaphore::release(void)
-{
-    lock();
-    if(used)
-        --used;
-    if(waits) {
-		if(count)
-	        signal();
-		else
-			broadcast();
-	}
-    unlock();
+    // a zero count semaphore releases waiters as a group on release...
+    for(;;) {
+        seq = futex_load(sequence);
+        __sync_add_and_fetch(waits, 1);
+        if(semaphore_take(used, count)) {
+            __sync_sub_and_fetch(waits, 1);
+            return true;
+        }
+        alive = futex_wait(sequence, seq, deadline);
+        __sync_sub_and_fetch(waits, 1);
+        if(!futex_load(count)) {
+            if(futex_load(sequence) != seq)
+                return true;
+        }
+        else if(semaphore_take(used, count))
+            return true;
+        if(!alive)
+            return false;
+    }
 }
 
-void Semaphore::set(unsigned value)
+static bool event_wait(unsigned *signalled, unsigned *waiting, const struct timespec *deadline)
 {
-    assert(value > 0);
+    unsigned spin = futex_spinning;
+    bool alive;
 
-    unsigned diff;
-
-    lock();
-    count = value;
-    if(used >= count || !waits) {
-        unlock();
-        return;
+    while(spin--) {
+        if(__sync_bool_compare_and_swap(signalled, 1, 0))
+            return true;
+        futex_relax();
     }
-    diff = count - used;
-    if(diff > waits)
-        diff = waits;
-    unlock();
-    while(diff--) {
-        lock();
-        signal();
-        unlock();
+
+    for(;;) {
+        __sync_add_and_fetch(waiting, 1);
+        if(__sync_bool_compare_and_swap(signalled, 1, 0)) {
+            __sync_sub_and_fetch(waiting, 1);
+            return true;
+        }
+        alive = futex_wait(signalled, 0, deadline);
+        __sync_sub_and_fetch(waiting, 1);
+        if(__sync_bool_compare_and_swap(signalled, 1, 0))
+            return true;
+        if(!alive)
+            return false;
     }
 }
 
-#ifdef  _MSTHREADS_
+#endif
 
-bool Thread::equal(pthread_t t1, pthread_t t2)
+static unsigned hash_address(const void *ptr, unsigned indexing)
 {
-    return t1 == t2;
-}
+    assert(ptr != NULL);
 
-#ifdef  _MSCONDITIONAL_
+    if(indexing < 2)
+        return 0;
 
-Conditional::Conditional()
-{
-    InitializeCriticalSection(&mutex);
-    InitializeConditionVariable(&cond);
+    // drop alignment bits, then spread the rest with a fibonacci multiply...
+    uintptr_t key = (uintptr_t)ptr >> 3;
+    key ^= key >> 16;
+    key *= (uintptr_t)0x9e3779b97f4a7c15ull;
+    key ^= key >> 15;
+
+    return (unsigned)(key % indexing);
 }
 
-Conditional::~Conditional()
+lock_entry::lock_entry()
 {
-    DeleteCriticalSection(&mutex);
+    next = NULL;
+    pointer = NULL;
+    count = 0;
 }
 
-void Conditional::wait(void)
+mutex_entry::mutex_entry() : lock_entry()
 {
-    SleepConditionVariableCS(&cond, &mutex, INFINITE);
+    pthread_mutex_init(&mutex, NULL);
 }
 
-bool Conditional::wait(timeout_t timeout)
+rwlock_entry::rwlock_entry() : lock_entry(), ThreadLock()
 {
-    if(SleepConditionVariableCS(&cond, &mutex, timeout))
-        return true;
-
-    return false;
 }
 
-void Conditional::signal(void)
+lock_index::lock_index() : Mutex()
 {
-    WakeConditionVariable(&cond);
+    list = NULL;
+    contended = 0;
 }
 
-void Conditional::broadcast(void)
+size_t lock_index::size(void)
 {
-    WakeAllConditionVariable(&cond);
+    return ((sizeof(lock_index) + LOCK_CACHELINE - 1) / LOCK_CACHELINE) * LOCK_CACHELINE;
 }
 
-#else
-void Conditional::wait(void)
+lock_index *lock_index::create(unsigned count)
 {
-    int result;
+    // buckets are line aligned and never released, like their entries...
+    caddr_t mem = (caddr_t)::malloc(size() * count + LOCK_CACHELINE);
+    crit(mem != NULL, "lock index alloc failed");
 
-    EnterCriticalSection(&mlock);
-    ++waiting;
-    LeaveCriticalSection(&mlock);
-    LeaveCriticalSection(&mutex);
-    result = WaitForMultipleObjects(2, events, FALSE, INFINITE);
-    EnterCriticalSection(&mlock);
-    --waiting;
-    result = ((result == WAIT_OBJECT_0 + BROADCAST) && (waiting == 0));
-    LeaveCriticalSection(&mlock);
-    if(result)
-        ResetEvent(&events[BROADCAST]);
-    EnterCriticalSection(&mutex);
+    mem += LOCK_CACHELINE - ((uintptr_t)mem % LOCK_CACHELINE);
+    for(unsigned pos = 0; pos < count; ++pos)
+        new(mem + pos * size()) lock_index;
+
+    return (lock_index *)mem;
 }
 
-void Conditional::signal(void)
+static lock_index *lock_bucket(lock_index *table, unsigned pos)
 {
-    EnterCriticalSection(&mlock);
-    if(waiting)
-        SetEvent(&events[SIGNAL]);
-    LeaveCriticalSection(&mlock);
+    return (lock_index *)((caddr_t)table + pos * lock_index::size());
 }
 
-void Conditional::broadcast(void)
+#ifdef  HAVE_GCC_ATOMICS
+static inline long lock_add(volatile long *value, long offset)
 {
-    EnterCriticalSection(&mlock);
-    if(waiting)
-        SetEvent(&events[BROADCAST]);
-    LeaveCriticalSection(&mlock);
-
+    return __sync_add_and_fetch(value, offset);
 }
 
-Conditional::Conditional()
+static inline bool lock_reclaim(volatile long *value)
 {
-    waiting = 0;
+    return __sync_bool_compare_and_swap(value, 0l, -LOCK_RECLAIM);
+}
 
-    InitializeCriticalSection(&mutex);
-    InitializeCriticalSection(&mlock);
-    events[SIGNAL] = CreateEvent(NULL, FALSE, FALSE, NULL);
-    events[BROADCAST] = CreateEvent(NULL, TRUE, FALSE, NULL);
+static inline void lock_count(volatile unsigned long *value)
+{
+    __sync_add_and_fetch(value, 1ul);
 }
 
-Conditional::~Conditional()
+static inline void lock_publish(void)
 {
-    DeleteCriticalSection(&mlock);
-    DeleteCriticalSection(&mutex);
-    CloseHandle(events[SIGNAL]);
-    CloseHandle(events[BROADCAST]);
+    __sync_synchronize();
+}
+#else
+static inline long lock_add(volatile long *value, long offset)
+{
+    return *value += offset;
 }
 
-bool Conditional::wait(timeout_t timeout)
+static inline bool lock_reclaim(volatile long *value)
 {
-    int result;
-    bool rtn = true;
-
-    if(!timeout)
+    if(*value)
         return false;
+    *value = -LOCK_RECLAIM;
+    return true;
+}
 
-    EnterCriticalSection(&mlock);
-    ++waiting;
-    LeaveCriticalSection(&mlock);
-    LeaveCriticalSection(&mutex);
-    result = WaitForMultipleObjects(2, events, FALSE, timeout);
-    EnterCriticalSection(&mlock);
-    --waiting;
-    if(result == WAIT_OBJECT_0 || result == WAIT_OBJECT_0 + BROADCAST)
-        rtn = true;
-    result = ((result == WAIT_OBJECT_0 + BROADCAST) && (waiting == 0));
-    LeaveCriticalSection(&mlock);
-    if(result)
-        ResetEvent(&events[BROADCAST]);
-    EnterCriticalSection(&mutex);
-    return rtn;
+static inline void lock_count(volatile unsigned long *value)
+{
+    ++*value;
+}
+
+static inline void lock_publish(void)
+{
 }
 #endif
 
-bool Conditional::wait(struct timespec *ts)
+// find and reference the active entry of a pointer, if there is one...
+static lock_entry *lock_find(lock_index *index, const void *ptr)
 {
-    assert(ts != NULL);
+    lock_entry *entry = index->list;
 
-    return wait((timeout_t)(ts->tv_sec * 1000 + (ts->tv_nsec / 1000000l)));
+    while(entry) {
+        if(entry->pointer == ptr) {
+            long count = lock_add(&entry->count, 1);
+            if(count > 0 && entry->pointer == ptr) {
+                if(count > 1)
+                    lock_count(&index->contended);
+                return entry;
+            }
+            lock_add(&entry->count, -1);
+        }
+        entry = entry->next;
+    }
+    return NULL;
 }
 
-#else
-
-#include <stdio.h>
-bool Thread::equal(pthread_t t1, pthread_t t2)
+template<class T>
+static lock_entry *lock_acquire(lock_index *index, const void *ptr)
 {
-#ifdef  __PTH__
-    return (t1 == t2);
-#else
-    return pthread_equal(t1, t2) != 0;
+    lock_entry *entry;
+
+#ifdef  HAVE_GCC_ATOMICS
+    entry = lock_find(index, ptr);
+    if(entry)
+        return entry;
 #endif
+
+    index->acquire();
+    entry = lock_find(index, ptr);
+    if(entry) {
+        index->release();
+        return entry;
+    }
+
+    entry = index->list;
+    while(entry) {
+        if(lock_reclaim(&entry->count))
+            break;
+        entry = entry->next;
+    }
+
+    if(entry) {
+        entry->pointer = ptr;
+        lock_publish();
+        lock_add(&entry->count, LOCK_RECLAIM + 1);
+    }
+    else {
+        entry = new T;
+        entry->pointer = ptr;
+        entry->count = 1;
+        entry->next = index->list;
+        lock_publish();
+        index->list = entry;
+    }
+    index->release();
+    return entry;
 }
 
-#ifndef __PTH__
-Conditional::attribute::attribute()
+// find the entry of a pointer the caller already holds a reference to...
+static lock_entry *lock_holder(lock_index *index, const void *ptr)
 {
-    Thread::init();
-    pthread_condattr_init(&attr);
-#if _POSIX_TIMERS > 0 && defined(HAVE_PTHREAD_CONDATTR_SETCLOCK) && defined(POSIX_TIMERS)
-#if defined(_POSIX_MONOTONIC_CLOCK)
-    if(!pthread_condattr_setclock(&attr, CLOCK_MONOTONIC))
-        _posix_clocking = CLOCK_MONOTONIC;
-#else
-    pthread_condattr_setclock(&attr, CLOCK_REALTIME);
-#endif
-#endif
+    lock_entry *entry = index->list;
+
+    while(entry) {
+        if(entry->count > 0 && entry->pointer == ptr)
+            break;
+        entry = entry->next;
+    }
+    return entry;
 }
-#endif
 
-Conditional::Conditional()
+// without atomics the entry counts are kept under the bucket lock...
+static inline void lock_enter(lock_index *index)
 {
-#ifdef  __PTH__
-    Thread::init();
-    pth_cond_init(&cond);
-    pth_mutex_init(&mutex);
+#ifdef  HAVE_GCC_ATOMICS
+    (void)index;
 #else
-    crit(pthread_cond_init(&cond, &attr.attr) == 0, "conditional init failed");
-    crit(pthread_mutex_init(&mutex, NULL) == 0, "mutex init failed");
+    index->acquire();
 #endif
 }
 
-Conditional::~Conditional()
+static inline void lock_leave(lock_index *index)
 {
-#ifndef __PTH__
-    pthread_cond_destroy(&cond);
-    pthread_mutex_destroy(&mutex);
+#ifdef  HAVE_GCC_ATOMICS
+    (void)index;
+#else
+    index->release();
 #endif
 }
 
-bool Conditional::wait(timeout_t timeout)
+static lock_index *lock_select(lock_index **table, unsigned *indexing, const void *ptr)
 {
-    struct timespec ts;
-    set(&ts, timeout);
-    return wait(&ts);
+    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    lock_index *index = *(lock_index *volatile *)table;
+
+    if(!index) {
+        pthread_mutex_lock(&lock);
+        if(!*table) {
+            index = lock_index::create(LOCK_DEFAULT);
+            *indexing = LOCK_DEFAULT;
+            lock_publish();
+            *table = index;
+        }
+        index = *table;
+        pthread_mutex_unlock(&lock);
+    }
+    return lock_bucket(index, hash_address(ptr, *indexing));
 }
 
-bool Conditional::wait(struct timespec *ts)
+static void lock_indexing(lock_index **table, unsigned *indexing, unsigned size)
 {
-    assert(ts != NULL);
-
-    if(pthread_cond_timedwait(&cond, &mutex, ts) == ETIMEDOUT)
-        return false;
+    lock_index *index = lock_index::create(size);
 
-    return true;
+    *indexing = size;
+    lock_publish();
+    *table = index;
 }
 
-#endif
-
-
-#if defined(_MSCONDITIONAL_)
-
-ConditionalAccess::ConditionalAccess()
+ReusableAllocator::ReusableAllocator() :
+Conditional()
 {
-    waiting = pending = sharing = 0;
-    InitializeConditionVariable(&bcast);
+    freelist = NULL;
+    waiting = 0;
+    unit = 0;
 }
 
-ConditionalAccess::~ConditionalAccess()
+memstats ReusableAllocator::statistics(void)
 {
+    memstats copy;
+
+    lock();
+    copy = stats;
+    unlock();
+    return copy;
 }
 
-bool ConditionalAccess::waitBroadcast(timeout_t timeout)
+void ReusableAllocator::release(ReusableObject *obj)
 {
-    assert(ts != NULL);
+    assert(obj != NULL);
 
-    if(SleepConditionVariableCS(&bcast, &mutex, timeout))
-        return true;
+    LinkedObject **ru = (LinkedObject **)&freelist;
 
-    return false;
-}
+    obj->retain();
+    obj->release();
 
-bool ConditionalAccess::waitSignal(timeout_t timeout)
-{
-    assert(ts != NULL);
+    lock();
+    obj->enlist(ru);
+    stats.release(unit);
 
-    if(SleepConditionVariableCS(&cond, &mutex, timeout))
-        return true;
+    if(waiting)
+        signal();
 
-    return false;
+    unlock();
 }
 
-bool ConditionalAccess::waitBroadcast(struct timespec *ts)
+void ConditionalAccess::limit_sharing(unsigned max)
 {
-    assert(ts != NULL);
-
-    return waitBroadcast((timeout_t)(ts->tv_sec * 1000 + (ts->tv_nsec / 1000000l)));
+    max_sharing = max;
 }
 
-bool ConditionalAccess::waitSignal(struct timespec *ts)
+void Conditional::set(struct timespec *ts, timeout_t msec)
 {
     assert(ts != NULL);
 
-    return waitSignal((timeout_t)(ts->tv_sec * 1000 + (ts->tv_nsec / 1000000l)));
+#if _POSIX_TIMERS > 0 && defined(POSIX_TIMERS)
+    clock_gettime(_posix_clocking, ts);
+#else
+    timeval tv;
+    gettimeofday(&tv, NULL);
+    ts->tv_sec = tv.tv_sec;
+    ts->tv_nsec = tv.tv_usec * 1000l;
+#endif
+    ts->tv_sec += msec / 1000;
+    ts->tv_nsec += (msec % 1000) * 1000000l;
+    while(ts->tv_nsec >= 1000000000l) {
+        ++ts->tv_sec;
+        ts->tv_nsec -= 1000000000l;
+    }
 }
 
-#elif defined(_MSTHREADS_)
+static pthread_mutex_t profile_lock = PTHREAD_MUTEX_INITIALIZER;
+static lockstats *profiles = NULL;
 
-void ConditionalAccess::waitSignal(void)
+static unsigned profile_bucket(Timer::tick_t ticks)
 {
-    LeaveCriticalSection(&mutex);
-    WaitForSingleObject(&events[SIGNAL], INFINITE);
-    EnterCriticalSection(&mutex);
+    // ticks are 100ns units, buckets are powers of two microseconds...
+    Timer::tick_t usec = ticks / 10;
+    unsigned bucket = 0;
+
+    while(usec > 1 && bucket < lockstats::HISTOGRAM - 1) {
+        usec >>= 1;
+        ++bucket;
+    }
+    return bucket;
 }
 
-void ConditionalAccess::waitBroadcast(void)
+static unsigned long profile_percent(const unsigned long *hist, unsigned percent)
 {
-    int result;
+    unsigned long total = 0, sum = 0;
+    unsigned bucket;
 
-    EnterCriticalSection(&mlock);
-    ++waiting;
-    LeaveCriticalSection(&mlock);
-    LeaveCriticalSection(&mutex);
-    result = WaitForSingleObject(&events[BROADCAST], INFINITE);
-    EnterCriticalSection(&mlock);
-    --waiting;
-    result = ((result == WAIT_OBJECT_0) && (waiting == 0));
-    LeaveCriticalSection(&mlock);
-    if(result)
-        ResetEvent(&events[BROADCAST]);
-    EnterCriticalSection(&mutex);
+    for(bucket = 0; bucket < lockstats::HISTOGRAM; ++bucket)
+        total += hist[bucket];
+
+    if(!total)
+        return 0;
+
+    for(bucket = 0; bucket < lockstats::HISTOGRAM - 1; ++bucket) {
+        sum += hist[bucket];
+        if(sum * 100 >= total * percent)
+            break;
+    }
+    return 2ul << bucket;
 }
 
-ConditionalAccess::ConditionalAccess() : Conditional()
+lockstats::lockstats(const char *id)
 {
-    pending = waiting = sharing = 0;
+    next = NULL;
+    started = 0;
+    acquired = contended = 0;
+    memset(name, 0, sizeof(name));
+    memset(waits, 0, sizeof(waits));
+    memset(holds, 0, sizeof(holds));
+    if(id)
+        String::set(name, sizeof(name), id);
 }
 
-ConditionalAccess::~ConditionalAccess()
+lockstats *lockstats::create(const char *id)
 {
+    lockstats *stats = new lockstats(id);
+
+    pthread_mutex_lock(&profile_lock);
+    stats->next = profiles;
+    profiles = stats;
+    pthread_mutex_unlock(&profile_lock);
+    return stats;
 }
 
-bool ConditionalAccess::waitSignal(timeout_t timeout)
+Timer::tick_t lockstats::clock(void)
 {
-    int result;
-    bool rtn = true;
+#if defined(_MSTHREADS_)
+    LARGE_INTEGER count, freq;
 
-    if(!timeout)
-        return false;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (Timer::tick_t)(count.QuadPart / freq.QuadPart) * 10000000l +
+        (Timer::tick_t)((count.QuadPart % freq.QuadPart) * 10000000l / freq.QuadPart);
+#elif defined(CLOCK_MONOTONIC)
+    struct timespec ts;
 
-    LeaveCriticalSection(&mutex);
-    result = WaitForSingleObject(events[SIGNAL], timeout);
-    if(result == WAIT_OBJECT_0)
-        rtn = true;
-    EnterCriticalSection(&mutex);
-    return rtn;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (Timer::tick_t)ts.tv_sec * 10000000l + ts.tv_nsec / 100;
+#else
+    return Timer::ticks();
+#endif
 }
 
-bool ConditionalAccess::waitSignal(struct timespec *ts)
+void lockstats::acquire(Timer::tick_t start, bool busy)
 {
-    assert(ts != NULL);
-
-    return waitSignal((timeout_t)(ts->tv_sec * 1000 + (ts->tv_nsec / 1000000l)));
+    started = clock();
+    ++acquired;
+    if(busy)
+        ++contended;
+    ++waits[profile_bucket(started - start)];
 }
 
-
-bool ConditionalAccess::waitBroadcast(timeout_t timeout)
+void lockstats::release(void)
 {
-    int result;
-    bool rtn = true;
+    ++holds[profile_bucket(clock() - started)];
+}
 
-    if(!timeout)
-        return false;
+unsigned lockstats::top(lockstats *list, unsigned count)
+{
+    unsigned used = 0, pos;
+    lockstats *stats;
 
-    EnterCriticalSection(&mlock);
-    ++waiting;
-    LeaveCriticalSection(&mlock);
-    LeaveCriticalSection(&mutex);
-    result = WaitForSingleObject(events[BROADCAST], timeout);
-    EnterCriticalSection(&mlock);
-    --waiting;
-    if(result == WAIT_OBJECT_0)
-        rtn = true;
-    result = ((result == WAIT_OBJECT_0) && (waiting == 0));
-    LeaveCriticalSection(&mlock);
-    if(result)
-        ResetEvent(&events[BROADCAST]);
-    EnterCriticalSection(&mutex);
-    return rtn;
+    pthread_mutex_lock(&profile_lock);
+    stats = profiles;
+    while(stats && count) {
+        pos = used;
+        while(pos && list[pos - 1].contended < stats->contended) {
+            if(pos < count)
+                list[pos] = list[pos - 1];
+            --pos;
+        }
+        if(pos < count) {
+            list[pos] = *stats;
+            list[pos].next = NULL;
+            if(used < count)
+                ++used;
+        }
+        stats = stats->next;
+    }
+    pthread_mutex_unlock(&profile_lock);
+    return used;
 }
 
-bool ConditionalAccess::waitBroadcast(struct timespec *ts)
+void lockstats::dump(FILE *output, unsigned count)
 {
-    assert(ts != NULL);
+    lockstats *list = new lockstats[count];
+    unsigned used = top(list, count);
 
-    return waitBroadcast((timeout_t)(ts->tv_sec * 1000 + (ts->tv_nsec / 1000000l)));
+    fprintf(output, "%-24s %10s %10s %8s %8s %8s %8s\n",
+        "lock", "acquired", "contended", "wait50", "wait99", "hold50", "hold99");
+    for(unsigned pos = 0; pos < used; ++pos) {
+        lockstats *stats = &list[pos];
+        fprintf(output, "%-24s %10lu %10lu %8lu %8lu %8lu %8lu\n",
+            stats->name[0] ? stats->name : "-",
+            stats->acquired, stats->contended,
+            profile_percent(stats->waits, 50), profile_percent(stats->waits, 99),
+            profile_percent(stats->holds, 50), profile_percent(stats->holds, 99));
+    }
+    delete[] list;
 }
 
-#else
-
-ConditionalAccess::ConditionalAccess()
+Semaphore::Semaphore(unsigned limit) :
+Conditional()
 {
-    waiting = pending = sharing = 0;
-#ifdef  __PTH__
-    pth_cond_init(&bcast);
-#else
-    crit(pthread_cond_init(&bcast, &attr.attr) == 0, "conditional init failed");
-#endif
+	waits = 0;
+	count = limit;
+	used = 0;
+	sequence = 0;
+	profiler = NULL;
 }
 
-ConditionalAccess::~ConditionalAccess()
+Semaphore::Semaphore(unsigned limit, unsigned avail) :
+Conditional()
 {
-#ifndef __PTH__
-    pthread_cond_destroy(&bcast);
-#endif
+	assert(limit > 0);
+	assert(avail <= limit);
+
+	waits = 0;
+	count = limit;
+	used = limit - avail;
+	sequence = 0;
+	profiler = NULL;
 }
 
-bool ConditionalAccess::waitSignal(timeout_t timeout)
+void Semaphore::_share(void)
 {
-    struct timespec ts;
-    set(&ts, timeout);
-    return waitSignal(&ts);
+    wait();
 }
 
-bool ConditionalAccess::waitBroadcast(struct timespec *ts)
+void Semaphore::_unlock(void)
 {
-    assert(ts != NULL);
-
-    if(pthread_cond_timedwait(&bcast, &mutex, ts) == ETIMEDOUT)
-        return false;
-
-    return true;
+    release();
 }
 
-bool ConditionalAccess::waitBroadcast(timeout_t timeout)
+void Semaphore::profile(const char *id)
 {
-    struct timespec ts;
-    set(&ts, timeout);
-    return waitBroadcast(&ts);
+    if(!profiler)
+        profiler = lockstats::create(id);
 }
 
-bool ConditionalAccess::waitSignal(struct timespec *ts)
+#ifdef  USE_FUTEX
+
+bool Semaphore::wait(timeout_t timeout)
 {
-    assert(ts != NULL);
+    struct timespec ts;
+    bool busy = false;
+    bool result;
+    Timer::tick_t start = 0;
 
-    if(pthread_cond_timedwait(&cond, &mutex, ts) == ETIMEDOUT)
-        return false;
+    if(profiler)
+        start = lockstats::clock();
 
-    return true;
-}
+    if(timeout != Timer::inf)
+        futex_deadline(&ts, timeout);
 
-#endif
+    result = semaphore_wait(&used, &count, &waits, &sequence,
+        (timeout != Timer::inf) ? &ts : NULL, &busy);
 
-// abstract class never runs...
-bool Thread::is_active(void)
-{
-    return false;
+    if(result && profiler) {
+        lock();
+        profiler->acquire(start, busy);
+        unlock();
+    }
+    return result;
 }
 
-bool JoinableThread::is_active(void)
+void Semaphore::wait(void)
 {
-#ifdef  _MSTHREADS_
-    return (running != INVALID_HANDLE_VALUE) && !joining;
-#else
-    return running && !joining;
-#endif
-}
+    bool busy = false;
+    Timer::tick_t start = 0;
 
-bool DetachedThread::is_active(void)
-{
-    return active;
+    if(profiler)
+        start = lockstats::clock();
+
+    semaphore_wait(&used, &count, &waits, &sequence, NULL, &busy);
+
+    if(profiler) {
+        lock();
+        profiler->acquire(start, busy);
+        unlock();
+    }
 }
 
-void ConditionalAccess::modify(void)
+void Semaphore::release(void)
 {
-    lock();
-    while(sharing) {
-        ++pending;
-        waitSignal();
-        --pending;
+    unsigned current = futex_load(&used), prior;
+
+    while(current) {
+        prior = __sync_val_compare_and_swap(&used, current, current - 1);
+        if(prior == current)
+            break;
+        current = prior;
+    }
+
+    if(!current)
+        __sync_synchronize();
+
+    // only wake when someone is parked, one for each free slot...
+    if(futex_load(&waits)) {
+        __sync_add_and_fetch(&sequence, 1);
+        futex_wake(&sequence, futex_load(&count) ? 1 : INT_MAX);
     }
 }
 
-void ConditionalAccess::commit(void)
+void Semaphore::set(unsigned value)
 {
-    if(pending)
-        signal();
-    else if(waiting)
-        broadcast();
-    unlock();
+    assert(value > 0);
+
+    unsigned current, parked;
+
+    count = value;
+    __sync_synchronize();
+    current = futex_load(&used);
+    parked = futex_load(&waits);
+    if(current >= value || !parked)
+        return;
+
+    __sync_add_and_fetch(&sequence, 1);
+    if(value - current < parked)
+        parked = value - current;
+    futex_wake(&sequence, (int)parked);
 }
 
-void ConditionalAccess::access(void)
+#else
+
+bool Semaphore::wait(timeout_t timeout)
 {
+    bool result = true;
+    bool busy = false;
+    struct timespec ts;
+    Timer::tick_t start = 0;
+    Conditional::set(&ts, timeout);
+
+    if(profiler)
+        start = lockstats::clock();
+
     lock();
-    assert(!max_sharing || sharing < max_sharing);
-    while(pending) {
-        ++waiting;
-        waitBroadcast();
-        --waiting;
+    while(used >= count && result) {
+        busy = true;
+        ++waits;
+        result = Conditional::wait(&ts);
+        --waits;
+		if(!count)
+			break;
+    }
+    if(result && count) {
+        ++used;
+        if(profiler)
+            profiler->acquire(start, busy);
     }
-    ++sharing;
     unlock();
+    return result;
 }
 
-void ConditionalAccess::release(void)
+void Semaphore::wait(void)
 {
-   lock();
-    assert(sharing);
+    bool busy = false;
+    Timer::tick_t start = 0;
 
-    --sharing;
-    if(pending && !sharing)
-        signal();
-    else if(waiting && !pending)
-        broadcast();
-    unlock();
-}
+    if(profiler)
+        start = lockstats::clock();
 
-RecursiveMutex::RecursiveMutex() :
-Conditional()
-{
-    lockers = 0;
-    waiting = 0;
+    lock();
+    while(used >= count) {
+        busy = true;
+        ++waits;
+        Conditional::wait();
+        --waits;
+        if(!count)
+            break;
+    }
+	if(count) {
+	    ++used;
+	    if(profiler)
+	        profiler->acquire(start, busy);
+	}
+    unlock();
 }
 
-void RecursiveMutex::_lock(void)
+void Semaphore::release(void)
 {
     lock();
+    if(used)
+        --used;
+    if(waits) {
+		if(count)
+	        signal();
+		else
+			broadcast();
+	}
+    unlock();
 }
 
-void RecursiveMutex::_unlock(void)
+void Semaphore::set(unsigned value)
 {
-    release();
-}
+    assert(value > 0);
 
-bool RecursiveMutex::lock(timeout_t timeout)
-{
-    bool result = true;
-    struct timespec ts;
-    set(&ts, timeout);
+    unsigned diff;
 
-    Conditional::lock();
-    while(result && lockers) {
-        if(Thread::equal(locker, pthread_self()))
-            break;
-        ++waiting;
-        result = Conditional::wait(&ts);
-        --waiting;
+    lock();
+    count = value;
+    if(used >= count || !waits) {
+        unlock();
+        return;
     }
-    if(!lockers) {
-        result = true;
-        locker = pthread_self();
+    diff = count - used;
+    if(diff > waits)
+        diff = waits;
+    unlock();
+    while(diff--) {
+        lock();
+        signal();
+        unlock();
     }
-    else
-        result = false;
-    ++lockers;
-    Conditional::unlock();
-    return result;
 }
 
-void RecursiveMutex::lock(void)
+#endif
+
+#ifdef  _MSTHREADS_
+
+bool Thread::equal(pthread_t t1, pthread_t t2)
 {
-    Conditional::lock();
-    while(lockers) {
-        if(Thread::equal(locker, pthread_self()))
-            break;
-        ++waiting;
-        Conditional::wait();
-        --waiting;
-    }
-    if(!lockers)
-        locker = pthread_self();
-    ++lockers;
-    Conditional::unlock();
-    return;
+    return t1 == t2;
 }
 
-void RecursiveMutex::release(void)
+#ifdef  _MSCONDITIONAL_
+
+Conditional::Conditional()
 {
-    Conditional::lock();
-    --lockers;
-    if(!lockers && waiting)
-        Conditional::signal();
-    Conditional::unlock();
+    InitializeCriticalSection(&mutex);
+    InitializeConditionVariable(&cond);
 }
 
-ThreadLock::ThreadLock() :
-ConditionalAccess()
+Conditional::~Conditional()
 {
-    writers = 0;
+    DeleteCriticalSection(&mutex);
 }
 
-void ThreadLock::_lock(void)
+void Conditional::wait(void)
 {
-    modify();
+    SleepConditionVariableCS(&cond, &mutex, INFINITE);
 }
 
-void ThreadLock::_share(void)
+bool Conditional::wait(timeout_t timeout)
 {
-    access();
+    if(SleepConditionVariableCS(&cond, &mutex, timeout))
+        return true;
+
+    return false;
 }
 
-void ThreadLock::_unlock(void)
+void Conditional::signal(void)
 {
-    release();
+    WakeConditionVariable(&cond);
 }
 
-bool ThreadLock::modify(timeout_t timeout)
+void Conditional::broadcast(void)
 {
-    bool rtn = true;
-    struct timespec ts;
+    WakeAllConditionVariable(&cond);
+}
 
-    if(timeout && timeout != Timer::inf)
-        set(&ts, timeout);
+#else
+void Conditional::wait(void)
+{
+    int result;
 
-    lock();
-    while((writers || sharing) && rtn) {
-        if(writers && Thread::equal(writeid, pthread_self()))
-            break;
-        ++pending;
-        if(timeout == Timer::inf)
-            waitSignal();
-        else if(timeout)
-            rtn = waitSignal(&ts);
-        else
-            rtn = false;
-        --pending;
-    }
-    assert(!max_sharing || writers < max_sharing);
-    if(rtn) {
-        if(!writers)
-            writeid = pthread_self();
-        ++writers;
-    }
-    unlock();
-    return rtn;
+    EnterCriticalSection(&mlock);
+    ++waiting;
+    LeaveCriticalSection(&mlock);
+    LeaveCriticalSection(&mutex);
+    result = WaitForMultipleObjects(2, events, FALSE, INFINITE);
+    EnterCriticalSection(&mlock);
+    --waiting;
+    result = ((result == WAIT_OBJECT_0 + BROADCAST) && (waiting == 0));
+    LeaveCriticalSection(&mlock);
+    if(result)
+        ResetEvent(&events[BROADCAST]);
+    EnterCriticalSection(&mutex);
 }
 
-bool ThreadLock::access(timeout_t timeout)
+void Conditional::signal(void)
 {
-    struct timespec ts;
-    bool rtn = true;
-
-    if(timeout && timeout != Timer::inf)
-        set(&ts, timeout);
-
-    lock();
-    while((writers || pending) && rtn) {
-        ++waiting;
-        if(timeout == Timer::inf)
-            waitBroadcast();
-        else if(timeout)
-            rtn = waitBroadcast(&ts);
-        else
-            rtn = false;
-        --waiting;
-    }
-    assert(!max_sharing || sharing < max_sharing);
-    if(rtn)
-        ++sharing;
-    unlock();
-    return rtn;
+    EnterCriticalSection(&mlock);
+    if(waiting)
+        SetEvent(&events[SIGNAL]);
+    LeaveCriticalSection(&mlock);
 }
 
-void ThreadLock::release(void)
+void Conditional::broadcast(void)
 {
-    lock();
-    assert(sharing || writers);
+    EnterCriticalSection(&mlock);
+    if(waiting)
+        SetEvent(&events[BROADCAST]);
+    LeaveCriticalSection(&mlock);
 
-    if(writers) {
-        assert(!sharing);
-        --writers;
-        if(pending && !writers)
-            signal();
-        else if(waiting && !writers)
-            broadcast();
-        unlock();
-        return;
-    }
-    if(sharing) {
-        assert(!writers);
-        --sharing;
-        if(pending && !sharing)
-            signal();
-        else if(waiting && !pending)
-            broadcast();
-    }
-    unlock();
 }
 
-auto_protect::auto_protect()
+Conditional::Conditional()
 {
-    object = NULL;
-}
+    waiting = 0;
 
-auto_protect::auto_protect(const void *obj)
-{
-    object = obj;
-    if(object)
-        Mutex::protect(obj);
+    InitializeCriticalSection(&mutex);
+    InitializeCriticalSection(&mlock);
+    events[SIGNAL] = CreateEvent(NULL, FALSE, FALSE, NULL);
+    events[BROADCAST] = CreateEvent(NULL, TRUE, FALSE, NULL);
 }
 
-auto_protect::~auto_protect()
+Conditional::~Conditional()
 {
-    release();
+    DeleteCriticalSection(&mlock);
+    DeleteCriticalSection(&mutex);
+    CloseHandle(events[SIGNAL]);
+    CloseHandle(events[BROADCAST]);
 }
 
-void auto_protect::release()
+bool Conditional::wait(timeout_t timeout)
 {
-    if(object) {
-        Mutex::release(object);
-        object = NULL;
-    }
-}
+    int result;
+    bool rtn = true;
 
-void auto_protect::operator=(const void *obj)
-{
-    if(obj == object)
-        return;
+    if(!timeout)
+        return false;
 
-    release();
-    object = obj;
-    if(object)
-        Mutex::protect(object);
+    EnterCriticalSection(&mlock);
+    ++waiting;
+    LeaveCriticalSection(&mlock);
+    LeaveCriticalSection(&mutex);
+    result = WaitForMultipleObjects(2, events, FALSE, timeout);
+    EnterCriticalSection(&mlock);
+    --waiting;
+    if(result == WAIT_OBJECT_0 || result == WAIT_OBJECT_0 + BROADCAST)
+        rtn = true;
+    result = ((result == WAIT_OBJECT_0 + BROADCAST) && (waiting == 0));
+    LeaveCriticalSection(&mlock);
+    if(result)
+        ResetEvent(&events[BROADCAST]);
+    EnterCriticalSection(&mutex);
+    return rtn;
 }
+#endif
 
-Mutex::guard::guard()
+bool Conditional::wait(struct timespec *ts)
 {
-    object = NULL;
-}
+    assert(ts != NULL);
 
-Mutex::guard::guard(const void *obj)
-{
-    object = obj;
-    if(obj)
-        Mutex::protect(object);
+    return wait((timeout_t)(ts->tv_sec * 1000 + (ts->tv_nsec / 1000000l)));
 }
 
-Mutex::guard::~guard()
-{
-    release();
-}
+#else
 
-void Mutex::guard::set(const void *obj)
+#include <stdio.h>
+bool Thread::equal(pthread_t t1, pthread_t t2)
 {
-    release();
-    object = obj;
-    if(obj)
-        Mutex::protect(object);
+#ifdef  __PTH__
+    return (t1 == t2);
+#else
+    return pthread_equal(t1, t2) != 0;
+#endif
 }
 
-void Mutex::guard::release(void)
+#ifndef __PTH__
+Conditional::attribute::attribute()
 {
-    if(object) {
-        Mutex::release(object);
-        object = NULL;
-    }
+    Thread::init();
+    pthread_condattr_init(&attr);
+#if _POSIX_TIMERS > 0 && defined(HAVE_PTHREAD_CONDATTR_SETCLOCK) && defined(POSIX_TIMERS)
+#if defined(_POSIX_MONOTONIC_CLOCK)
+    if(!pthread_condattr_setclock(&attr, CLOCK_MONOTONIC))
+        _posix_clocking = CLOCK_MONOTONIC;
+#else
+    pthread_condattr_setclock(&attr, CLOCK_REALTIME);
+#endif
+#endif
 }
+#endif
 
-Mutex::Mutex()
+Conditional::Conditional()
 {
 #ifdef  __PTH__
-    pth_mutex_init(&mlock);
+    Thread::init();
+    pth_cond_init(&cond);
+    pth_mutex_init(&mutex);
 #else
-    crit(pthread_mutex_init(&mlock, NULL) == 0, "mutex init failed");
+    crit(pthread_cond_init(&cond, &attr.attr) == 0, "conditional init failed");
+    crit(pthread_mutex_init(&mutex, NULL) == 0, "mutex init failed");
 #endif
 }
 
-Mutex::~Mutex()
+Conditional::~Conditional()
 {
-    pthread_mutex_destroy(&mlock);
+#ifndef __PTH__
+    pthread_cond_destroy(&cond);
+    pthread_mutex_destroy(&mutex);
+#endif
 }
 
-void Mutex::indexing(unsigned index)
+bool Conditional::wait(timeout_t timeout)
 {
-    if(index > 1) {
-        mutex_table = new mutex_index[index];
-        mutex_indexing = index;
-    }
+    struct timespec ts;
+    set(&ts, timeout);
+    return wait(&ts);
 }
 
-void ThreadLock::indexing(unsigned index)
+bool Conditional::wait(struct timespec *ts)
 {
-    if(index > 1) {
-        rwlock_table = new rwlock_index[index];
-        rwlock_indexing = index;
-    }
+    assert(ts != NULL);
+
+    if(pthread_cond_timedwait(&cond, &mutex, ts) == ETIMEDOUT)
+        return false;
+
+    return true;
 }
 
-ThreadLock::guard_reader::guard_reader()
+#endif
+
+
+#if defined(_MSCONDITIONAL_)
+
+ConditionalAccess::ConditionalAccess()
 {
-    object = NULL;
+    waiting = pending = sharing = 0;
+    profiler = NULL;
+    InitializeConditionVariable(&bcast);
 }
 
-ThreadLock::guard_reader::guard_reader(const void *obj)
+ConditionalAccess::~ConditionalAccess()
 {
-    object = obj;
-    if(obj)
-        if(!ThreadLock::reader(object))
-            object = NULL;
 }
 
-ThreadLock::guard_reader::~guard_reader()
+bool ConditionalAccess::waitBroadcast(timeout_t timeout)
 {
-    release();
+    assert(ts != NULL);
+
+    if(SleepConditionVariableCS(&bcast, &mutex, timeout))
+        return true;
+
+    return false;
 }
 
-void ThreadLock::guard_reader::set(const void *obj)
+bool ConditionalAccess::waitSignal(timeout_t timeout)
 {
-    release();
-    object = obj;
-    if(obj)
-        if(!ThreadLock::reader(object))
-            object = NULL;
+    assert(ts != NULL);
+
+    if(SleepConditionVariableCS(&cond, &mutex, timeout))
+        return true;
+
+    return false;
 }
 
-void ThreadLock::guard_reader::release(void)
+bool ConditionalAccess::waitBroadcast(struct timespec *ts)
 {
-    if(object) {
-        ThreadLock::release(object);
-        object = NULL;
-    }
+    assert(ts != NULL);
+
+    return waitBroadcast((timeout_t)(ts->tv_sec * 1000 + (ts->tv_nsec / 1000000l)));
 }
 
-ThreadLock::guard_writer::guard_writer()
+bool ConditionalAccess::waitSignal(struct timespec *ts)
 {
-    object = NULL;
+    assert(ts != NULL);
+
+    return waitSignal((timeout_t)(ts->tv_sec * 1000 + (ts->tv_nsec / 1000000l)));
 }
 
-ThreadLock::guard_writer::guard_writer(const void *obj)
+#elif defined(_MSTHREADS_)
+
+void ConditionalAccess::waitSignal(void)
 {
-    object = obj;
-    if(obj)
-        if(!ThreadLock::writer(object))
-            object = NULL;
+    LeaveCriticalSection(&mutex);
+    WaitForSingleObject(&events[SIGNAL], INFINITE);
+    EnterCriticalSection(&mutex);
 }
 
-ThreadLock::guard_writer::~guard_writer()
+void ConditionalAccess::waitBroadcast(void)
 {
-    release();
+    int result;
+
+    EnterCriticalSection(&mlock);
+    ++waiting;
+    LeaveCriticalSection(&mlock);
+    LeaveCriticalSection(&mutex);
+    result = WaitForSingleObject(&events[BROADCAST], INFINITE);
+    EnterCriticalSection(&mlock);
+    --waiting;
+    result = ((result == WAIT_OBJECT_0) && (waiting == 0));
+    LeaveCriticalSection(&mlock);
+    if(result)
+        ResetEvent(&events[BROADCAST]);
+    EnterCriticalSection(&mutex);
 }
 
-void ThreadLock::guard_writer::set(const void *obj)
+ConditionalAccess::ConditionalAccess() : Conditional()
 {
-    release();
-    object = obj;
-    if(obj)
-        if(!ThreadLock::writer(object))
-            object = NULL;
+    pending = waiting = sharing = 0;
+    profiler = NULL;
 }
 
-void ThreadLock::guard_writer::release(void)
+ConditionalAccess::~ConditionalAccess()
 {
-    if(object) {
-        ThreadLock::release(object);
-        object = NULL;
-    }
 }
 
-bool ThreadLock::reader(const void *ptr, timeout_t timeout)
+bool ConditionalAccess::waitSignal(timeout_t timeout)
 {
-    rwlock_index *index = &rwlock_table[hash_address(ptr, rwlock_indexing)];
-    rwlock_entry *entry, *empty = NULL;
+    int result;
+    bool rtn = true;
 
-    if(!ptr)
+    if(!timeout)
         return false;
 
-    index->acquire();
-    entry = index->list;
-    while(entry) {
-        if(entry->count && entry->object == ptr)
-            break;
-        if(!entry->count)
-            empty = entry;
-        entry = entry->next;
-    }
-    if(!entry) {
-        if(empty)
-            entry = empty;
-        else {
-            entry = new rwlock_entry;
-            entry->next = index->list;
-            index->list = entry;
-        }
-    }
-    entry->object = ptr;
-    ++entry->count;
-    index->release();
-    if(entry->access(timeout))
-        return true;
-    index->acquire();
-    --entry->count;
-    index->release();
-    return false;
+    LeaveCriticalSection(&mutex);
+    result = WaitForSingleObject(events[SIGNAL], timeout);
+    if(result == WAIT_OBJECT_0)
+        rtn = true;
+    EnterCriticalSection(&mutex);
+    return rtn;
 }
 
-bool ThreadLock::writer(const void *ptr, timeout_t timeout)
+bool ConditionalAccess::waitSignal(struct timespec *ts)
 {
-    rwlock_index *index = &rwlock_table[hash_address(ptr, rwlock_indexing)];
-    rwlock_entry *entry, *empty = NULL;
+    assert(ts != NULL);
 
-    if(!ptr)
+    return waitSignal((timeout_t)(ts->tv_sec * 1000 + (ts->tv_nsec / 1000000l)));
+}
+
+
+bool ConditionalAccess::waitBroadcast(timeout_t timeout)
+{
+    int result;
+    bool rtn = true;
+
+    if(!timeout)
         return false;
 
-    index->acquire();
-    entry = index->list;
-    while(entry) {
-        if(entry->count && entry->object == ptr)
-            break;
-        if(!entry->count)
-            empty = entry;
-        entry = entry->next;
-    }
-    if(!entry) {
-        if(empty)
-            entry = empty;
-        else {
-            entry = new rwlock_entry;
-            entry->next = index->list;
-            index->list = entry;
-        }
-    }
-    entry->object = ptr;
-    ++entry->count;
-    index->release();
-    if(entry->modify(timeout))
-        return true;
-    index->acquire();
-    --entry->count;
-    index->release();
-    return false;
+    EnterCriticalSection(&mlock);
+    ++waiting;
+    LeaveCriticalSection(&mlock);
+    LeaveCriticalSection(&mutex);
+    result = WaitForSingleObject(events[BROADCAST], timeout);
+    EnterCriticalSection(&mlock);
+    --waiting;
+    if(result == WAIT_OBJECT_0)
+        rtn = true;
+    result = ((result == WAIT_OBJECT_0) && (waiting == 0));
+    LeaveCriticalSection(&mlock);
+    if(result)
+        ResetEvent(&events[BROADCAST]);
+    EnterCriticalSection(&mutex);
+    return rtn;
 }
 
-void Mutex::protect(const void *ptr)
+bool ConditionalAccess::waitBroadcast(struct timespec *ts)
+{
+    assert(ts != NULL);
+
+    return waitBroadcast((timeout_t)(ts->tv_sec * 1000 + (ts->tv_nsec / 1000000l)));
+}
+
+#else
+
+ConditionalAccess::ConditionalAccess()
 {
-    mutex_index *index = &mutex_table[hash_address(ptr, mutex_indexing)];
-    mutex_entry *entry, *empty = NULL;
+    waiting = pending = sharing = 0;
+    profiler = NULL;
+#ifdef  __PTH__
+    pth_cond_init(&bcast);
+#else
+    crit(pthread_cond_init(&bcast, &attr.attr) == 0, "conditional init failed");
+#endif
+}
 
-    if(!ptr)
-        return;
+ConditionalAccess::~ConditionalAccess()
+{
+#ifndef __PTH__
+    pthread_cond_destroy(&bcast);
+#endif
+}
 
-    index->acquire();
-    entry = index->list;
-    while(entry) {
-        if(entry->count && entry->pointer == ptr)
-            break;
-        if(!entry->count)
-            empty = entry;
-        entry = entry->next;
-    }
-    if(!entry) {
-        if(empty)
-            entry = empty;
-        else {
-            entry = new struct mutex_entry;
-            entry->count = 0;
-            pthread_mutex_init(&entry->mutex, NULL);
-            entry->next = index->list;
-            index->list = entry;
-        }
-    }
-    entry->pointer = ptr;
-    ++entry->count;
-//  printf("ACQUIRE %p, THREAD %d, POINTER %p, COUNT %d\n", entry, Thread::self(), entry->pointer, entry->count);
-    index->release();
-    pthread_mutex_lock(&entry->mutex);
+bool ConditionalAccess::waitSignal(timeout_t timeout)
+{
+    struct timespec ts;
+    set(&ts, timeout);
+    return waitSignal(&ts);
 }
 
-void ThreadLock::release(const void *ptr)
+bool ConditionalAccess::waitBroadcast(struct timespec *ts)
 {
-    rwlock_index *index = &rwlock_table[hash_address(ptr, rwlock_indexing)];
-    rwlock_entry *entry;
+    assert(ts != NULL);
 
-    if(!ptr)
-        return;
+    if(pthread_cond_timedwait(&bcast, &mutex, ts) == ETIMEDOUT)
+        return false;
 
-    index->acquire();
-    entry = index->list;
-    while(entry) {
-        if(entry->count && entry->object == ptr)
-            break;
-        entry = entry->next;
-    }
+    return true;
+}
 
-    assert(entry);
-    if(entry) {
-        entry->release();
-        --entry->count;
-    }
-    index->release();
+bool ConditionalAccess::waitBroadcast(timeout_t timeout)
+{
+    struct timespec ts;
+    set(&ts, timeout);
+    return waitBroadcast(&ts);
 }
 
-void Mutex::release(const void *ptr)
+bool ConditionalAccess::waitSignal(struct timespec *ts)
 {
-    mutex_index *index = &mutex_table[hash_address(ptr, mutex_indexing)];
-    mutex_entry *entry;
+    assert(ts != NULL);
 
-    if(!ptr)
-        return;
+    if(pthread_cond_timedwait(&cond, &mutex, ts) == ETIMEDOUT)
+        return false;
 
-    index->acquire();
-    entry = index->list;
-    while(entry) {
-        if(entry->count && entry->pointer == ptr)
-            break;
-        entry = entry->next;
-    }
+    return true;
+}
 
-    assert(entry);
-    if(entry) {
-//      printf("RELEASE %p, THREAD %d, POINTER %p COUNT %d\n", entry, Thread::self(), entry->pointer, entry->count);
-        pthread_mutex_unlock(&entry->mutex);
-        --entry->count;
+#endif
+
+// abstract class never runs...
+bool Thread::is_active(void)
+{
+    return false;
+}
+
+bool JoinableThread::is_active(void)
+{
+#ifdef  _MSTHREADS_
+    return (running != INVALID_HANDLE_VALUE) && !joining;
+#else
+    return running && !joining;
+#endif
+}
+
+bool DetachedThread::is_active(void)
+{
+    return active;
+}
+
+void ConditionalAccess::profile(const char *id)
+{
+    if(!profiler)
+        profiler = lockstats::create(id);
+}
+
+void ConditionalAccess::modify(void)
+{
+    bool busy = false;
+    Timer::tick_t start = 0;
+
+    if(profiler)
+        start = lockstats::clock();
+
+    lock();
+    while(sharing) {
+        busy = true;
+        ++pending;
+        waitSignal();
+        --pending;
     }
-    index->release();
+    if(profiler)
+        profiler->acquire(start, busy);
 }
 
-void Mutex::_lock(void)
+void ConditionalAccess::commit(void)
 {
-    pthread_mutex_lock(&mlock);
+    if(profiler)
+        profiler->release();
+    if(pending)
+        signal();
+    else if(waiting)
+        broadcast();
+    unlock();
 }
 
-void Mutex::_unlock(void)
+void ConditionalAccess::access(void)
 {
-    pthread_mutex_unlock(&mlock);
+    bool busy = false;
+    Timer::tick_t start = 0;
+
+    if(profiler)
+        start = lockstats::clock();
+
+    lock();
+    assert(!max_sharing || sharing < max_sharing);
+    while(pending) {
+        busy = true;
+        ++waiting;
+        waitBroadcast();
+        --waiting;
+    }
+    ++sharing;
+    if(profiler)
+        profiler->acquire(start, busy);
+    unlock();
+}
+
+void ConditionalAccess::release(void)
+{
+   lock();
+    assert(sharing);
+
+    --sharing;
+    if(pending && !sharing)
+        signal();
+    else if(waiting && !pending)
+        broadcast();
+    unlock();
+}
+
+RecursiveMutex::RecursiveMutex() :
+Conditional()
+{
+    lockers = 0;
+    waiting = 0;
+    profiler = NULL;
+}
+
+void RecursiveMutex::profile(const char *id)
+{
+    if(!profiler)
+        profiler = lockstats::create(id);
+}
+
+void RecursiveMutex::_lock(void)
+{
+    lock();
+}
+
+void RecursiveMutex::_unlock(void)
+{
+    release();
+}
+
+bool RecursiveMutex::lock(timeout_t timeout)
+{
+    bool result = true;
+    bool busy = false;
+    struct timespec ts;
+    Timer::tick_t start = 0;
+    set(&ts, timeout);
+
+    if(profiler)
+        start = lockstats::clock();
+
+    Conditional::lock();
+    while(result && lockers) {
+        if(Thread::equal(locker, pthread_self()))
+            break;
+        busy = true;
+        ++waiting;
+        result = Conditional::wait(&ts);
+        --waiting;
+    }
+    if(!lockers) {
+        result = true;
+        locker = pthread_self();
+        if(profiler)
+            profiler->acquire(start, busy);
+    }
+    else
+        result = false;
+    ++lockers;
+    Conditional::unlock();
+    return result;
+}
+
+void RecursiveMutex::lock(void)
+{
+    bool busy = false;
+    Timer::tick_t start = 0;
+
+    if(profiler)
+        start = lockstats::clock();
+
+    Conditional::lock();
+    while(lockers) {
+        if(Thread::equal(locker, pthread_self()))
+            break;
+        busy = true;
+        ++waiting;
+        Conditional::wait();
+        --waiting;
+    }
+    if(!lockers) {
+        locker = pthread_self();
+        if(profiler)
+            profiler->acquire(start, busy);
+    }
+    ++lockers;
+    Conditional::unlock();
+    return;
+}
+
+void RecursiveMutex::release(void)
+{
+    Conditional::lock();
+    --lockers;
+    if(!lockers && profiler)
+        profiler->release();
+    if(!lockers && waiting)
+        Conditional::signal();
+    Conditional::unlock();
+}
+
+ThreadLock::ThreadLock() :
+ConditionalAccess()
+{
+    writers = 0;
+}
+
+void ThreadLock::_lock(void)
+{
+    modify();
+}
+
+void ThreadLock::_share(void)
+{
+    access();
+}
+
+void ThreadLock::_unlock(void)
+{
+    release();
+}
+
+bool ThreadLock::modify(timeout_t timeout)
+{
+    bool rtn = true;
+    bool busy = false;
+    struct timespec ts;
+    Timer::tick_t start = 0;
+
+    if(timeout && timeout != Timer::inf)
+        set(&ts, timeout);
+
+    if(profiler)
+        start = lockstats::clock();
+
+    lock();
+    while((writers || sharing) && rtn) {
+        if(writers && Thread::equal(writeid, pthread_self()))
+            break;
+        busy = true;
+        ++pending;
+        if(timeout == Timer::inf)
+            waitSignal();
+        else if(timeout)
+            rtn = waitSignal(&ts);
+        else
+            rtn = false;
+        --pending;
+    }
+    assert(!max_sharing || writers < max_sharing);
+    if(rtn) {
+        if(!writers) {
+            writeid = pthread_self();
+            if(profiler)
+                profiler->acquire(start, busy);
+        }
+        ++writers;
+    }
+    unlock();
+    return rtn;
+}
+
+bool ThreadLock::access(timeout_t timeout)
+{
+    struct timespec ts;
+    bool rtn = true;
+    bool busy = false;
+    Timer::tick_t start = 0;
+
+    if(timeout && timeout != Timer::inf)
+        set(&ts, timeout);
+
+    if(profiler)
+        start = lockstats::clock();
+
+    lock();
+    while((writers || pending) && rtn) {
+        busy = true;
+        ++waiting;
+        if(timeout == Timer::inf)
+            waitBroadcast();
+        else if(timeout)
+            rtn = waitBroadcast(&ts);
+        else
+            rtn = false;
+        --waiting;
+    }
+    assert(!max_sharing || sharing < max_sharing);
+    if(rtn) {
+        ++sharing;
+        if(profiler)
+            profiler->acquire(start, busy);
+    }
+    unlock();
+    return rtn;
+}
+
+void ThreadLock::release(void)
+{
+    lock();
+    assert(sharing || writers);
+
+    if(writers) {
+        assert(!sharing);
+        --writers;
+        if(!writers && profiler)
+            profiler->release();
+        if(pending && !writers)
+            signal();
+        else if(waiting && !writers)
+            broadcast();
+        unlock();
+        return;
+    }
+    if(sharing) {
+        assert(!writers);
+        --sharing;
+        if(pending && !sharing)
+            signal();
+        else if(waiting && !pending)
+            broadcast();
+    }
+    unlock();
+}
+
+// each reader stripe of a big reader lock has its own cache line...
+struct brlock_stripe
+{
+#ifndef HAVE_GCC_ATOMICS
+    pthread_mutex_t mutex;
+#endif
+    unsigned readers;
+};
+
+union brlock_slot
+{
+    brlock_stripe stripe;
+    char pad[((sizeof(brlock_stripe) + LOCK_CACHELINE - 1) / LOCK_CACHELINE) * LOCK_CACHELINE];
+};
+
+#ifdef  HAVE_GCC_ATOMICS
+static bool brlock_enter(brlock_stripe *stripe, volatile unsigned *writing)
+{
+    __sync_add_and_fetch(&stripe->readers, 1);
+    if(!*writing)
+        return true;
+    __sync_sub_and_fetch(&stripe->readers, 1);
+    return false;
+}
+
+// true if a writer may be waiting for us to drain...
+static bool brlock_leave(brlock_stripe *stripe, volatile unsigned *writing)
+{
+    __sync_sub_and_fetch(&stripe->readers, 1);
+    return *writing != 0;
+}
+
+static unsigned brlock_count(brlock_stripe *stripe)
+{
+    return *(volatile unsigned *)&stripe->readers;
+}
+#else
+static bool brlock_enter(brlock_stripe *stripe, volatile unsigned *writing)
+{
+    bool rtn = false;
+
+    pthread_mutex_lock(&stripe->mutex);
+    if(!*writing) {
+        ++stripe->readers;
+        rtn = true;
+    }
+    pthread_mutex_unlock(&stripe->mutex);
+    return rtn;
+}
+
+static bool brlock_leave(brlock_stripe *stripe, volatile unsigned *writing)
+{
+    bool rtn;
+
+    pthread_mutex_lock(&stripe->mutex);
+    --stripe->readers;
+    rtn = (*writing != 0);
+    pthread_mutex_unlock(&stripe->mutex);
+    return rtn;
+}
+
+static unsigned brlock_count(brlock_stripe *stripe)
+{
+    unsigned count;
+
+    pthread_mutex_lock(&stripe->mutex);
+    count = stripe->readers;
+    pthread_mutex_unlock(&stripe->mutex);
+    return count;
+}
+#endif
+
+BigReaderLock::BigReaderLock(unsigned count) :
+Conditional()
+{
+    caddr_t mem;
+    brlock_slot *list;
+
+    if(!count)
+        count = Thread::processors();
+
+    stripes = count;
+    writing = 0;
+    writers = 0;
+
+    mem = (caddr_t)::malloc(sizeof(brlock_slot) * stripes + LOCK_CACHELINE);
+    crit(mem != NULL, "big reader lock alloc failed");
+    slots = mem;
+    list = (brlock_slot *)(mem + LOCK_CACHELINE - ((uintptr_t)mem % LOCK_CACHELINE));
+    for(unsigned pos = 0; pos < stripes; ++pos) {
+        list[pos].stripe.readers = 0;
+#ifndef HAVE_GCC_ATOMICS
+        pthread_mutex_init(&list[pos].stripe.mutex, NULL);
+#endif
+    }
+}
+
+BigReaderLock::~BigReaderLock()
+{
+#ifndef HAVE_GCC_ATOMICS
+    for(unsigned pos = 0; pos < stripes; ++pos)
+        pthread_mutex_destroy(&((brlock_stripe *)stripe())[pos].mutex);
+#endif
+    ::free(slots);
+}
+
+void *BigReaderLock::stripe(void)
+{
+    caddr_t mem = (caddr_t)slots;
+    return mem + LOCK_CACHELINE - ((uintptr_t)mem % LOCK_CACHELINE);
+}
+
+bool BigReaderLock::drained(void)
+{
+    brlock_slot *list = (brlock_slot *)stripe();
+
+    for(unsigned pos = 0; pos < stripes; ++pos) {
+        if(brlock_count(&list[pos].stripe))
+            return false;
+    }
+    return true;
+}
+
+void BigReaderLock::_lock(void)
+{
+    modify();
+}
+
+void BigReaderLock::_share(void)
+{
+    access();
+}
+
+void BigReaderLock::_unlock(void)
+{
+    release();
+}
+
+bool BigReaderLock::modify(timeout_t timeout)
+{
+    struct timespec ts;
+    bool rtn = true;
+
+    if(timeout && timeout != Timer::inf)
+        set(&ts, timeout);
+
+    lock();
+    while(writers && rtn) {
+        if(Thread::equal(writeid, pthread_self()))
+            break;
+        if(timeout == Timer::inf)
+            wait();
+        else if(timeout)
+            rtn = wait(&ts);
+        else
+            rtn = false;
+    }
+
+    if(!rtn) {
+        unlock();
+        return false;
+    }
+
+    if(writers++) {
+        unlock();
+        return true;
+    }
+
+    // hold off new readers, then wait for current ones to leave; the
+    // writer is only valid while writers is held under the lock...
+    writeid = pthread_self();
+    writing = 1;
+    lock_publish();
+    while(!drained()) {
+        if(timeout == Timer::inf)
+            wait();
+        else if(!timeout || !wait(&ts)) {
+            if(drained())
+                break;
+            writers = 0;
+            writing = 0;
+            broadcast();
+            unlock();
+            return false;
+        }
+    }
+    unlock();
+    return true;
+}
+
+bool BigReaderLock::access(timeout_t timeout)
+{
+    brlock_stripe *reader = &((brlock_slot *)stripe())[thread_slot() % stripes].stripe;
+    struct timespec ts;
+    bool rtn = true;
+
+    if(brlock_enter(reader, &writing))
+        return true;
+
+    if(timeout && timeout != Timer::inf)
+        set(&ts, timeout);
+
+    // our brief count may have held up a draining writer...
+    lock();
+    broadcast();
+    for(;;) {
+        while(writing && rtn) {
+            if(timeout == Timer::inf)
+                wait();
+            else if(timeout)
+                rtn = wait(&ts);
+            else
+                rtn = false;
+        }
+        if(!rtn || brlock_enter(reader, &writing))
+            break;
+        broadcast();
+    }
+    unlock();
+    return rtn;
+}
+
+void BigReaderLock::release(void)
+{
+    brlock_stripe *reader = &((brlock_slot *)stripe())[thread_slot() % stripes].stripe;
+
+    // only our own modify sets writing where we would see it, and who the
+    // writer is can only be trusted under the lock...
+    if(writing) {
+        lock();
+        if(writers && Thread::equal(writeid, pthread_self())) {
+            if(!--writers) {
+                writing = 0;
+                broadcast();
+            }
+        }
+        else {
+            brlock_leave(reader, &writing);
+            broadcast();
+        }
+        unlock();
+        return;
+    }
+
+    if(brlock_leave(reader, &writing)) {
+        lock();
+        broadcast();
+        unlock();
+    }
+}
+
+auto_protect::auto_protect()
+{
+    object = NULL;
+}
+
+auto_protect::auto_protect(const void *obj)
+{
+    object = obj;
+    if(object)
+        Mutex::protect(obj);
+}
+
+auto_protect::~auto_protect()
+{
+    release();
+}
+
+void auto_protect::release()
+{
+    if(object) {
+        Mutex::release(object);
+        object = NULL;
+    }
+}
+
+void auto_protect::operator=(const void *obj)
+{
+    if(obj == object)
+        return;
+
+    release();
+    object = obj;
+    if(object)
+        Mutex::protect(object);
+}
+
+Mutex::guard::guard()
+{
+    object = NULL;
+}
+
+Mutex::guard::guard(const void *obj)
+{
+    object = obj;
+    if(obj)
+        Mutex::protect(object);
+}
+
+Mutex::guard::~guard()
+{
+    release();
+}
+
+void Mutex::guard::set(const void *obj)
+{
+    release();
+    object = obj;
+    if(obj)
+        Mutex::protect(object);
+}
+
+void Mutex::guard::release(void)
+{
+    if(object) {
+        Mutex::release(object);
+        object = NULL;
+    }
+}
+
+Mutex::Mutex()
+{
+    profiler = NULL;
+#ifdef  __PTH__
+    pth_mutex_init(&mlock);
+#else
+    crit(pthread_mutex_init(&mlock, NULL) == 0, "mutex init failed");
+#endif
+}
+
+Mutex::~Mutex()
+{
+    pthread_mutex_destroy(&mlock);
+}
+
+void Mutex::indexing(unsigned index)
+{
+    if(index > 1)
+        lock_indexing(&mutex_table, &mutex_indexing, index);
+}
+
+void ThreadLock::indexing(unsigned index)
+{
+    if(index > 1)
+        lock_indexing(&rwlock_table, &rwlock_indexing, index);
+}
+
+unsigned long Mutex::contention(const void *ptr)
+{
+    if(!ptr)
+        return 0;
+
+    return lock_select(&mutex_table, &mutex_indexing, ptr)->contended;
+}
+
+unsigned long ThreadLock::contention(const void *ptr)
+{
+    if(!ptr)
+        return 0;
+
+    return lock_select(&rwlock_table, &rwlock_indexing, ptr)->contended;
+}
+
+ThreadLock::guard_reader::guard_reader()
+{
+    object = NULL;
+}
+
+ThreadLock::guard_reader::guard_reader(const void *obj)
+{
+    object = obj;
+    if(obj)
+        if(!ThreadLock::reader(object))
+            object = NULL;
+}
+
+ThreadLock::guard_reader::~guard_reader()
+{
+    release();
+}
+
+void ThreadLock::guard_reader::set(const void *obj)
+{
+    release();
+    object = obj;
+    if(obj)
+        if(!ThreadLock::reader(object))
+            object = NULL;
+}
+
+void ThreadLock::guard_reader::release(void)
+{
+    if(object) {
+        ThreadLock::release(object);
+        object = NULL;
+    }
+}
+
+ThreadLock::guard_writer::guard_writer()
+{
+    object = NULL;
+}
+
+ThreadLock::guard_writer::guard_writer(const void *obj)
+{
+    object = obj;
+    if(obj)
+        if(!ThreadLock::writer(object))
+            object = NULL;
+}
+
+ThreadLock::guard_writer::~guard_writer()
+{
+    release();
+}
+
+void ThreadLock::guard_writer::set(const void *obj)
+{
+    release();
+    object = obj;
+    if(obj)
+        if(!ThreadLock::writer(object))
+            object = NULL;
+}
+
+void ThreadLock::guard_writer::release(void)
+{
+    if(object) {
+        ThreadLock::release(object);
+        object = NULL;
+    }
+}
+
+bool ThreadLock::reader(const void *ptr, timeout_t timeout)
+{
+    if(!ptr)
+        return false;
+
+    lock_index *index = lock_select(&rwlock_table, &rwlock_indexing, ptr);
+    rwlock_entry *entry = static_cast<rwlock_entry *>(lock_acquire<rwlock_entry>(index, ptr));
+
+    if(entry->access(timeout))
+        return true;
+
+    lock_enter(index);
+    lock_add(&entry->count, -1);
+    lock_leave(index);
+    return false;
+}
+
+bool ThreadLock::writer(const void *ptr, timeout_t timeout)
+{
+    if(!ptr)
+        return false;
+
+    lock_index *index = lock_select(&rwlock_table, &rwlock_indexing, ptr);
+    rwlock_entry *entry = static_cast<rwlock_entry *>(lock_acquire<rwlock_entry>(index, ptr));
+
+    if(entry->modify(timeout))
+        return true;
+
+    lock_enter(index);
+    lock_add(&entry->count, -1);
+    lock_leave(index);
+    return false;
+}
+
+void Mutex::protect(const void *ptr)
+{
+    if(!ptr)
+        return;
+
+    lock_index *index = lock_select(&mutex_table, &mutex_indexing, ptr);
+    mutex_entry *entry = static_cast<mutex_entry *>(lock_acquire<mutex_entry>(index, ptr));
+
+    pthread_mutex_lock(&entry->mutex);
+}
+
+void ThreadLock::release(const void *ptr)
+{
+    if(!ptr)
+        return;
+
+    lock_index *index = lock_select(&rwlock_table, &rwlock_indexing, ptr);
+
+    lock_enter(index);
+    rwlock_entry *entry = static_cast<rwlock_entry *>(lock_holder(index, ptr));
+    assert(entry);
+    if(entry) {
+        entry->release();
+        lock_add(&entry->count, -1);
+    }
+    lock_leave(index);
+}
+
+void Mutex::release(const void *ptr)
+{
+    if(!ptr)
+        return;
+
+    lock_index *index = lock_select(&mutex_table, &mutex_indexing, ptr);
+
+    lock_enter(index);
+    mutex_entry *entry = static_cast<mutex_entry *>(lock_holder(index, ptr));
+    assert(entry);
+    if(entry) {
+        pthread_mutex_unlock(&entry->mutex);
+        lock_add(&entry->count, -1);
+    }
+    lock_leave(index);
+}
+
+void Mutex::profile(const char *id)
+{
+    if(!profiler)
+        profiler = lockstats::create(id);
+}
+
+void Mutex::_profile_lock(void)
+{
+    Timer::tick_t start = lockstats::clock();
+    bool busy = false;
+
+    if(pthread_mutex_trylock(&mlock)) {
+        busy = true;
+        pthread_mutex_lock(&mlock);
+    }
+    profiler->acquire(start, busy);
+}
+
+void Mutex::_profile_unlock(void)
+{
+    profiler->release();
+    pthread_mutex_unlock(&mlock);
+}
+
+void Mutex::_lock(void)
+{
+    lock();
+}
+
+void Mutex::_unlock(void)
+{
+    unlock();
+}
+
+// spin limits of adaptive locks, spinning is pointless on one cpu...
+static unsigned spin_cpus = 0;
+static unsigned spin_limit = 64;
+static unsigned spin_backoff = 64;
+
+static inline void spin_relax(void)
+{
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+    __asm__ __volatile__("pause" ::: "memory");
+#endif
+}
+
+static unsigned spin_count(unsigned count)
+{
+    if(!spin_cpus)
+        spin_cpus = Thread::processors();
+
+    if(spin_cpus < 2)
+        return 0;
+
+    if(!count)
+        return spin_limit;
+
+    return count;
+}
+
+void SpinMutex::tuning(unsigned count, unsigned backoff)
+{
+    spin_limit = count;
+    spin_backoff = backoff ? backoff : 1;
+}
+
+SpinMutex::SpinMutex(unsigned count)
+{
+    word = 0;
+    spins = spin_count(count);
+    acquires = spinning = parking = 0;
+#ifdef  __PTH__
+    pth_mutex_init(&mlock);
+#else
+    crit(pthread_mutex_init(&mlock, NULL) == 0, "mutex init failed");
+#endif
+}
+
+SpinMutex::~SpinMutex()
+{
+    pthread_mutex_destroy(&mlock);
+}
+
+#ifdef  USE_FUTEX
+
+// word is 0 when free, 1 when held, and 2 when held with parked waiters...
+void SpinMutex::contended(void)
+{
+    unsigned delay = 1, count = spins;
+
+    while(count--) {
+        for(unsigned pause = 0; pause < delay; ++pause)
+            spin_relax();
+        if(delay < spin_backoff)
+            delay <<= 1;
+        if(!futex_load(&word) && __sync_bool_compare_and_swap(&word, 0, 1)) {
+            ++acquires;
+            ++spinning;
+            return;
+        }
+    }
+
+    while(__sync_lock_test_and_set(&word, 2))
+        futex_wait(&word, 2, NULL);
+    ++acquires;
+    ++parking;
+}
+
+void SpinMutex::lock(void)
+{
+    if(__sync_bool_compare_and_swap(&word, 0, 1)) {
+        ++acquires;
+        return;
+    }
+    contended();
+}
+
+bool SpinMutex::trylock(void)
+{
+    if(!__sync_bool_compare_and_swap(&word, 0, 1))
+        return false;
+    ++acquires;
+    return true;
+}
+
+void SpinMutex::unlock(void)
+{
+    if(__sync_fetch_and_sub(&word, 1) != 1) {
+        __sync_lock_release(&word);
+        futex_wake(&word, 1);
+    }
+}
+
+TicketMutex::TicketMutex(unsigned count) : Conditional()
+{
+    next = serving = waiting = 0;
+    spins = spin_count(count);
+}
+
+void TicketMutex::lock(void)
+{
+    unsigned ticket = __sync_fetch_and_add(&next, 1);
+    unsigned count = spins, current, delay;
+
+    // back off in proportion to how far we are from being served...
+    while((current = futex_load(&serving)) != ticket) {
+        if(count) {
+            --count;
+            delay = ticket - current;
+            if(delay > spin_backoff)
+                delay = spin_backoff;
+            for(delay *= 8; delay; --delay)
+                spin_relax();
+            continue;
+        }
+        __sync_add_and_fetch(&waiting, 1);
+        current = futex_load(&serving);
+        if(current != ticket)
+            futex_wait(&serving, current, NULL);
+        __sync_sub_and_fetch(&waiting, 1);
+    }
+    __sync_synchronize();
+}
+
+void TicketMutex::unlock(void)
+{
+    __sync_add_and_fetch(&serving, 1);
+    if(futex_load(&waiting))
+        futex_wake(&serving, INT_MAX);
+}
+
+#else
+
+void SpinMutex::contended(void)
+{
+    unsigned delay = 1, count = spins;
+
+    while(count--) {
+        for(unsigned pause = 0; pause < delay; ++pause)
+            spin_relax();
+        if(delay < spin_backoff)
+            delay <<= 1;
+        if(!pthread_mutex_trylock(&mlock)) {
+            ++acquires;
+            ++spinning;
+            return;
+        }
+    }
+
+    pthread_mutex_lock(&mlock);
+    ++acquires;
+    ++parking;
+}
+
+void SpinMutex::lock(void)
+{
+    if(!pthread_mutex_trylock(&mlock)) {
+        ++acquires;
+        return;
+    }
+    contended();
+}
+
+bool SpinMutex::trylock(void)
+{
+    if(pthread_mutex_trylock(&mlock))
+        return false;
+    ++acquires;
+    return true;
+}
+
+void SpinMutex::unlock(void)
+{
+    pthread_mutex_unlock(&mlock);
+}
+
+TicketMutex::TicketMutex(unsigned count) : Conditional()
+{
+    next = serving = waiting = 0;
+    spins = spin_count(count);
+}
+
+void TicketMutex::lock(void)
+{
+    Conditional::lock();
+    unsigned ticket = next++;
+    while(serving != ticket) {
+        ++waiting;
+        Conditional::wait();
+        --waiting;
+    }
+    Conditional::unlock();
+}
+
+void TicketMutex::unlock(void)
+{
+    Conditional::lock();
+    ++serving;
+    if(waiting)
+        Conditional::broadcast();
+    Conditional::unlock();
+}
+
+#endif
+
+void SpinMutex::_lock(void)
+{
+    lock();
+}
+
+void SpinMutex::_unlock(void)
+{
+    unlock();
+}
+
+void TicketMutex::_lock(void)
+{
+    lock();
+}
+
+void TicketMutex::_unlock(void)
+{
+    unlock();
+}
+
+SeqLock::SeqLock()
+{
+    sequence = 0;
+}
+
+#ifdef  HAVE_GCC_ATOMICS
+
+unsigned SeqLock::begin(void)
+{
+    unsigned seq, spin = 0;
+
+    // writers are brief, but may be preempted while holding an odd count
+    while((seq = sequence) & 1) {
+        if(++spin < 64)
+            spin_relax();
+        else {
+            spin = 0;
+            Thread::yield();
+        }
+    }
+    lock_publish();
+    return seq;
+}
+
+bool SeqLock::retry(unsigned seq)
+{
+    lock_publish();
+    return sequence != seq;
+}
+
+void SeqLock::modify(void)
+{
+    writer.acquire();
+    ++sequence;
+    lock_publish();
+}
+
+void SeqLock::commit(void)
+{
+    lock_publish();
+    ++sequence;
+    writer.release();
+}
+
+#else
+
+unsigned SeqLock::begin(void)
+{
+    writer.acquire();
+    return sequence;
+}
+
+bool SeqLock::retry(unsigned)
+{
+    writer.release();
+    return false;
+}
+
+void SeqLock::modify(void)
+{
+    writer.acquire();
+    ++sequence;
+}
+
+void SeqLock::commit(void)
+{
+    ++sequence;
+    writer.release();
+}
+
+#endif
+
+#ifdef  _MSTHREADS_
+
+TimedEvent::TimedEvent() :
+Timer()
+{
+    event = CreateEvent(NULL, FALSE, FALSE, NULL);
+    InitializeCriticalSection((LPCRITICAL_SECTION)&mutex);
+    set();
+}
+
+TimedEvent::~TimedEvent()
+{
+    if(event != INVALID_HANDLE_VALUE) {
+        CloseHandle(event);
+        event = INVALID_HANDLE_VALUE;
+    }
+    DeleteCriticalSection((LPCRITICAL_SECTION)&mutex);
+}
+
+TimedEvent::TimedEvent(timeout_t timeout) :
+Timer(timeout)
+{
+    event = CreateEvent(NULL, FALSE, FALSE, NULL);
+    InitializeCriticalSection((LPCRITICAL_SECTION)&mutex);
+}
+
+TimedEvent::TimedEvent(time_t timer) :
+Timer(timer)
+{
+    event = CreateEvent(NULL, FALSE, FALSE, NULL);
+    InitializeCriticalSection((LPCRITICAL_SECTION)&mutex);
+}
+
+void TimedEvent::signal(void)
+{
+    SetEvent(event);
+}
+
+void TimedEvent::reset(void)
+{
+    set();
+    ResetEvent(event);
+}
+
+bool TimedEvent::sync(void)
+{
+    int result;
+    timeout_t timeout;
+
+    timeout = get();
+    if(!timeout)
+        return false;
+
+    LeaveCriticalSection((LPCRITICAL_SECTION)&mutex);
+    result = WaitForSingleObject(event, timeout);
+    EnterCriticalSection((LPCRITICAL_SECTION)&mutex);
+    if(result != WAIT_OBJECT_0)
+        return true;
+    return false;
+}
+
+bool TimedEvent::wait(timeout_t timer)
+{
+    int result;
+    timeout_t timeout;
+
+    if(timer)
+        operator+=(timer);
+
+    timeout = get();
+    if(!timeout)
+        return false;
+
+    result = WaitForSingleObject(event, timeout);
+    if(result == WAIT_OBJECT_0)
+        return true;
+    return false;
+}
+
+void TimedEvent::wait(void)
+{
+    WaitForSingleObject(event, INFINITE);
+}
+
+#else
+
+TimedEvent::TimedEvent() :
+Timer()
+{
+    signalled = waiting = 0;
+#ifdef  __PTH__
+    Thread::init();
+    pth_cond_init(&cond);
+    pth_mutex_init(&mutex);
+#else
+    crit(pthread_cond_init(&cond, Conditional::initializer()) == 0, "conditional init failed");
+    crit(pthread_mutex_init(&mutex, NULL) == 0, "mutex init failed");
+#endif
+    set();
+}
+
+TimedEvent::TimedEvent(timeout_t timeout) :
+Timer(timeout)
+{
+    signalled = waiting = 0;
+#ifdef  __PTH__
+    Thread::init();
+    pth_cond_init(&cond);
+    pth_mutex_init(&mutex);
+#else
+    crit(pthread_cond_init(&cond, Conditional::initializer()) == 0, "conditional init failed");
+    crit(pthread_mutex_init(&mutex, NULL) == 0, "mutex init failed");
+#endif
+}
+
+TimedEvent::TimedEvent(time_t timer) :
+Timer(timer)
+{
+    signalled = waiting = 0;
+#ifdef  __PTH__
+    Thread::init();
+    pth_cond_init(&cond);
+    pth_mutex_init(&mutex);
+#else
+    crit(pthread_cond_init(&cond, Conditional::initializer()) == 0, "conditional init failed");
+    crit(pthread_mutex_init(&mutex, NULL) == 0, "mutex init failed");
+#endif
+}
+
+TimedEvent::~TimedEvent()
+{
+#ifndef __PTH__
+    pthread_cond_destroy(&cond);
+    pthread_mutex_destroy(&mutex);
+#endif
+}
+
+#ifdef  USE_FUTEX
+
+void TimedEvent::reset(void)
+{
+    pthread_mutex_lock(&mutex);
+    signalled = 0;
+    set();
+    pthread_mutex_unlock(&mutex);
+}
+
+void TimedEvent::signal(void)
+{
+    __sync_fetch_and_or(&signalled, 1);
+    if(futex_load(&waiting))
+        futex_wake(&signalled, 1);
+}
+
+bool TimedEvent::sync(void)
+{
+    timeout_t timeout = get();
+    struct timespec ts;
+    bool result;
+
+    if(__sync_bool_compare_and_swap(&signalled, 1, 0))
+        return true;
+
+    if(!timeout)
+        return false;
+
+    futex_deadline(&ts, timeout);
+    pthread_mutex_unlock(&mutex);
+    result = event_wait(&signalled, &waiting, &ts);
+    pthread_mutex_lock(&mutex);
+    return result;
+}
+
+void TimedEvent::wait(void)
+{
+    event_wait(&signalled, &waiting, NULL);
+}
+
+#else
+
+void TimedEvent::reset(void)
+{
+    pthread_mutex_lock(&mutex);
+    signalled = 0;
+    set();
+    pthread_mutex_unlock(&mutex);
+}
+
+void TimedEvent::signal(void)
+{
+    pthread_mutex_lock(&mutex);
+    signalled = 1;
+    pthread_cond_signal(&cond);
+    pthread_mutex_unlock(&mutex);
+}
+
+bool TimedEvent::sync(void)
+{
+    timeout_t timeout = get();
+    struct timespec ts;
+
+    if(signalled) {
+        signalled = 0;
+        return true;
+    }
+
+    if(!timeout)
+        return false;
+
+    Conditional::set(&ts, timeout);
+
+    if(pthread_cond_timedwait(&cond, &mutex, &ts) == ETIMEDOUT)
+        return false;
+
+    signalled = 0;
+    return true;
+}
+
+void TimedEvent::wait(void)
+{
+    pthread_mutex_lock(&mutex);
+    if(signalled)
+        signalled = 0;
+    else
+        pthread_cond_wait(&cond, &mutex);
+    pthread_mutex_unlock(&mutex);
+}
+
+#endif
+
+bool TimedEvent::wait(timeout_t timeout)
+{
+    bool result = true;
+
+    pthread_mutex_lock(&mutex);
+    operator+=(timeout);
+    result = sync();
+    pthread_mutex_unlock(&mutex);
+    return result;
+}
+#endif
+
+void TimedEvent::lock(void)
+{
+    pthread_mutex_lock(&mutex);
+}
+
+void TimedEvent::release(void)
+{
+    pthread_mutex_unlock(&mutex);
+}
+
+ConditionalLock::ConditionalLock() :
+ConditionalAccess()
+{
+    contexts = NULL;
+    slots = NULL;
+    slotcount = 0;
+}
+
+ConditionalLock::~ConditionalLock()
+{
+    linked_pointer<Context> cp = contexts, next;
+    while(cp) {
+        next = cp->getNext();
+        delete *cp;
+        cp = next;
+    }
+    if(slots)
+        delete[] slots;
+}
+
+ConditionalLock::Context *ConditionalLock::getContext(void)
+{
+    unsigned slot = thread_slot();
+    Context *context;
+
+    // contexts are indexed by thread slot, so lookup never walks...
+    if(slot >= slotcount) {
+        unsigned size = slotcount ? slotcount * 2 : 8;
+        if(size <= slot)
+            size = slot + 1;
+        Context **list = new Context *[size];
+        memset(list, 0, sizeof(Context *) * size);
+        if(slots) {
+            memcpy(list, slots, sizeof(Context *) * slotcount);
+            delete[] slots;
+        }
+        slots = list;
+        slotcount = size;
+    }
+
+    context = slots[slot];
+    if(!context) {
+        context = new Context(&this->contexts);
+        context->count = 0;
+        slots[slot] = context;
+    }
+    if(!context->count)
+        context->thread = Thread::self();
+    return context;
+}
+
+void ConditionalLock::_share(void)
+{
+    access();
+}
+
+void ConditionalLock::_unlock(void)
+{
+    release();
+}
+
+void ConditionalLock::modify(void)
+{
+    Context *context;
+
+    lock();
+    context = getContext();
+
+    assert(context && sharing >= context->count);
+
+    sharing -= context->count;
+    while(sharing) {
+        ++pending;
+        waitSignal();
+        --pending;
+    }
+    ++context->count;
+}
+
+void ConditionalLock::commit(void)
+{
+    Context *context = getContext();
+    --context->count;
+
+    if(context->count) {
+        sharing += context->count;
+        unlock();
+    }
+    else
+        ConditionalAccess::commit();
+}
+
+void ConditionalLock::release(void)
+{
+    Context *context;
+
+    lock();
+    context = getContext();
+    assert(sharing && context && context->count > 0);
+    --sharing;
+    --context->count;
+    if(pending && !sharing)
+        signal();
+    else if(waiting && !pending)
+        broadcast();
+    unlock();
+}
+
+void ConditionalLock::access(void)
+{
+    Context *context;
+    lock();
+    context = getContext();
+    assert(context && (!max_sharing || sharing < max_sharing));
+
+    // reschedule if pending exclusives to make sure modify threads are not
+    // starved.
+
+    ++context->count;
+
+    while(context->count < 2 && pending) {
+        ++waiting;
+        waitBroadcast();
+        --waiting;
+    }
+    ++sharing;
+    unlock();
+}
+
+void ConditionalLock::exclusive(void)
+{
+    Context *context;
+
+    lock();
+    context = getContext();
+    assert(sharing && context && context->count > 0);
+    sharing -= context->count;
+    while(sharing) {
+        ++pending;
+        waitSignal();
+        --pending;
+    }
+}
+
+void ConditionalLock::share(void)
+{
+    Context *context = getContext();
+    assert(!sharing && context && context->count);
+    sharing += context->count;
+    unlock();
+}
+
+barrier::barrier(unsigned limit) :
+Conditional()
+{
+    count = limit;
+    waits = 0;
+    generation = 0;
+}
+
+barrier::~barrier()
+{
+    lock();
+    if(waits)
+        wakeup();
+    unlock();
+}
+
+void barrier::wakeup(void)
+{
+    waits = 0;
+#ifdef  USE_FUTEX
+    __sync_add_and_fetch(&generation, 1);
+    futex_wake(&generation, INT_MAX);
+#else
+    broadcast();
+#endif
+}
+
+void barrier::set(unsigned limit)
+{
+    assert(limit > 0);
+
+    lock();
+    count = limit;
+    if(count <= waits)
+        wakeup();
+    unlock();
+}
+
+void barrier::dec(void)
+{
+    lock();
+    if(count)
+        --count;
+    unlock();
+}
+
+unsigned barrier::operator--(void)
+{
+    unsigned result;
+    lock();
+    if(count)
+        --count;
+    result = count;
+    unlock();
+    return result;
+}
+
+void barrier::inc(void)
+{
+    lock();
+    count++;
+    if(count <= waits)
+        wakeup();
+    unlock();
+}
+
+unsigned barrier::operator++(void)
+{
+    unsigned result;
+    lock();
+    count++;
+    if(count <= waits)
+        wakeup();
+    result = count;
+    unlock();
+    return result;
+}
+
+bool barrier::wait(timeout_t timeout)
+{
+    bool result;
+
+    Conditional::lock();
+    if(!count) {
+        Conditional::unlock();
+        return true;
+    }
+    if(++waits >= count) {
+        wakeup();
+        Conditional::unlock();
+        return true;
+    }
+#ifdef  USE_FUTEX
+    struct timespec ts;
+    unsigned gen = generation;
+
+    futex_deadline(&ts, timeout);
+    Conditional::unlock();
+    result = true;
+    while(futex_load(&generation) == gen) {
+        if(!futex_wait(&generation, gen, &ts)) {
+            Conditional::lock();
+            if(generation == gen) {
+                --waits;
+                result = false;
+            }
+            Conditional::unlock();
+            break;
+        }
+    }
+#else
+    result = Conditional::wait(timeout);
+    Conditional::unlock();
+#endif
+    return result;
+}
+
+void barrier::wait(void)
+{
+    Conditional::lock();
+    if(!count) {
+        Conditional::unlock();
+        return;
+    }
+    if(++waits >= count) {
+        wakeup();
+        Conditional::unlock();
+        return;
+    }
+#ifdef  USE_FUTEX
+    unsigned gen = generation;
+
+    Conditional::unlock();
+    while(futex_load(&generation) == gen)
+        futex_wait(&generation, gen, NULL);
+#else
+    Conditional::wait();
+    Conditional::unlock();
+#endif
 }
 
-#ifdef  _MSTHREADS_
-
-TimedEvent::TimedEvent() :
-Timer()
+LockedPointer::LockedPointer()
 {
-    event = CreateEvent(NULL, FALSE, FALSE, NULL);
+#if defined(_MSTHREADS_)
     InitializeCriticalSection((LPCRITICAL_SECTION)&mutex);
-    set();
+#else
+#ifdef  __PTH__
+    static pthread_mutex_t lock = PTH_MUTEX_INIT;
+#else
+    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+    memcpy(&mutex, &lock, sizeof(mutex));
+#endif
+    pointer = NULL;
 }
 
-TimedEvent::~TimedEvent()
+void LockedPointer::replace(ObjectProtocol *obj)
 {
-    if(event != INVALID_HANDLE_VALUE) {
-        CloseHandle(event);
-        event = INVALID_HANDLE_VALUE;
-    }
-    DeleteCriticalSection((LPCRITICAL_SECTION)&mutex);
-}
+    assert(obj != NULL);
 
-TimedEvent::TimedEvent(timeout_t timeout) :
-Timer(timeout)
-{
-    event = CreateEvent(NULL, FALSE, FALSE, NULL);
-    InitializeCriticalSection((LPCRITICAL_SECTION)&mutex);
+    pthread_mutex_lock(&mutex);
+    obj->retain();
+    if(pointer)
+        pointer->release();
+    pointer = obj;
+    pthread_mutex_unlock(&mutex);
 }
 
-TimedEvent::TimedEvent(time_t timer) :
-Timer(timer)
+ObjectProtocol *LockedPointer::dup(void)
 {
-    event = CreateEvent(NULL, FALSE, FALSE, NULL);
-    InitializeCriticalSection((LPCRITICAL_SECTION)&mutex);
+    ObjectProtocol *temp;
+    pthread_mutex_lock(&mutex);
+    temp = pointer;
+    if(temp)
+        temp->retain();
+    pthread_mutex_unlock(&mutex);
+    return temp;
 }
 
-void TimedEvent::signal(void)
+SharedObject::~SharedObject()
 {
-    SetEvent(event);
 }
 
-void TimedEvent::reset(void)
+SharedPointer::SharedPointer() :
+ConditionalAccess()
 {
-    set();
-    ResetEvent(event);
+    pointer = NULL;
 }
 
-bool TimedEvent::sync(void)
+SharedPointer::~SharedPointer()
 {
-    int result;
-    timeout_t timeout;
-
-    timeout = get();
-    if(!timeout)
-        return false;
-
-    LeaveCriticalSection((LPCRITICAL_SECTION)&mutex);
-    result = WaitForSingleObject(event, timeout);
-    EnterCriticalSection((LPCRITICAL_SECTION)&mutex);
-    if(result != WAIT_OBJECT_0)
-        return true;
-    return false;
 }
 
-bool TimedEvent::wait(timeout_t timer)
+void SharedPointer::replace(SharedObject *ptr)
 {
-    int result;
-    timeout_t timeout;
-
-    if(timer)
-        operator+=(timer);
+    modify();
 
-    timeout = get();
-    if(!timeout)
-        return false;
+    if(pointer)
+        delete pointer;
+    pointer = ptr;
+    if(ptr)
+        ptr->commit(this);
 
-    result = WaitForSingleObject(event, timeout);
-    if(result == WAIT_OBJECT_0)
-        return true;
-    return false;
+    commit();
 }
 
-void TimedEvent::wait(void)
+SharedObject *SharedPointer::share(void)
 {
-    WaitForSingleObject(event, INFINITE);
+    access();
+    return pointer;
 }
 
-#else
+// Epoch readers each own a line padded record found by thread slot.  A
+// reader stores the global epoch in its record on entry and clears it on
+// exit.  A writer publishes, advances the epoch, and then waits until no
+// record holds an epoch older than the new one.  Records are allocated in
+// chunks that are never freed or moved, so readers find them without a
+// lock.  Without gcc atomics each record has a mutex that orders the
+// reader against a scanning writer, which still never shares a line.
 
-TimedEvent::TimedEvent() :
-Timer()
+#define EPOCH_CHUNK     64
+#define EPOCH_CHUNKS    1024
+
+struct epoch_record
 {
-    signalled = false;
-#ifdef  __PTH__
-    Thread::init();
-    pth_cond_init(&cond);
-    pth_mutex_init(&mutex);
-#else
-    crit(pthread_cond_init(&cond, Conditional::initializer()) == 0, "conditional init failed");
-    crit(pthread_mutex_init(&mutex, NULL) == 0, "mutex init failed");
+    volatile unsigned long epoch;
+    unsigned nesting;
+#ifndef HAVE_GCC_ATOMICS
+    pthread_mutex_t mutex;
 #endif
-    set();
-}
+};
 
-TimedEvent::TimedEvent(timeout_t timeout) :
-Timer(timeout)
+union epoch_slot
 {
-    signalled = false;
-#ifdef  __PTH__
-    Thread::init();
-    pth_cond_init(&cond);
-    pth_mutex_init(&mutex);
-#else
-    crit(pthread_cond_init(&cond, Conditional::initializer()) == 0, "conditional init failed");
-    crit(pthread_mutex_init(&mutex, NULL) == 0, "mutex init failed");
+    epoch_record record;
+    char pad[((sizeof(epoch_record) + LOCK_CACHELINE - 1) / LOCK_CACHELINE) * LOCK_CACHELINE];
+};
+
+static epoch_slot *volatile epoch_chunks[EPOCH_CHUNKS];
+static volatile unsigned epoch_count = 0;
+static volatile unsigned long epoch_global = 1;
+static pthread_mutex_t epoch_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static epoch_record *epoch_reader(void)
+{
+    unsigned slot = thread_slot();
+    unsigned chunk = slot / EPOCH_CHUNK;
+    epoch_slot *list;
+
+    crit(chunk < EPOCH_CHUNKS, "epoch reader limit exceeded");
+
+    list = epoch_chunks[chunk];
+    if(!list) {
+        pthread_mutex_lock(&epoch_lock);
+        while(epoch_count <= chunk) {
+            caddr_t mem = (caddr_t)::malloc(sizeof(epoch_slot) * EPOCH_CHUNK + LOCK_CACHELINE);
+            crit(mem != NULL, "epoch reader alloc failed");
+            mem += LOCK_CACHELINE - ((uintptr_t)mem % LOCK_CACHELINE);
+            list = (epoch_slot *)mem;
+            for(unsigned pos = 0; pos < EPOCH_CHUNK; ++pos) {
+                list[pos].record.epoch = 0;
+                list[pos].record.nesting = 0;
+#ifndef HAVE_GCC_ATOMICS
+                pthread_mutex_init(&list[pos].record.mutex, NULL);
 #endif
+            }
+            epoch_chunks[epoch_count] = list;
+            lock_publish();
+            ++epoch_count;
+        }
+        list = epoch_chunks[chunk];
+        pthread_mutex_unlock(&epoch_lock);
+    }
+    return &list[slot % EPOCH_CHUNK].record;
 }
 
-TimedEvent::TimedEvent(time_t timer) :
-Timer(timer)
+static void epoch_enter(void)
 {
-    signalled = false;
-#ifdef  __PTH__
-    Thread::init();
-    pth_cond_init(&cond);
-    pth_mutex_init(&mutex);
+    epoch_record *reader = epoch_reader();
+
+    if(reader->nesting++)
+        return;
+
+#ifdef  HAVE_GCC_ATOMICS
+    reader->epoch = epoch_global;
+    __sync_synchronize();
 #else
-    crit(pthread_cond_init(&cond, Conditional::initializer()) == 0, "conditional init failed");
-    crit(pthread_mutex_init(&mutex, NULL) == 0, "mutex init failed");
+    pthread_mutex_lock(&reader->mutex);
+    reader->epoch = epoch_global;
+    pthread_mutex_unlock(&reader->mutex);
 #endif
 }
 
-TimedEvent::~TimedEvent()
+static void epoch_leave(void)
 {
-#ifndef __PTH__
-    pthread_cond_destroy(&cond);
-    pthread_mutex_destroy(&mutex);
-#endif
-}
+    epoch_record *reader = epoch_reader();
 
-void TimedEvent::reset(void)
-{
-    pthread_mutex_lock(&mutex);
-    signalled = false;
-    set();
-    pthread_mutex_unlock(&mutex);
-}
+    if(!reader->nesting || --reader->nesting)
+        return;
 
-void TimedEvent::signal(void)
-{
-    pthread_mutex_lock(&mutex);
-    signalled = true;
-    pthread_cond_signal(&cond);
-    pthread_mutex_unlock(&mutex);
+#ifdef  HAVE_GCC_ATOMICS
+    __sync_synchronize();
+    reader->epoch = 0;
+#else
+    pthread_mutex_lock(&reader->mutex);
+    reader->epoch = 0;
+    pthread_mutex_unlock(&reader->mutex);
+#endif
 }
 
-bool TimedEvent::sync(void)
+static bool epoch_passed(epoch_record *reader, unsigned long epoch)
 {
-    timeout_t timeout = get();
-    struct timespec ts;
-
-    if(signalled) {
-        signalled = false;
-        return true;
-    }
-
-    if(!timeout)
-        return false;
-
-    Conditional::set(&ts, timeout);
-
-    if(pthread_cond_timedwait(&cond, &mutex, &ts) == ETIMEDOUT)
-        return false;
+    unsigned long current;
 
-    signalled = false;
-    return true;
+#ifdef  HAVE_GCC_ATOMICS
+    current = reader->epoch;
+#else
+    pthread_mutex_lock(&reader->mutex);
+    current = reader->epoch;
+    pthread_mutex_unlock(&reader->mutex);
+#endif
+    return !current || current >= epoch;
 }
 
-void TimedEvent::wait(void)
+void EpochPointer::synchronize(void)
 {
-    pthread_mutex_lock(&mutex);
-    if(signalled)
-        signalled = false;
-    else
-        pthread_cond_wait(&cond, &mutex);
-    pthread_mutex_unlock(&mutex);
-}
+    unsigned long epoch;
+    unsigned chunks;
 
-bool TimedEvent::wait(timeout_t timeout)
-{
-    bool result = true;
+    pthread_mutex_lock(&epoch_lock);
+    epoch = ++epoch_global;
+    chunks = epoch_count;
+    pthread_mutex_unlock(&epoch_lock);
 
-    pthread_mutex_lock(&mutex);
-    operator+=(timeout);
-    result = sync();
-    pthread_mutex_unlock(&mutex);
-    return result;
-}
+#ifdef  HAVE_GCC_ATOMICS
+    __sync_synchronize();
 #endif
 
-void TimedEvent::lock(void)
-{
-    pthread_mutex_lock(&mutex);
+    for(unsigned chunk = 0; chunk < chunks; ++chunk) {
+        epoch_slot *list = epoch_chunks[chunk];
+        for(unsigned pos = 0; pos < EPOCH_CHUNK; ++pos) {
+            while(!epoch_passed(&list[pos].record, epoch))
+                Thread::yield();
+        }
+    }
 }
 
-void TimedEvent::release(void)
+EpochPointer::EpochPointer() : writer()
 {
-    pthread_mutex_unlock(&mutex);
+    pointer = NULL;
 }
 
-ConditionalLock::ConditionalLock() :
-ConditionalAccess()
+EpochPointer::~EpochPointer()
 {
-    contexts = NULL;
+    if(pointer)
+        delete pointer;
 }
 
-ConditionalLock::~ConditionalLock()
+void EpochPointer::replace(SharedObject *object)
 {
-    linked_pointer<Context> cp = contexts, next;
-    while(cp) {
-        next = cp->getNext();
-        delete *cp;
-        cp = next;
-    }
-}
+    SharedObject *prior;
 
-ConditionalLock::Context *ConditionalLock::getContext(void)
-{
-    Context *slot = NULL;
-    pthread_t tid = Thread::self();
-    linked_pointer<Context> cp = contexts;
+    writer.acquire();
+    prior = pointer;
+    lock_publish();
+    pointer = object;
+    if(prior)
+        synchronize();
+    writer.release();
 
-    while(cp) {
-        if(cp->count && Thread::equal(cp->thread, tid))
-            return *cp;
-        if(!cp->count)
-            slot = *cp;
-        cp.next();
-    }
-    if(!slot) {
-        slot = new Context(&this->contexts);
-        slot->count = 0;
-    }
-    slot->thread = tid;
-    return slot;
+    if(prior)
+        delete prior;
 }
 
-void ConditionalLock::_share(void)
+SharedObject *EpochPointer::share(void)
 {
-    access();
+    epoch_enter();
+    return pointer;
 }
 
-void ConditionalLock::_unlock(void)
+void EpochPointer::release(void)
 {
-    release();
+    epoch_leave();
 }
 
-void ConditionalLock::modify(void)
+epoch_release::epoch_release()
 {
-    Context *context;
-
-    lock();
-    context = getContext();
-
-    assert(context && sharing >= context->count);
-
-    sharing -= context->count;
-    while(sharing) {
-        ++pending;
-        waitSignal();
-        --pending;
-    }
-    ++context->count;
+    ptr = NULL;
+    object = NULL;
 }
 
-void ConditionalLock::commit(void)
+epoch_release::epoch_release(EpochPointer &p)
 {
-    Context *context = getContext();
-    --context->count;
+    ptr = &p;
+    object = p.share();
+}
 
-    if(context->count) {
-        sharing += context->count;
-        unlock();
-    }
-    else
-        ConditionalAccess::commit();
+epoch_release::~epoch_release()
+{
+    release();
 }
 
-void ConditionalLock::release(void)
+void epoch_release::release(void)
 {
-    Context *context;
+    if(ptr)
+        ptr->release();
+    ptr = NULL;
+    object = NULL;
+}
 
-    lock();
-    context = getContext();
-    assert(sharing && context && context->count > 0);
-    --sharing;
-    --context->count;
-    if(pending && !sharing)
-        signal();
-    else if(waiting && !pending)
-        broadcast();
-    unlock();
+epoch_release &epoch_release::operator=(EpochPointer &p)
+{
+    release();
+    ptr = &p;
+    object = p.share();
+    return *this;
 }
 
-void ConditionalLock::access(void)
+// Placement is kept apart from the thread object so threads that never
+// set affinity or a scheduling class pay only for a NULL pointer.
+
+class __LOCAL Thread::placement
 {
-    Context *context;
-    lock();
-    context = getContext();
-    assert(context && (!max_sharing || sharing < max_sharing));
+public:
+    cpumask cpus;
+    bool pinned, created;
+    int node, policy, level;
+    unsigned long runtime, deadline, period;
 
-    // reschedule if pending exclusives to make sure modify threads are not
-    // starved.
+    placement();
 
-    ++context->count;
+    bool pin(void);
+    bool schedule(void);
+#if defined(USE_AFFINITY) && defined(HAVE_PTHREAD_ATTR_SETAFFINITY_NP)
+    void attach(pthread_attr_t *attr);
+#endif
+};
 
-    while(context->count < 2 && pending) {
-        ++waiting;
-        waitBroadcast();
-        --waiting;
-    }
-    ++sharing;
-    unlock();
-}
+#ifdef  USE_DEADLINE
+struct thread_schedattr
+{
+    uint32_t size;
+    uint32_t policy;
+    uint64_t flags;
+    int32_t nice;
+    uint32_t priority;
+    uint64_t runtime;
+    uint64_t deadline;
+    uint64_t period;
+};
+#endif
 
-void ConditionalLock::exclusive(void)
+#ifdef  USE_AFFINITY
+static void cpu_native(const cpumask& mask, cpu_set_t *set)
 {
-    Context *context;
-
-    lock();
-    context = getContext();
-    assert(sharing && context && context->count > 0);
-    sharing -= context->count;
-    while(sharing) {
-        ++pending;
-        waitSignal();
-        --pending;
+    CPU_ZERO(set);
+    for(unsigned cpu = 0; cpu < cpumask::MAXCPUS && cpu < CPU_SETSIZE; ++cpu) {
+        if(mask.is_set(cpu))
+            CPU_SET(cpu, set);
     }
 }
+#endif
 
-void ConditionalLock::share(void)
+cpumask::cpumask()
 {
-    Context *context = getContext();
-    assert(!sharing && context && context->count);
-    sharing += context->count;
-    unlock();
+    zero();
 }
 
-barrier::barrier(unsigned limit) :
-Conditional()
+cpumask::cpumask(unsigned cpu)
 {
-    count = limit;
-    waits = 0;
+    zero();
+    set(cpu);
 }
 
-barrier::~barrier()
+void cpumask::zero(void)
 {
-    lock();
-    if(waits)
-        broadcast();
-    unlock();
+    memset(bits, 0, sizeof(bits));
 }
 
-void barrier::set(unsigned limit)
+void cpumask::set(unsigned cpu)
 {
-    assert(limit > 0);
-
-    lock();
-    count = limit;
-    if(count <= waits) {
-        waits = 0;
-        broadcast();
-    }
-    unlock();
+    if(cpu < MAXCPUS)
+        bits[cpu / (8 * sizeof(unsigned long))] |= (1ul << (cpu % (8 * sizeof(unsigned long))));
 }
 
-void barrier::dec(void)
+void cpumask::clear(unsigned cpu)
 {
-    lock();
-    if(count)
-        --count;
-    unlock();
+    if(cpu < MAXCPUS)
+        bits[cpu / (8 * sizeof(unsigned long))] &= ~(1ul << (cpu % (8 * sizeof(unsigned long))));
 }
 
-unsigned barrier::operator--(void)
+bool cpumask::is_set(unsigned cpu) const
 {
-    unsigned result;
-    lock();
-    if(count)
-        --count;
-    result = count;
-    unlock();
-    return result;
+    if(cpu >= MAXCPUS)
+        return false;
+
+    return (bits[cpu / (8 * sizeof(unsigned long))] & (1ul << (cpu % (8 * sizeof(unsigned long))))) != 0;
 }
 
-void barrier::inc(void)
+unsigned cpumask::count(void) const
 {
-    lock();
-    count++;
-    if(count <= waits) {
-        waits = 0;
-        broadcast();
+    unsigned total = 0;
+
+    for(unsigned cpu = 0; cpu < MAXCPUS; ++cpu) {
+        if(is_set(cpu))
+            ++total;
     }
-    unlock();
+    return total;
 }
 
-unsigned barrier::operator++(void)
+Thread::placement::placement()
 {
-    unsigned result;
-    lock();
-    count++;
-    if(count <= waits) {
-        waits = 0;
-        broadcast();
-    }
-    result = count;
-    unlock();
-    return result;
+    pinned = created = false;
+    node = policy = -1;
+    level = 0;
+    runtime = deadline = period = 0;
 }
 
-bool barrier::wait(timeout_t timeout)
+#if defined(USE_AFFINITY) && defined(HAVE_PTHREAD_ATTR_SETAFFINITY_NP)
+void Thread::placement::attach(pthread_attr_t *attr)
 {
-    bool result;
+    cpu_set_t set;
 
-    Conditional::lock();
-    if(!count) {
-        Conditional::unlock();
-        return true;
-    }
-    if(++waits >= count) {
-        waits = 0;
-        Conditional::broadcast();
-        Conditional::unlock();
-        return true;
-    }
-    result = Conditional::wait(timeout);
-    Conditional::unlock();
-    return result;
+    if(!pinned)
+        return;
+
+    cpu_native(cpus, &set);
+    if(!pthread_attr_setaffinity_np(attr, sizeof(set), &set))
+        created = true;
 }
+#endif
 
-void barrier::wait(void)
+bool Thread::placement::pin(void)
 {
-    Conditional::lock();
-    if(!count) {
-        Conditional::unlock();
-        return;
+#if defined(_MSTHREADS_)
+    DWORD_PTR mask = 0;
+    if(!pinned)
+        return true;
+
+    for(unsigned cpu = 0; cpu < sizeof(mask) * 8; ++cpu) {
+        if(cpus.is_set(cpu))
+            mask |= ((DWORD_PTR)1) << cpu;
     }
-    if(++waits >= count) {
-        waits = 0;
-        Conditional::broadcast();
-        Conditional::unlock();
-        return;
+    return mask && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#else
+    bool result = true;
+#ifdef  USE_AFFINITY
+    if(pinned && !created) {
+        cpu_set_t set;
+        cpu_native(cpus, &set);
+        if(pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+            result = false;
     }
-    Conditional::wait();
-    Conditional::unlock();
+#endif
+    created = false;
+    return result;
+#endif
 }
 
-LockedPointer::LockedPointer()
+bool Thread::placement::schedule(void)
 {
 #if defined(_MSTHREADS_)
-    InitializeCriticalSection((LPCRITICAL_SECTION)&mutex);
+    return false;
 #else
-#ifdef  __PTH__
-    static pthread_mutex_t lock = PTH_MUTEX_INIT;
+    if(policy < 0)
+        return false;
+
+#ifdef  USE_DEADLINE
+    if(policy == SCHED_DEADLINE) {
+        struct thread_schedattr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.policy = SCHED_DEADLINE;
+        attr.runtime = (uint64_t)runtime * 1000;
+        attr.deadline = (uint64_t)deadline * 1000;
+        attr.period = (uint64_t)period * 1000;
+        return syscall(SYS_sched_setattr, 0, &attr, 0) == 0;
+    }
+#endif
+
+#if _POSIX_PRIORITY_SCHEDULING > 0 && !defined(__PTH__)
+    struct sched_param sp;
+    memset(&sp, 0, sizeof(sp));
+    sp.sched_priority = level;
+    return pthread_setschedparam(pthread_self(), policy, &sp) == 0;
 #else
-    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    return false;
 #endif
-    memcpy(&mutex, &lock, sizeof(mutex));
 #endif
-    pointer = NULL;
 }
 
-void LockedPointer::replace(ObjectProtocol *obj)
+Thread::placement *Thread::placing(void)
 {
-    assert(obj != NULL);
+    if(!place)
+        place = new placement;
 
-    pthread_mutex_lock(&mutex);
-    obj->retain();
-    if(pointer)
-        pointer->release();
-    pointer = obj;
-    pthread_mutex_unlock(&mutex);
+    return place;
 }
 
-ObjectProtocol *LockedPointer::dup(void)
+bool Thread::affinity(const cpumask& mask)
 {
-    ObjectProtocol *temp;
-    pthread_mutex_lock(&mutex);
-    temp = pointer;
-    if(temp)
-        temp->retain();
-    pthread_mutex_unlock(&mutex);
-    return temp;
+#if defined(USE_AFFINITY) || defined(_MSTHREADS_)
+    if(!mask)
+        return false;
+
+    placing()->cpus = mask;
+    place->pinned = true;
+    if(thread_self() == this)
+        return place->pin();
+    return true;
+#else
+    return false;
+#endif
 }
 
-SharedObject::~SharedObject()
+bool Thread::numa(unsigned id)
 {
+    cpumask mask;
+
+    if(!topology(id, mask) || !affinity(mask))
+        return false;
+
+    place->node = (int)id;
+    return true;
 }
 
-SharedPointer::SharedPointer() :
-ConditionalAccess()
+int Thread::node(void) const
 {
-    pointer = NULL;
+    if(!place)
+        return -1;
+
+    return place->node;
 }
 
-SharedPointer::~SharedPointer()
+bool Thread::scheduler(int policy, int level)
 {
+#if _POSIX_PRIORITY_SCHEDULING > 0 && !defined(__PTH__) && !defined(_MSTHREADS_)
+    placing()->policy = policy;
+    place->level = level;
+    if(thread_self() == this)
+        return place->schedule();
+    return true;
+#else
+    return false;
+#endif
 }
 
-void SharedPointer::replace(SharedObject *ptr)
+bool Thread::deadline(unsigned long runtime, unsigned long deadline, unsigned long period)
 {
-    modify();
+#ifdef  USE_DEADLINE
+    if(!runtime || deadline < runtime)
+        return false;
 
-    if(pointer)
-        delete pointer;
-    pointer = ptr;
-    if(ptr)
-        ptr->commit(this);
+    placing()->policy = SCHED_DEADLINE;
+    place->runtime = runtime;
+    place->deadline = deadline;
+    place->period = period ? period : deadline;
+    if(thread_self() == this)
+        return place->schedule();
+    return true;
+#else
+    return false;
+#endif
+}
 
-    commit();
+unsigned Thread::processors(void)
+{
+    long cpus = 1;
+
+#if defined(_MSWINDOWS_)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    cpus = (long)info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+    if(cpus < 1)
+        return 1;
+
+    return (unsigned)cpus;
 }
 
-SharedObject *SharedPointer::share(void)
+unsigned Thread::nodes(void)
 {
-    access();
-    return pointer;
+    unsigned total = 0;
+    cpumask mask;
+
+    for(unsigned id = 0; id < 256; ++id) {
+        if(topology(id, mask))
+            ++total;
+    }
+
+    if(!total)
+        return 1;
+
+    return total;
+}
+
+bool Thread::topology(unsigned id, cpumask& mask)
+{
+    mask.zero();
+
+#ifdef  __linux__
+    char path[64];
+    unsigned first, last;
+    int ch;
+    FILE *fp;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", id);
+    fp = fopen(path, "r");
+    if(!fp) {
+        // kernels without numa support have one node of all processors
+        if(id)
+            return false;
+    }
+    else {
+        // list is of the form "0-3,8-11"
+        while(fscanf(fp, "%u", &first) == 1) {
+            last = first;
+            ch = fgetc(fp);
+            if(ch == '-') {
+                if(fscanf(fp, "%u", &last) != 1)
+                    break;
+                ch = fgetc(fp);
+            }
+            while(first <= last)
+                mask.set(first++);
+            if(ch != ',')
+                break;
+        }
+        fclose(fp);
+        return mask.count() > 0;
+    }
+#else
+    if(id)
+        return false;
+#endif
+
+    for(unsigned cpu = 0; cpu < processors(); ++cpu)
+        mask.set(cpu);
+    return true;
+}
+
+unsigned Thread::locate(unsigned cpu)
+{
+    cpumask mask;
+
+    for(unsigned id = 0; id < 256; ++id) {
+        if(topology(id, mask) && mask.is_set(cpu))
+            return id;
+    }
+    return 0;
+}
+
+int Thread::cpu(void)
+{
+#if defined(HAVE_SCHED_GETCPU) && !defined(__PTH__)
+    return sched_getcpu();
+#else
+    return -1;
+#endif
 }
 
 Thread::Thread(size_t size)
 {
     stack = size;
     priority = 0;
+    place = NULL;
 #ifdef  _MSTHREADS_
     cancellor = INVALID_HANDLE_VALUE;
 #else
@@ -1812,6 +3744,10 @@ Thread::Thread(size_t size)
 void Thread::setPriority(void)
 {
     HANDLE hThread = GetCurrentThread();
+
+    if(place)
+        place->pin();
+
     priority += THREAD_PRIORITY_NORMAL;
     if(priority < THREAD_PRIORITY_LOWEST)
         priority = THREAD_PRIORITY_LOWEST;
@@ -1830,6 +3766,14 @@ void Thread::setPriority(void)
     pthread_t ptid = pthread_self();
     int pri = 0;
 
+    if(place)
+        place->pin();
+
+    // an explicit scheduling class replaces relative priority, unless it
+    // could not be set...
+    if(place && place->schedule())
+        return;
+
     if(!priority)
         return;
 
@@ -1857,7 +3801,11 @@ void Thread::setPriority(void)
 }
 
 #else
-void Thread::setPriority(void) {}
+void Thread::setPriority(void)
+{
+    if(place)
+        place->pin();
+}
 #endif
 
 void Thread::concurrency(int level)
@@ -1943,6 +3891,8 @@ void DetachedThread::exit(void)
 
 Thread::~Thread()
 {
+    if(place)
+        delete place;
 }
 
 JoinableThread::~JoinableThread()
@@ -1960,6 +3910,7 @@ extern "C" {
         assert(obj != NULL);
 
         Thread *th = static_cast<Thread *>(obj);
+        thread_enter(th);
         th->setPriority();
         th->run();
         th->exit();
@@ -1971,6 +3922,7 @@ extern "C" {
         assert(obj != NULL);
 
         Thread *th = static_cast<Thread *>(obj);
+        thread_enter(th);
         th->setPriority();
         th->run();
         th->exit();
@@ -2070,6 +4022,10 @@ void JoinableThread::start(int adj)
 #else
     if(stack)
         pthread_attr_setstacksize(&attr, stack);
+#if defined(USE_AFFINITY) && defined(HAVE_PTHREAD_ATTR_SETAFFINITY_NP)
+    if(place)
+        place->attach(&attr);
+#endif
     result = pthread_create(&tid, &attr, &exec_thread, this);
     pthread_attr_destroy(&attr);
     if(!result)
@@ -2101,6 +4057,10 @@ void DetachedThread::start(int adj)
 #else
     if(stack)
         pthread_attr_setstacksize(&attr, stack);
+#if defined(USE_AFFINITY) && defined(HAVE_PTHREAD_ATTR_SETAFFINITY_NP)
+    if(place)
+        place->attach(&attr);
+#endif
     pthread_create(&tid, &attr, &exec_thread, this);
     pthread_attr_destroy(&attr);
 #endif
@@ -2252,15 +4212,26 @@ void Thread::init(void)
     static volatile bool initialized = false;
 
     if(!initialized) {
+        // slots and placement depend on these keys, there is no fallback
 #ifdef  __PTH__
         pth_init();
-        pth_key_create(&threadmap, NULL);
+        bool keyed = pth_key_create(&threadmap, NULL) &&
+            pth_key_create(&slotmap, &slot_release) &&
+            pth_key_create(&selfmap, NULL);
+        crit(keyed, "thread key create failed");
         atexit(pthread_shutdown);
 #else
 #ifdef  _MSTHREADS_
         threadmap = TlsAlloc();
+        slotmap = TlsAlloc();
+        selfmap = TlsAlloc();
+        crit(threadmap != TLS_OUT_OF_INDEXES && slotmap != TLS_OUT_OF_INDEXES &&
+            selfmap != TLS_OUT_OF_INDEXES, "thread key create failed");
 #else
-        pthread_key_create(&threadmap, NULL);
+        bool keyed = !pthread_key_create(&threadmap, NULL) &&
+            !pthread_key_create(&slotmap, &slot_release) &&
+            !pthread_key_create(&selfmap, NULL);
+        crit(keyed, "thread key create failed");
 #endif
 #endif
         initialized = true;
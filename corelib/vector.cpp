@@ -198,7 +198,7 @@ ObjectProtocol *Vector::get(int offset) const
     if(offset >= (int)(data->len))
         return invalid();
 
-    if(((vectorsize_t)(-offset)) >= data->len)
+    if(offset < 0 && ((vectorsize_t)(-offset)) > data->len)
         return invalid();
 
     if(offset >= 0)
@@ -227,7 +227,7 @@ Vector::array *Vector::create(vectorsize_t size) const
 {
     assert(size > 0);
 
-    return new((size_t)size) array(size);
+    return new((size_t)size * sizeof(ObjectProtocol *)) array(size);
 }
 
 void Vector::release(void)
@@ -471,6 +471,7 @@ ReusableAllocator()
     assert(c > 0 && size > 0 && memory != NULL);
 
     objsize = size;
+    unit = size;
     count = 0;
     limit = c;
     used = 0;
@@ -483,6 +484,7 @@ ReusableAllocator()
     assert(c > 0 && size > 0);
 
     objsize = size;
+    unit = size;
     count = 0;
     limit = c;
     used = 0;
@@ -530,6 +532,7 @@ ReusableObject *ArrayReuse::get(timeout_t timeout)
     }
 
     if(!rtn) {
+        ++stats.faults;
         unlock();
         return NULL;
     }
@@ -539,10 +542,13 @@ ReusableObject *ArrayReuse::get(timeout_t timeout)
         freelist = next(obj);
     } else if(used < limit) {
         obj = (ReusableObject *)&mem[used * objsize];
+        stats.reserve(objsize);
         ++used;
     }
-    if(obj)
+    if(obj) {
+        stats.alloc(objsize, objsize);
         ++count;
+    }
     unlock();
     return obj;
 }
@@ -563,10 +569,15 @@ ReusableObject *ArrayReuse::request(void)
     }
     else if(used < limit) {
         obj = (ReusableObject *)(mem + (used * objsize));
+        stats.reserve(objsize);
         ++used;
     }
-    if(obj)
+    if(obj) {
+        stats.alloc(objsize, objsize);
         ++count;
+    }
+    else
+        ++stats.faults;
     unlock();
     return obj;
 }
@@ -589,6 +600,7 @@ MemoryRedirect(p), ReusableAllocator()
     limit = c;
     count = 0;
     osize = objsize;
+    unit = objsize;
 }
 
 PagerReuse::~PagerReuse()
@@ -614,6 +626,7 @@ ReusableObject *PagerReuse::request(void)
     ReusableObject *obj = NULL;
     lock();
     if(!limit || count < limit) {
+        stats.alloc(osize, osize);
         if(freelist) {
             ++count;
             obj = freelist;
@@ -621,10 +634,13 @@ ReusableObject *PagerReuse::request(void)
         }
         else {
             ++count;
+            stats.reserve(osize);
             unlock();
             return (ReusableObject *)_alloc(osize);
         }
     }
+    else
+        ++stats.faults;
     unlock();
     return obj;
 }
@@ -655,15 +671,18 @@ ReusableObject *PagerReuse::get(timeout_t timeout)
         --waiting;
     }
     if(!rtn) {
+        ++stats.faults;
         unlock();
         return NULL;
     }
+    stats.alloc(osize, osize);
     if(freelist) {
         obj = freelist;
         freelist = next(obj);
     }
     else {
         ++count;
+        stats.reserve(osize);
         unlock();
         return (ReusableObject *)_alloc(osize);
     }
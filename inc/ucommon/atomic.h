@@ -29,14 +29,25 @@
 #include <ucommon/platform.h>
 #endif
 
+// compilers with ordered atomic builtins can inline typed atomics...
+#if defined(__ATOMIC_SEQ_CST) && !defined(_UCOMMON_ATOMIC_ORDERED_)
+#define _UCOMMON_ATOMIC_ORDERED_
+#endif
+
+#if defined(__GNUC__)
+#define __CACHELINE __attribute__ ((aligned (64)))
+#else
+#define __CACHELINE
+#endif
+
 namespace ucommon {
 
 /**
  * Generic atomic class for referencing atomic objects and static functions.
- * We have an atomic counter and spinlock, and in the future we may add
- * other atomic classes and atomic manipulations needed to create lockfree
- * data structures.  The atomic classes use mutexes if no suitable atomic
- * code is available.
+ * We have an atomic counter and spinlock, and typed atomic values, pointers,
+ * and flags whose operations take an explicit memory order, so statistics
+ * and flags can be kept without paying for full barriers.  The atomic
+ * classes use mutexes if no suitable atomic code is available.
  * @author David Sugar <dyfet@gnutelephony.org>
  */
 class __EXPORT atomic
@@ -47,6 +58,55 @@ public:
      */
     static const bool simulated;
 
+    /**
+     * Memory order of a typed atomic operation.  Relaxed operations are
+     * atomic but order nothing else, acquire and release order the memory
+     * accesses after a load or before a store, and sequential consistency
+     * is a full barrier.  The values match those of the compiler.
+     */
+    typedef enum {
+        RELAXED = 0,
+        CONSUME,
+        ACQUIRE,
+        RELEASE,
+        ACQ_REL,
+        SEQ_CST
+    } order_t;
+
+    /**
+     * Get the order a failed compare and swap may use, which is only a
+     * load and so cannot release.
+     * @param order of successful swap.
+     * @return order of failed swap.
+     */
+    inline static order_t failure(order_t order)
+        {return order == RELEASE ? RELAXED : (order == ACQ_REL ? ACQUIRE : order);}
+
+    /**
+     * Lock an object for simulated typed atomics.  This is used by the
+     * typed templates when the compiler has no ordered atomics.
+     * @param object to lock.
+     */
+    static void protect(const volatile void *object);
+
+    /**
+     * Unlock an object for simulated typed atomics.
+     * @param object to unlock.
+     */
+    static void release(const volatile void *object);
+
+#ifdef  _UCOMMON_ATOMIC_ORDERED_
+    /**
+     * Memory fence of the given order.
+     * @param order of fence.
+     */
+    inline static void fence(order_t order = SEQ_CST)
+        {__atomic_thread_fence(order);}
+#else
+    inline static void fence(order_t order = SEQ_CST)
+        {protect(&simulated); release(&simulated);}
+#endif
+
     /**
      * Atomic counter class.  Can be used to manipulate value of an
      * atomic counter without requiring explicit thread locking.
@@ -100,6 +160,236 @@ public:
          */
         void release(void);
     };
+
+    /**
+     * Typed atomic value.  This may be any integral type the processor
+     * can operate on atomically.  Every operation takes a memory order,
+     * and defaults to sequential consistency.  Operators are sequentially
+     * consistent.  Fetch operations return the value prior to the change.
+     * @author David Sugar <dyfet@gnutelephony.org>
+     */
+    template<typename T>
+    class value
+    {
+    protected:
+        volatile T object;
+
+    public:
+        /**
+         * Create atomic value.
+         * @param initial value.
+         */
+        inline value(T initial = 0)
+            {object = initial;}
+
+#ifdef  _UCOMMON_ATOMIC_ORDERED_
+        inline T get(order_t order = SEQ_CST) const
+            {return __atomic_load_n(&object, order);}
+
+        inline void set(T change, order_t order = SEQ_CST)
+            {__atomic_store_n(&object, change, order);}
+
+        inline T exchange(T change, order_t order = SEQ_CST)
+            {return __atomic_exchange_n(&object, change, order);}
+
+        /**
+         * Compare and swap value.
+         * @param expected value, updated to the current value if not equal.
+         * @param change to store if equal.
+         * @param order of successful swap.
+         * @return true if swapped.
+         */
+        inline bool cas(T& expected, T change, order_t order = SEQ_CST)
+            {return __atomic_compare_exchange_n(&object, &expected, change, false, order, failure(order));}
+
+        inline T fetch_add(T offset, order_t order = SEQ_CST)
+            {return __atomic_fetch_add(&object, offset, order);}
+
+        inline T fetch_sub(T offset, order_t order = SEQ_CST)
+            {return __atomic_fetch_sub(&object, offset, order);}
+
+        inline T fetch_and(T mask, order_t order = SEQ_CST)
+            {return __atomic_fetch_and(&object, mask, order);}
+
+        inline T fetch_or(T mask, order_t order = SEQ_CST)
+            {return __atomic_fetch_or(&object, mask, order);}
+
+        inline T fetch_xor(T mask, order_t order = SEQ_CST)
+            {return __atomic_fetch_xor(&object, mask, order);}
+#else
+        inline T get(order_t order = SEQ_CST) const
+            {protect(&object); T result = object; release(&object); return result;}
+
+        inline void set(T change, order_t order = SEQ_CST)
+            {protect(&object); object = change; release(&object);}
+
+        inline T exchange(T change, order_t order = SEQ_CST)
+            {protect(&object); T prior = object; object = change; release(&object); return prior;}
+
+        inline bool cas(T& expected, T change, order_t order = SEQ_CST)
+            {protect(&object); bool rtn = (object == expected); if(rtn) object = change; else expected = object; release(&object); return rtn;}
+
+        inline T fetch_add(T offset, order_t order = SEQ_CST)
+            {protect(&object); T prior = object; object = prior + offset; release(&object); return prior;}
+
+        inline T fetch_sub(T offset, order_t order = SEQ_CST)
+            {protect(&object); T prior = object; object = prior - offset; release(&object); return prior;}
+
+        inline T fetch_and(T mask, order_t order = SEQ_CST)
+            {protect(&object); T prior = object; object = prior & mask; release(&object); return prior;}
+
+        inline T fetch_or(T mask, order_t order = SEQ_CST)
+            {protect(&object); T prior = object; object = prior | mask; release(&object); return prior;}
+
+        inline T fetch_xor(T mask, order_t order = SEQ_CST)
+            {protect(&object); T prior = object; object = prior ^ mask; release(&object); return prior;}
+#endif
+
+        inline operator T() const
+            {return get();}
+
+        inline value<T>& operator=(T change)
+            {set(change); return *this;}
+
+        inline T operator++()
+            {return fetch_add(1) + 1;}
+
+        inline T operator--()
+            {return fetch_sub(1) - 1;}
+
+        inline T operator+=(T offset)
+            {return fetch_add(offset) + offset;}
+
+        inline T operator-=(T offset)
+            {return fetch_sub(offset) - offset;}
+    };
+
+    /**
+     * Typed atomic value on its own cache line.  This keeps counters that
+     * are updated often by different threads from sharing a line with
+     * each other or with read mostly data.
+     * @author David Sugar <dyfet@gnutelephony.org>
+     */
+    template<typename T>
+    class __CACHELINE aligned : public value<T>
+    {
+    private:
+        char pad[64 - (sizeof(value<T>) % 64)];
+
+    public:
+        inline aligned(T initial = 0) : value<T>(initial) {}
+
+        inline aligned<T>& operator=(T change)
+            {value<T>::set(change); return *this;}
+    };
+
+    /**
+     * Typed atomic pointer.  A pointer published with release order may
+     * be loaded with acquire order to see the object it was set up with.
+     * @author David Sugar <dyfet@gnutelephony.org>
+     */
+    template<typename T>
+    class pointer
+    {
+    protected:
+        T *volatile object;
+
+    public:
+        /**
+         * Create atomic pointer.
+         * @param initial pointer.
+         */
+        inline pointer(T *initial = NULL)
+            {object = initial;}
+
+#ifdef  _UCOMMON_ATOMIC_ORDERED_
+        inline T *get(order_t order = SEQ_CST) const
+            {return __atomic_load_n(&object, order);}
+
+        inline void set(T *change, order_t order = SEQ_CST)
+            {__atomic_store_n(&object, change, order);}
+
+        inline T *exchange(T *change, order_t order = SEQ_CST)
+            {return __atomic_exchange_n(&object, change, order);}
+
+        /**
+         * Compare and swap pointer.
+         * @param expected pointer, updated to the current one if not equal.
+         * @param change to store if equal.
+         * @param order of successful swap.
+         * @return true if swapped.
+         */
+        inline bool cas(T *& expected, T *change, order_t order = SEQ_CST)
+            {return __atomic_compare_exchange_n(&object, &expected, change, false, order, failure(order));}
+#else
+        inline T *get(order_t order = SEQ_CST) const
+            {protect(&object); T *result = object; release(&object); return result;}
+
+        inline void set(T *change, order_t order = SEQ_CST)
+            {protect(&object); object = change; release(&object);}
+
+        inline T *exchange(T *change, order_t order = SEQ_CST)
+            {protect(&object); T *prior = object; object = change; release(&object); return prior;}
+
+        inline bool cas(T *& expected, T *change, order_t order = SEQ_CST)
+            {protect(&object); bool rtn = (object == expected); if(rtn) object = change; else expected = object; release(&object); return rtn;}
+#endif
+
+        inline operator T*() const
+            {return get();}
+
+        inline T* operator->() const
+            {return get();}
+
+        inline T& operator*() const
+            {return *get();}
+
+        inline pointer<T>& operator=(T *change)
+            {set(change); return *this;}
+    };
+
+    /**
+     * Atomic flag.  Setting the flag acquires and clearing it releases by
+     * default, so it may also serve as a minimal spinlock.
+     * @author David Sugar <dyfet@gnutelephony.org>
+     */
+    class __EXPORT flag
+    {
+    private:
+        value<unsigned> state;
+
+    public:
+        inline flag() : state(0) {}
+
+        /**
+         * Set flag.
+         * @param order of set.
+         * @return true if flag was already set.
+         */
+        inline bool set(order_t order = ACQUIRE)
+            {return state.exchange(1, order) != 0;}
+
+        /**
+         * Clear flag.
+         * @param order of clear.
+         */
+        inline void clear(order_t order = RELEASE)
+            {state.set(0, order);}
+
+        /**
+         * Test flag.
+         * @param order of test.
+         * @return true if set.
+         */
+        inline bool is_set(order_t order = SEQ_CST) const
+            {return state.get(order) != 0;}
+
+        inline operator bool() const
+            {return is_set();}
+
+        inline bool operator!() const
+            {return !is_set();}
+    };
 };
 
 } // namespace ucommon
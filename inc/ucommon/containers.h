@@ -49,6 +49,10 @@
 #include <ucommon/thread.h>
 #endif
 
+#ifndef _UCOMMON_ATOMIC_H_
+#include <ucommon/atomic.h>
+#endif
+
 namespace ucommon {
 
 /**
@@ -202,6 +206,134 @@ public:
     bool operator!();
 };
 
+/**
+ * A bounded ring for streaming copies of class data between threads.
+ * Like the buffer, it holds physical copies of objects that are all the
+ * same size, but each slot carries a sequence number so producers and
+ * consumers claim slots with a single compare and swap rather than
+ * taking a lock.  A ring may be created for a single producer, a single
+ * consumer, or both, which then claim slots with a plain store.  Threads
+ * only block when the ring is full or empty, and are woken through a
+ * conditional only when some thread is actually waiting.  Without
+ * compiler atomics each claim falls back to a short internal lock.  The
+ * capacity is rounded up to a power of two.  This is normally used
+ * through the ringbufferof template.
+ * @author David Sugar <dyfet@gnutelephony.org>
+ */
+class __EXPORT RingBuffer : protected Conditional
+{
+public:
+    /**
+     * Set if only one thread ever puts into or gets from the ring.
+     */
+    enum {
+        MULTIPLE = 0,
+        SINGLE_PRODUCER = 0x01,
+        SINGLE_CONSUMER = 0x02,
+        SINGLE = 0x03
+    };
+
+private:
+    size_t objsize, cellsize, mask;
+    unsigned mode;
+    caddr_t cells;
+    atomic::value<unsigned> waiting;
+    atomic::aligned<size_t> head, tail;
+
+    __LOCAL bool enqueue(const void *data);
+    __LOCAL bool dequeue(void *data);
+    __LOCAL void notify(void);
+
+protected:
+    /**
+     * Create a ring.
+     * @param typesize of objects in the ring.
+     * @param count of objects the ring holds.
+     * @param mode of producers and consumers.
+     */
+    RingBuffer(size_t typesize, size_t count, unsigned mode = MULTIPLE);
+
+    /**
+     * Destroy ring.
+     */
+    virtual ~RingBuffer();
+
+    /**
+     * Put (copy) an object into the ring, waiting while full.
+     * @param data to copy in.
+     */
+    void put(const void *data);
+
+    /**
+     * Put (copy) an object into the ring.
+     * @param data to copy in.
+     * @param timeout to wait while full, 0 to not wait.
+     * @return true if put, false if full.
+     */
+    bool put(const void *data, timeout_t timeout);
+
+    /**
+     * Copy the next object from the ring, waiting while empty.
+     * @param data to copy out to.
+     */
+    void copy(void *data);
+
+    /**
+     * Copy the next object from the ring.
+     * @param data to copy out to.
+     * @param timeout to wait while empty, 0 to not wait.
+     * @return true if copied, false if empty.
+     */
+    bool copy(void *data, timeout_t timeout);
+
+    /**
+     * Put as many objects from a list as the ring has room for, without
+     * waiting.  Waiting consumers are woken once for the batch.
+     * @param list of objects to copy in.
+     * @param count of objects in list.
+     * @return number of objects put.
+     */
+    unsigned push(const void *list, unsigned count);
+
+    /**
+     * Copy as many objects as are available into a list, without waiting.
+     * Waiting producers are woken once for the batch.
+     * @param list to copy objects out to.
+     * @param count of objects list may hold.
+     * @return number of objects copied.
+     */
+    unsigned pull(void *list, unsigned count);
+
+public:
+    /**
+     * Get the capacity of the ring.
+     * @return number of objects the ring holds.
+     */
+    inline unsigned size(void) const
+        {return (unsigned)(mask + 1);}
+
+    /**
+     * Get the number of objects in the ring.  This is only a snapshot
+     * while other threads are active.
+     * @return number of objects in ring.
+     */
+    unsigned count(void) const;
+
+    /**
+     * Test if ring has objects.
+     * @return true if not empty.
+     */
+    inline operator bool() const
+        {return count() > 0;}
+
+    /**
+     * Test if ring is empty.
+     * @return true if empty.
+     */
+    inline bool operator!() const
+        {return count() == 0;}
+};
+
 /**
  * Manage a thread-safe queue of objects through reference pointers.  This
  * can be particularly interesting when used to enqueue/dequeue reference
@@ -513,6 +645,82 @@ public:
         {return static_cast<T*>(Buffer::peek(offset));}
 };
 
+/**
+ * A templated typed class for ring buffering of objects.  Slots are
+ * claimed without locks, and threads block only when the ring is full or
+ * empty.  This is an alternative to bufferof for pipelines where lock
+ * handoff dominates, and may be used with any number of producer and
+ * consumer threads, or be created for a single producer and/or consumer.
+ * Objects are always copied in and out, since a slot is reused as soon
+ * as it is taken, so the pointer based get and release of bufferof are
+ * not offered.
+ * @author David Sugar <dyfet@gnutelephony.org>
+ */
+template<class T>
+class ringbufferof : public RingBuffer
+{
+public:
+    /**
+     * Create a ring to hold a series of typed objects.
+     * @param capacity of typed objects in the ring.
+     * @param mode of producers and consumers.
+     */
+    inline ringbufferof(unsigned capacity, unsigned mode = RingBuffer::MULTIPLE) :
+        RingBuffer(sizeof(T), capacity, mode) {}
+
+    /**
+     * Put (copy) a typed object into the ring.  This blocks while the ring
+     * is full.
+     * @param object to copy into the ring.
+     */
+    inline void put(const T *object)
+        {RingBuffer::put(object);}
+
+    /**
+     * Put (copy) a typed object into the ring.
+     * @param object to copy into the ring.
+     * @param timeout to wait if ring is full.
+     * @return true if copied, false if timed out while full.
+     */
+    inline bool put(const T *object, timeout_t timeout)
+        {return RingBuffer::put(object, timeout);}
+
+    /**
+     * Copy the next typed object from the ring.  This blocks until an
+     * object becomes available.
+     * @param object pointer to copy typed object into.
+     */
+    inline void copy(T *object)
+        {RingBuffer::copy(object);}
+
+    /**
+     * Copy the next typed object from the ring.
+     * @param object pointer to copy typed object into.
+     * @param timeout to wait when ring is empty in milliseconds.
+     * @return true if object copied, or false if timed out.
+     */
+    inline bool get(T *object, timeout_t timeout = Timer::inf)
+        {return RingBuffer::copy(object, timeout);}
+
+    /**
+     * Put a batch of typed objects into the ring without waiting.
+     * @param list of objects to copy into the ring.
+     * @param count of objects in list.
+     * @return number of objects put.
+     */
+    inline unsigned push(const T *list, unsigned count)
+        {return RingBuffer::push(list, count);}
+
+    /**
+     * Copy a batch of typed objects from the ring without waiting.
+     * @param list to copy objects into.
+     * @param count of objects list may hold.
+     * @return number of objects copied.
+     */
+    inline unsigned pull(T *list, unsigned count)
+        {return RingBuffer::pull(list, count);}
+};
+
 /**
  * A templated typed class for thread-safe stack of object pointers.  This
  * allows one to use the stack class in a typesafe manner for a specific
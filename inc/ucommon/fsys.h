@@ -328,6 +328,25 @@ public:
      */
     ssize_t write(const void *buffer, size_t count);
 
+#ifndef _MSWINDOWS_
+    /**
+     * Write a vector of memory segments to descriptor.
+     * @param vector of segments to write.
+     * @param count of segments in vector.
+     * @return bytes transferred, -1 if error.
+     */
+    ssize_t writev(const struct iovec *vector, unsigned count);
+
+    /**
+     * Write the text of a buffered pager to descriptor.  The pager pages
+     * are written directly with vectored i/o rather than copied into one
+     * buffer first.
+     * @param buffer to write.
+     * @return bytes transferred, -1 if error.
+     */
+    ssize_t writev(const bufpager& buffer);
+#endif
+
     /**
      * Get status of open descriptor.
      * @param buffer to save status info in.
@@ -40,6 +40,10 @@
 #include <ucommon/object.h>
 #endif
 
+#ifndef _UCOMMON_ATOMIC_H_
+#include <ucommon/atomic.h>
+#endif
+
 namespace ucommon {
 
 class OrderedObject;
@@ -58,6 +62,8 @@ protected:
     friend class LinkedRing;
     friend class NamedObject;
     friend class ObjectStack;
+    friend class AtomicFifo;
+    friend class PushStack;
 
     LinkedObject *Next;
 
@@ -573,6 +579,105 @@ public:
      */
     inline bool operator!=(const char *name) const
         {return compare(name) != 0;}
+
+    friend class NamedTable;
+};
+
+/**
+ * A growable hash table of named objects.  This is an alternative to the
+ * fixed size hash map of object chains used with NamedObject::map(), for
+ * when the number of names is large or not known in advance.  Objects are
+ * held in a linear probed table that stores the hash of each name, so most
+ * probes do not touch the object itself.  The table doubles when it is 3/4
+ * full, and entries are moved from the old table a few at a time on each
+ * later insert rather than all at once.  Hashing folds case so objects
+ * with case insensitive compare() methods may still be used.
+ */
+class __EXPORT NamedTable
+{
+private:
+    typedef struct {
+        unsigned hash;
+        NamedObject *node;
+    } slot_t;
+
+    slot_t *table, *prior;
+    unsigned size, used, members;
+    unsigned priorsize, moved;
+
+    __LOCAL slot_t *find(slot_t *list, unsigned max, const char *name, unsigned key) const;
+    __LOCAL void place(NamedObject *node, unsigned key);
+    __LOCAL void migrate(unsigned count);
+    __LOCAL void grow(void);
+
+public:
+    /**
+     * Create an empty table.  No memory is allocated until the first
+     * object is added.
+     * @param size of initial table, rounded up to a power of 2.
+     */
+    NamedTable(unsigned size = 16);
+
+    /**
+     * Destroy table.  Objects in the table are not released.
+     */
+    ~NamedTable();
+
+    /**
+     * Add a named object to the table.  If an object of the same name is
+     * already in the table it is replaced.
+     * @param object to add.
+     * @param name of the object.
+     * @return object that was replaced or NULL if name is new.
+     */
+    NamedObject *add(NamedObject *object, char *name);
+
+    /**
+     * Find a named object in the table.
+     * @param name of object to find.
+     * @return object pointer or NULL if not found.
+     */
+    NamedObject *map(const char *name) const;
+
+    /**
+     * Remove a named object from the table.
+     * @param name of object to remove.
+     * @return object that is removed or NULL if not found.
+     */
+    NamedObject *remove(const char *name);
+
+    /**
+     * Iterate through the table.  The order is arbitrary, and changes when
+     * objects are added or removed.
+     * @param current named object we iterated or NULL to find first.
+     * @return next named object or NULL if no more objects.
+     */
+    NamedObject *skip(NamedObject *current) const;
+
+    /**
+     * Convert the table into a linear object pointer array.  The array
+     * is created from the heap and must be deleted when no longer used.
+     * @return array of named object pointers.
+     */
+    NamedObject **index(void) const;
+
+    /**
+     * Remove all objects from the table and free the table memory.
+     * Objects in the table are not released.
+     */
+    void clear(void);
+
+    /**
+     * Release all objects in the table and clear it.
+     */
+    void purge(void);
+
+    /**
+     * Get number of objects in the table.
+     * @return count of objects.
+     */
+    inline unsigned count(void) const
+        {return members;}
 };
 
 /**
@@ -962,6 +1067,129 @@ public:
 };
 
 
+/**
+ * A lock free intrusive fifo of linked objects for passing events from
+ * many producer threads to one consumer thread.  Objects are linked
+ * directly through their list pointer, so nothing is allocated.  A push
+ * is one atomic exchange and never waits.  Only one thread may pull.  The
+ * consumer takes ownership of each object it pulls and may free it at
+ * once, since producers never touch an object after it is linked behind
+ * them, so no hazard pointers or epochs are needed.  A pull may briefly
+ * find the fifo empty while a push is still completing.  An object may
+ * only be in one list at a time.
+ * @author David Sugar <dyfet@gnutelephony.org>
+ */
+class __EXPORT AtomicFifo
+{
+private:
+    atomic::aligned<LinkedObject *> head;
+    LinkedObject *tail, *stub;
+
+    __LOCAL static atomic::pointer<LinkedObject> *link(LinkedObject *object);
+
+public:
+    /**
+     * Create an empty fifo.
+     */
+    AtomicFifo();
+
+    /**
+     * Destroy fifo.  Objects still in the fifo are not released.
+     */
+    ~AtomicFifo();
+
+    /**
+     * Push an object into the fifo.  This may be called from any thread.
+     * @param object to push.
+     */
+    void push(LinkedObject *object);
+
+    /**
+     * Pull the oldest object from the fifo.  This is called from the
+     * consumer thread.
+     * @return object pulled or NULL if empty.
+     */
+    LinkedObject *pull(void);
+
+    /**
+     * Pull a batch of objects from the fifo as a list linked in the order
+     * pushed, such as to deliver all pending events at once.  This is
+     * called from the consumer thread.
+     * @param limit of objects to pull, 0 for all that are ready.
+     * @return list of objects pulled or NULL if empty.
+     */
+    LinkedObject *drain(unsigned limit = 0);
+
+    /**
+     * Test if fifo is empty.  This is only a snapshot.
+     * @return true if empty.
+     */
+    bool is_empty(void) const;
+};
+
+/**
+ * An intrusive stack of linked objects with lock free pushes and locked
+ * pulls.  Objects are linked directly through their list pointer, so
+ * nothing is allocated.  Any number of threads may push without ever
+ * waiting or blocking a puller.  Pulls are not lock free: they are
+ * serialized among themselves by a spin then yield flag, so a puller may
+ * wait on another.  This means the top object can never be removed and
+ * reused or freed while another thread reads its link, which avoids both
+ * ABA and unsafe reclamation without hazard pointers or epochs, and so
+ * pulled objects may be reused or freed at once.  This suits free lists
+ * that many threads refill and few drain.  An object may only be in one
+ * list at a time.
+ * @author David Sugar <dyfet@gnutelephony.org>
+ */
+class __EXPORT PushStack
+{
+private:
+    atomic::pointer<LinkedObject> root;
+    atomic::flag pulling;
+
+    __LOCAL void lock(void);
+
+public:
+    /**
+     * Create an empty stack.
+     */
+    PushStack();
+
+    /**
+     * Push an object onto the stack.  This may be called from any thread.
+     * @param object to push.
+     */
+    void push(LinkedObject *object);
+
+    /**
+     * Pull the most recent object from the stack.  This may wait for
+     * another thread that is pulling.
+     * @return object pulled or NULL if empty.
+     */
+    LinkedObject *pull(void);
+
+    /**
+     * Pull every object from the stack as a list linked from the most
+     * recently pushed.
+     * @return list of objects or NULL if empty.
+     */
+    LinkedObject *drain(void);
+
+    /**
+     * Pop an object from the stack.
+     * @return object popped from stack or NULL if empty.
+     */
+    inline LinkedObject *pop(void)
+        {return PushStack::pull();}
+
+    /**
+     * Test if stack is empty.  This is only a snapshot.
+     * @return true if empty.
+     */
+    inline bool is_empty(void) const
+        {return root.get(atomic::RELAXED) == NULL;}
+};
+
 /**
  * A multipath linked list where membership is managed in multiple
  * lists.
@@ -1235,6 +1463,100 @@ public:
         {return (T *)OrderedIndex::get();}
 };
 
+/**
+ * Template for typesafe lock free fifo of objects passed to a consumer
+ * thread.  The object type, T, must be derived from LinkedObject.
+ * @author David Sugar <dyfet@gnutelephony.org>
+ */
+template <class T>
+class atomicfifo : public AtomicFifo
+{
+public:
+    /**
+     * Create a new lock free fifo.
+     */
+    inline atomicfifo() : AtomicFifo() {}
+
+    /**
+     * Push an object into the fifo from any thread.
+     * @param object of specified type to push.
+     */
+    inline void push(T *object)
+        {AtomicFifo::push(object);}
+
+    /**
+     * Add an object into the fifo from any thread.
+     * @param object of specified type to push.
+     */
+    inline void add(T *object)
+        {AtomicFifo::push(object);}
+
+    /**
+     * Pull the oldest object from the fifo.
+     * @return object of specified type or NULL if empty.
+     */
+    inline T *pull(void)
+        {return (T *)AtomicFifo::pull();}
+
+    /**
+     * Pull a batch of objects linked in the order pushed.
+     * @param limit of objects to pull, 0 for all.
+     * @return first object of specified type or NULL if empty.
+     */
+    inline T *drain(unsigned limit = 0)
+        {return (T *)AtomicFifo::drain(limit);}
+};
+
+/**
+ * Template for typesafe stack with lock free pushes and locked pulls.  The
+ * object type, T, must be derived from LinkedObject.
+ * @author David Sugar <dyfet@gnutelephony.org>
+ */
+template <class T>
+class pushstack : public PushStack
+{
+public:
+    /**
+     * Create a new stack.
+     */
+    inline pushstack() : PushStack() {}
+
+    /**
+     * Push an object onto the stack from any thread.
+     * @param object of specified type to push.
+     */
+    inline void push(T *object)
+        {PushStack::push(object);}
+
+    /**
+     * Add an object onto the stack from any thread.
+     * @param object of specified type to push.
+     */
+    inline void add(T *object)
+        {PushStack::push(object);}
+
+    /**
+     * Pull an object from the stack.
+     * @return object of specified type or NULL if empty.
+     */
+    inline T *pull(void)
+        {return (T *)PushStack::pull();}
+
+    /**
+     * Pull (pop) an object from the stack.
+     * @return object of specified type or NULL if empty.
+     */
+    inline T *pop(void)
+        {return (T *)PushStack::pull();}
+
+    /**
+     * Pull all objects from the stack.
+     * @return first object of specified type or NULL if empty.
+     */
+    inline T *drain(void)
+        {return (T *)PushStack::drain();}
+};
+
 /**
  * Template for typesafe basic object queue container.  The object type, T,
  * that is contained in the fifo must be derived from DLinkedObject.
@@ -1863,7 +2185,7 @@ public:
      * @return pointer to index root.
      */
     inline NamedObject **root(void)
-        {return static_cast<NamedObject**>(&head);}
+        {return reinterpret_cast<NamedObject**>(&head);}
 
     /**
      * Return first item in ordered list.  This is commonly used to
@@ -1964,6 +2286,16 @@ typedef OrderedIndex objfifo_t;
  */
 typedef ObjectQueue objqueue_t;
 
+/**
+ * Convenience type for lock free fifos.
+ */
+typedef AtomicFifo atomicfifo_t;
+
+/**
+ * Convenience type for lock free stacks.
+ */
+typedef PushStack pushstack_t;
+
 } // namespace ucommon
 
 #endif
@@ -265,6 +265,20 @@ public:
      * @param object being returned.
      */
     void removeLocked(ReusableObject *object);
+
+    /**
+     * Get a snapshot of allocation statistics for the mapped pool.
+     * @return copy of current statistics.
+     */
+    inline memstats statistics(void)
+        {return ReusableAllocator::statistics();}
+
+    /**
+     * Enable or disable the histogram of request sizes.
+     * @param enable histogram if true.
+     */
+    inline void histogram(bool enable)
+        {ReusableAllocator::histogram(enable);}
 };
 
 /**
@@ -376,14 +390,14 @@ public:
      * @return true if objects are available.
      */
     inline operator bool() const
-        {return MappedReuse::avail();}
+        {return const_cast<mapped_reuse*>(this)->MappedReuse::avail();}
 
     /**
      * Check whether there are typed objects available to be allocated.
      * @return true if no more typed objects are available.
      */
     inline bool operator!() const
-        {return !MappedReuse::avail();}
+        {return !const_cast<mapped_reuse*>(this)->MappedReuse::avail();}
 
     /**
      * Request a typed reusable object from the free list or mapped space.
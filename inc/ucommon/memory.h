@@ -46,10 +46,87 @@
 #include <ucommon/string.h>
 #endif
 
+#ifndef _MSWINDOWS_
+#include <sys/uio.h>
+#endif
+
 namespace ucommon {
 
 class PagerPool;
 
+/**
+ * Allocation statistics for pagers and pools.  These are kept incrementally
+ * as memory is allocated, so reading them does not require walking pages
+ * or object lists.  For object pools the byte counts are in units of the
+ * pool object size and pages counts the objects carved from backing memory.
+ * An optional histogram of request sizes by power of two can be kept.
+ * @author David Sugar <dyfet@gnutelephony.org>
+ */
+class __EXPORT memstats
+{
+public:
+    enum {SIZES = 16};
+
+    unsigned long allocs;       /**< Allocation requests served. */
+    unsigned long faults;       /**< Allocation requests that failed. */
+    unsigned long requested;    /**< Total bytes requested. */
+    unsigned long used;         /**< Bytes of reserved memory in use. */
+    unsigned long peak;         /**< High water mark of bytes in use. */
+    unsigned long reserved;     /**< Bytes reserved from the heap. */
+    unsigned pages;             /**< Pages or objects reserved. */
+    bool histogram;             /**< Keep histogram of request sizes. */
+    unsigned long sizes[SIZES]; /**< Requests by power of two size. */
+
+    memstats();
+
+    /**
+     * Clear all statistics.
+     */
+    void clear(void);
+
+    /**
+     * Record an allocation.
+     * @param request size asked for.
+     * @param size actually consumed.
+     */
+    void alloc(size_t request, size_t size);
+
+    /**
+     * Record memory returned for re-use.
+     * @param size released.
+     */
+    inline void release(size_t size)
+        {used -= size;}
+
+    /**
+     * Record a page or object reserved from the heap.
+     * @param size reserved.
+     */
+    inline void reserve(size_t size)
+        {reserved += size; ++pages;}
+
+    /**
+     * Percent of reserved memory that is in use.
+     * @return utilization, 0-100.
+     */
+    unsigned utilization(void) const;
+
+    /**
+     * Percent of reserved memory that is not in use.
+     * @return fragmentation, 0-100.
+     */
+    unsigned fragmentation(void) const;
+
+    /**
+     * Combine statistics of another allocator, such as for sub-arenas.
+     * The combined peak is the larger of either peak or the combined use,
+     * since the allocators may have peaked at different times.
+     * @param stats to add.
+     * @return reference to combined statistics.
+     */
+    memstats& operator+=(const memstats& stats);
+};
+
 /**
  * A memory protocol pager for private heap manager.  This is used to allocate
  * in an optimized manner, as it assumes no mutex locks are held or used as
@@ -67,13 +144,32 @@ private:
 
     typedef struct mempage {
         struct mempage *next;
+        struct mempage *avail;
         union {
             void *memalign;
             unsigned used;
         };
     }   page_t;
 
-    page_t *page;
+    typedef struct memregion {
+        struct memregion *next;
+        caddr_t base;
+        size_t size, used;
+    }   region_t;
+
+    page_t *page, *tail, *active, *spare;
+    page_t *avail[32];
+    region_t *regions;
+    unsigned mapping;
+
+protected:
+    memstats stats;
+
+private:
+    __LOCAL void retire(page_t *p);
+    __LOCAL page_t *fit(size_t size);
+    __LOCAL region_t *region(size_t size);
+    __LOCAL page_t *carve(void);
 
 protected:
     unsigned limit;
@@ -90,6 +186,26 @@ protected:
     virtual void fault(void) const;
 
 public:
+    /**
+     * Page backing options for backing().
+     */
+    enum {
+        HUGEPAGES = 0x01,
+        PREFAULT = 0x02,
+        LOCKED = 0x04
+    };
+
+    /**
+     * Checkpoint of the allocation state of a pager.  This is created by
+     * mark() and used to rewind the pager back to that state.
+     */
+    typedef struct {
+        struct mempage *page, *active;
+        struct mempage *avail[32];
+        unsigned used;
+        unsigned long inuse;
+    } mark_t;
+
     /**
      * Construct a memory pager.
      * @param page size to use or 0 for OS allocation size.
@@ -125,6 +241,23 @@ public:
     inline unsigned size(void) const
         {return pagesize;}
 
+    /**
+     * Select how pager pages are backed.  With HUGEPAGES, pages are carved
+     * from 2mb huge page regions rather than allocated from the heap one at
+     * a time.  Explicit huge pages are tried first and transparent huge
+     * pages are requested otherwise.  PREFAULT touches region memory when
+     * it is mapped so first use does not take page faults, and LOCKED locks
+     * region memory into ram, failing the region if it cannot be locked.  A
+     * region large enough for the reserve size is mapped immediately, so
+     * large pagers can be warmed up at startup.  This must be set before
+     * any pages are allocated.
+     * @param options for page backing.
+     * @param reserve size of memory to map in advance, 0 if none.
+     * @return false if pages already allocated or memory cannot be mapped
+     * or locked.
+     */
+    bool backing(unsigned options, size_t reserve = 0);
+
     /**
      * Determine fragmentation level of acquired heap pages.  This is
      * represented as an average % utilization (0-100) and represents the
@@ -135,17 +268,57 @@ public:
      * may suggest a larger page size should be used.
      * @return pager utilization.
      */
-    unsigned utilization(void) const;
+    inline unsigned utilization(void) const
+        {return stats.utilization();}
+
+    /**
+     * Get allocation statistics of the pager.
+     * @return copy of pager statistics.
+     */
+    inline memstats statistics(void) const
+        {return stats;}
+
+    /**
+     * Enable or disable the request size histogram.
+     * @param enable histogram.
+     */
+    inline void histogram(bool enable)
+        {stats.histogram = enable;}
 
     /**
      * Purge all allocated memory and heap pages immediately.
      */
     void purge(void);
 
+    /**
+     * Mark the current allocation state of the pager.  This is used
+     * to later rewind the pager to this point.  Free space at the end of
+     * pages filled before the mark is set aside until the rewind, so all
+     * allocations made after the mark can be released.  If a mark is never
+     * rewound, that space stays unused until the pager is purged.
+     * @return checkpoint of pager state.
+     */
+    mark_t mark(void);
+
+    /**
+     * Rewind the pager to a previously marked checkpoint.  All memory
+     * allocated since the mark is released at once.  Pages acquired since
+     * the mark are kept by the pager and re-used for new allocations
+     * rather than being returned to the heap.  This can be used to give
+     * a pager per-request arena semantics.  A checkpoint is no longer
+     * valid after the pager is purged or rewound to an earlier mark.
+     * @param point to rewind to.
+     */
+    void rewind(const mark_t& point);
+
     /**
      * Allocate memory from the pager heap.  The size of the request must be
      * less than the size of the memory page used.  This implements the
-     * memory protocol allocation method.
+     * memory protocol allocation method.  Requests are bump allocated from
+     * the current page.  When the current page is exhausted, the space left
+     * at the end of older pages is found through free lists segregated by
+     * power of two size classes, so allocation time does not depend on the
+     * number of pages the pager has grown to.
      * @param size of memory request.
      * @return allocated memory or NULL if not possible.
      */
@@ -215,11 +388,30 @@ public:
      */
     unsigned utilization(void);
 
+    /**
+     * Get allocation statistics of the pager.
+     * @return copy of pager statistics.
+     */
+    memstats statistics(void);
+
     /**
      * Purge all allocated memory and heap pages immediately.
      */
     void purge(void);
 
+    /**
+     * Mark the current allocation state of the pager.
+     * @return checkpoint of pager state.
+     */
+    mark_t mark(void);
+
+    /**
+     * Rewind the pager to a previously marked checkpoint.  Pages acquired
+     * since the mark are kept for re-use.
+     * @param point to rewind to.
+     */
+    void rewind(const mark_t& point);
+
     /**
      * Return memory back to pager heap.  This actually does nothing, but
      * might be used in a derived class to create a memory heap that can
@@ -240,6 +432,111 @@ public:
     virtual void *_alloc(size_t size);
 };
 
+/**
+ * A sharded memory pager for threaded applications.  Each thread that
+ * allocates from a shard pager is given it's own private mempager sub-arena
+ * on first use, so concurrent threads no longer contend for a single pager
+ * mutex.  All sub-arenas are owned by the shard pager itself and remain
+ * valid after the thread that created them has exited.  The sub-arena of
+ * a thread that exits is kept and re-used by the next new thread.  The
+ * shard pager can purge all sub-arenas at once and report combined usage.
+ * @author David Sugar <dyfet@gnutelephony.org>
+ */
+class __EXPORT shardpager : public MemoryProtocol
+{
+public:
+    class __LOCAL shard;
+
+private:
+    friend class shard;
+
+    size_t pagesize;
+    unsigned limit, count;
+    bool sizes;
+    shard *list, *idle;
+    pthread_mutex_t mutex;
+#if defined(_MSTHREADS_)
+    DWORD key;
+#elif defined(__PTH__)
+    pth_key_t key;
+#else
+    pthread_key_t key;
+#endif
+    bool keyed;
+
+    __LOCAL shard *local(void);
+
+public:
+    /**
+     * Construct a sharded memory pager.
+     * @param page size to use for each sub-arena or 0 for OS allocation size.
+     * @param max pages each sub-arena may allocate, 0 if unlimited.
+     */
+    shardpager(size_t page = 0, unsigned max = 0);
+
+    /**
+     * Destroy a sharded memory pager.  Release all sub-arenas and their
+     * pages back to the heap at once.
+     */
+    virtual ~shardpager();
+
+    /**
+     * Get the number of sub-arenas that have been created.
+     * @return number of sub-arenas.
+     */
+    inline unsigned shards(void) const
+        {return count;}
+
+    /**
+     * Get the size of a memory page used by each sub-arena.
+     * @return size of each pager heap allocation.
+     */
+    inline size_t size(void) const
+        {return pagesize;}
+
+    /**
+     * Get the total number of pages allocated by all sub-arenas.
+     * @return pages allocated from heap.
+     */
+    unsigned pages(void);
+
+    /**
+     * Determine combined utilization of all sub-arenas.  This is the
+     * page weighted average of the utilization of each sub-arena.
+     * @return pager utilization, 0-100.
+     */
+    unsigned utilization(void);
+
+    /**
+     * Get combined allocation statistics of all sub-arenas.
+     * @return pager statistics.
+     */
+    memstats statistics(void);
+
+    /**
+     * Enable or disable the request size histogram of all sub-arenas,
+     * including ones created later.
+     * @param enable histogram.
+     */
+    void histogram(bool enable);
+
+    /**
+     * Purge the allocated memory and heap pages of all sub-arenas.  The
+     * sub-arenas themselves remain assigned to their threads.  This should
+     * only be used when no other thread still uses memory allocated from
+     * the pager.
+     */
+    void purge(void);
+
+    /**
+     * Allocate memory from the sub-arena of the calling thread.  The
+     * sub-arena is created on first use by a thread.
+     * @param size of memory request.
+     * @return allocated memory or NULL if not possible.
+     */
+    virtual void *_alloc(size_t size);
+};
+
 class __EXPORT ObjectPager : protected memalloc
 {
 public:
@@ -348,6 +645,15 @@ public:
     inline unsigned pages(void)
         {return memalloc::pages();}
 
+    /**
+     * Select how pager pages are backed, see memalloc::backing().
+     * @param options for page backing.
+     * @param reserve size of memory to map in advance, 0 if none.
+     * @return false if pages already allocated or memory cannot be mapped.
+     */
+    inline bool backing(unsigned options, size_t reserve = 0)
+        {return memalloc::backing(options, reserve);}
+
 protected:
     /**
      * Gather index list.
@@ -408,6 +714,17 @@ public:
             {return text;}
     };
 
+    /**
+     * Checkpoint of a string pager.  This is created by mark() and used
+     * to rewind the list back to that state.
+     */
+    typedef struct {
+        memalloc::mark_t pager;
+        LinkedObject *root;
+        member *last;
+        unsigned members;
+    } mark_t;
+
     /**
      * Create a pager with a maximum page size.
      * @param size of pager allocation pages.
@@ -416,6 +733,11 @@ public:
 
     StringPager(char **list, size_t pagesize = 256);
 
+    /**
+     * Release the hash index of interned strings.
+     */
+    virtual ~StringPager();
+
     /**
      * Get the number of items in the pager string list.
      * @return number of items stored.
@@ -444,6 +766,26 @@ public:
      */
     void add(const char *text);
 
+    /**
+     * Intern text in the list.  If the same text is already a member of
+     * the list, the existing copy is returned and nothing new is stored.
+     * Otherwise the text is added to the end of the list.  Since equal
+     * strings intern to the same pointer, interned strings can be compared
+     * by pointer rather than by content.  A hash index of the list is kept
+     * so both interning and find() are constant time.
+     * @param text to intern.
+     * @return pooled copy of text.
+     */
+    const char *intern(const char *text);
+
+    /**
+     * Find a member of the list by content.  This uses the hash index
+     * that intern() keeps, building it first if needed.
+     * @param text to find.
+     * @return pooled copy of text or NULL if not a member.
+     */
+    const char *find(const char *text);
+
     /**
      * Add text to front of list.
      * @param text to add.
@@ -530,6 +872,20 @@ public:
      */
     void sort(void);
 
+    /**
+     * Mark the current list and pager state.
+     * @return checkpoint of list.
+     */
+    mark_t mark(void);
+
+    /**
+     * Rewind the list to a previously marked checkpoint.  Strings added
+     * since the mark are removed and the pager memory they used is kept
+     * for re-use.  The list should only have been added to since the mark.
+     * @param point to rewind to.
+     */
+    void rewind(const mark_t& point);
+
     /**
      * Gather index list.
      * @return index.
@@ -581,6 +937,13 @@ public:
 private:
     member *last;
     char **index;
+    member **hashed;
+    unsigned hashsize, hashcount;
+
+    __LOCAL void rehash(unsigned size);
+    __LOCAL member **slot(const char *text);
+    __LOCAL void insert(member *node);
+    __LOCAL void reset(void);
 };
 
 /**
@@ -677,6 +1040,17 @@ protected:
     virtual void *_alloc(size_t size);
 
 public:
+    /**
+     * Checkpoint of a buffered pager.  This is created by mark() and used
+     * to rewind the buffer back to that state.
+     */
+    typedef struct {
+        memalloc::mark_t pager;
+        struct cpage *last;
+        unsigned used;
+        unsigned long count;
+    } mark_t;
+
     /**
      * Reset pager text buffer protocol.
      */
@@ -687,6 +1061,22 @@ public:
      */
     void rewind(void);
 
+    /**
+     * Mark the current buffer and pager state.
+     * @return checkpoint of buffer.
+     */
+    mark_t mark(void);
+
+    /**
+     * Rewind the buffer to a previously marked checkpoint.  Text written
+     * since the mark is discarded and the pager memory it used is kept
+     * for re-use.  Buffer space released by reset() before the mark is
+     * not recovered.  The read position is moved to the start of the
+     * buffer.
+     * @param point to rewind to.
+     */
+    void rewind(const mark_t& point);
+
     /**
      * Create an output string from buffer.
      * @return output string allocated.
@@ -764,6 +1154,25 @@ public:
      */
     void update(size_t size);
 
+    /**
+     * Get the number of memory segments that hold buffered text.
+     * @return number of segments gather() would fill.
+     */
+    unsigned segments(void) const;
+
+#ifndef _MSWINDOWS_
+    /**
+     * Export buffered text as an i/o vector for writev() or sendmsg()
+     * without copying it.  The vector points into pager memory, and is
+     * valid until the buffer is reset, rewound to a mark, or purged.
+     * @param vector to fill.
+     * @param max number of segments in vector.
+     * @param offset of first byte to export, such as after a partial write.
+     * @return number of segments filled.
+     */
+    unsigned gather(struct iovec *vector, unsigned max, size_t offset = 0) const;
+#endif
+
     /**
      * Check if can still save into buffer.
      * @return true if buffer is full.
@@ -859,14 +1268,35 @@ protected:
  * class for the pager template and generally is not used by itself.  If
  * different type pools are intended to use a common memory pager then
  * you will need to mixin a memory protocol object that performs
- * redirection such as the MemoryRedirect class.
+ * redirection such as the MemoryRedirect class.  Each thread recycles
+ * objects through its own small magazine of free objects, so get and put
+ * normally take no lock.  The shared free list is only locked to refill
+ * an empty magazine or to take the overflow of a full one.
  * @author David Sugar <dyfet@gnutelephony.org>
  */
 class __EXPORT PagerPool : public MemoryProtocol
 {
+public:
+    class __LOCAL magazine;
+
 private:
+    friend class magazine;
+
     LinkedObject *freelist;
     pthread_mutex_t mutex;
+    memstats stats;
+    size_t unit;
+    magazine *list, *idle;
+#if defined(_MSTHREADS_)
+    DWORD key;
+#elif defined(__PTH__)
+    pth_key_t key;
+#else
+    pthread_key_t key;
+#endif
+    bool keyed;
+
+    __LOCAL magazine *local(void);
 
 protected:
     PagerPool();
@@ -880,6 +1310,19 @@ public:
      * @param object to return to pool.
      */
     void put(PagerObject *object);
+
+    /**
+     * Get allocation statistics of the pool.  Counts kept by threads that
+     * are still recycling objects may be slightly behind.
+     * @return copy of pool statistics.
+     */
+    memstats statistics(void);
+
+    /**
+     * Enable or disable the request size histogram.
+     * @param enable histogram.
+     */
+    void histogram(bool enable);
 };
 
 class __EXPORT charmem : public CharacterProtocol
@@ -960,6 +1403,9 @@ private:
     size_t keysize;
     NamedObject **root;
     LinkedObject **list;
+    NamedTable table;
+
+    __LOCAL keydata *find(const char *id);
 
 protected:
     /**
@@ -972,8 +1418,10 @@ protected:
 
 public:
     /**
-     * Create a key associated memory pointer table.
-     * @param indexing size for hash map.
+     * Create a key associated memory pointer table.  An indexing size of 0
+     * uses a NamedTable that grows with the number of keys rather than a
+     * fixed size hash map.
+     * @param indexing size for hash map or 0 for growable table.
      * @param max size of a string name if names are in reusable managed memory.
      * @param page size of memory pager.
      */
@@ -1064,6 +1512,9 @@ public:
     inline T** list(void)
         {return (T**)ObjectPager::list();}
 
+    inline bool backing(unsigned options, size_t reserve = 0)
+        {return ObjectPager::backing(options, reserve);}
+
     inline T* operator++(void)
         {T* tmp = ObjectPager::add(); if(tmp) new((caddr_t)tmp) T; return tmp;}
 
@@ -1237,7 +1688,7 @@ public:
      * @return pager utilization, 0-100.
      */
     inline unsigned utilization(void) const
-        {return mempager::utilization();}
+        {return const_cast<assoc_pointer*>(this)->mempager::utilization();}
 
     /**
      * Access to number of pages allocated from heap for our associated
@@ -1258,6 +1709,10 @@ public:
 template <typename T>
 class pager : private MemoryRedirect, private PagerPool
 {
+private:
+    inline void *_alloc(size_t size)
+        {return MemoryRedirect::_alloc(size);}
+
 public:
     /**
      * Construct a pager and optionally assign a private pager heap.
@@ -1270,14 +1725,28 @@ public:
      * @return pointer to typed managed pager pool object.
      */
     inline T *operator()(void)
-        {return new(get(sizeof(T))) T;}
+        {return new((caddr_t)get(sizeof(T))) T;}
 
     /**
      * Create a managed object by pointer reference.
      * @return pointer to typed managed pager pool object.
      */
     inline T *operator*()
-        {return new(get(sizeof(T))) T;}
+        {return new((caddr_t)get(sizeof(T))) T;}
+
+    /**
+     * Get allocation statistics of the pool.
+     * @return copy of pool statistics.
+     */
+    inline memstats statistics(void)
+        {return PagerPool::statistics();}
+
+    /**
+     * Enable or disable the request size histogram.
+     * @param enable histogram.
+     */
+    inline void histogram(bool enable)
+        {PagerPool::histogram(enable);}
 };
 
 /**
@@ -1289,20 +1758,26 @@ template <class T, unsigned M = 177>
 class keypager : public mempager
 {
 private:
-    NamedObject *idx[M];
+    NamedObject *idx[M ? M : 1];
+    NamedTable table;
+
+    inline NamedObject **root(void) const
+        {return const_cast<NamedObject **>(idx);}
 
 public:
     /**
-     * Create the object cache.
+     * Create the object cache.  A hash map size of 0 uses a NamedTable
+     * that grows with the number of objects.
      * @param size of allocation units.
      */
-    inline keypager(size_t size) : mempager(size) {}
+    inline keypager(size_t size) : mempager(size)
+        {memset(idx, 0, sizeof(idx));}
 
     /**
      * Destroy the hash pager by purging the index chains and memory pools.
      */
     inline ~keypager()
-        {NamedObject::purge(idx, M); mempager::purge();}
+        {if(M) NamedObject::purge(idx, M); table.clear(); mempager::purge();}
 
     /**
      * Find a typed object derived from NamedObject in the hash map by name.
@@ -1311,10 +1786,14 @@ public:
      * @return typed object if found through map or NULL.
      */
     inline T *get(const char *name) const {
-        T *node = (static_cast<T*>(NamedObject::map(idx, name, M)));
+        T *node = static_cast<T*>(M ? NamedObject::map(root(), name, M) : table.map(name));
         if(!node) {
-            node = init<T>(static_cast<T*>(mempager::_alloc(sizeof(T))));
-            node->NamedObject::add(idx, name, M);
+            keypager *self = const_cast<keypager*>(this);
+            node = init<T>(static_cast<T*>(self->mempager::_alloc(sizeof(T))));
+            if(M)
+                node->NamedObject::add(self->idx, const_cast<char *>(name), M);
+            else
+                self->table.add(node, strcpy((char *)self->mempager::_alloc(strlen(name) + 1), name));
         }
         return node;
     }
@@ -1325,7 +1804,7 @@ public:
      * @return true if found.
      */
     bool test(const char *name) const
-        {return NamedObject::map(idx, name, M) != NULL;}
+        {return (M ? NamedObject::map(root(), name, M) : table.map(name)) != NULL;}
 
     /**
      * Find a typed object derived from NamedObject in the hash map by name.
@@ -1341,7 +1820,7 @@ public:
      * @return first typed object or NULL if nothing in list.
      */
     inline T *begin(void) const
-        {return static_cast<T*>(NamedObject::skip(idx, NULL, M));}
+        {return static_cast<T*>(M ? NamedObject::skip(root(), NULL, M) : table.skip(NULL));}
 
     /**
      * Find next typed object in hash map for iteration.
@@ -1349,14 +1828,14 @@ public:
      * @return next iterative object or NULL if past end of map.
      */
     inline T *next(T *current) const
-        {return static_cast<T*>(NamedObject::skip(idx, current, M));}
+        {return static_cast<T*>(M ? NamedObject::skip(root(), current, M) : table.skip(current));}
 
     /**
      * Count the number of typed objects in our hash map.
      * @return count of typed objects.
      */
     inline unsigned count(void) const
-        {return NamedObject::count(idx, M);}
+        {return M ? NamedObject::count(root(), M) : table.count();}
 
     /**
      * Convert our hash map into a linear object pointer array.  The
@@ -1365,7 +1844,7 @@ public:
      * @return array of typed named object pointers.
      */
     inline T **index(void) const
-        {return NamedObject::index(idx, M);}
+        {return (T **)(M ? NamedObject::index(root(), M) : table.index());}
 
     /**
      * Convert our hash map into an alphabetically sorted linear object
@@ -1374,7 +1853,7 @@ public:
      * @return sorted array of typed named object pointers.
      */
     inline T **sort(void) const
-        {return NamedObject::sort(NamedObject::index(idx, M));}
+        {return (T **)NamedObject::sort(M ? NamedObject::index(root(), M) : table.index());}
 
     /**
      * Convenience typedef for iterative pointer.
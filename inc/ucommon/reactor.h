@@ -0,0 +1,264 @@
+// Copyright (C) 2006-2014 David Sugar, Tycho Softworks.
+//
+// This file is part of GNU uCommon C++.
+//
+// GNU uCommon C++ is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// GNU uCommon C++ is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with GNU uCommon C++.  If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ * Event driven socket dispatch.  A reactor lets a single thread service
+ * many non-blocking sockets, timers, and notices posted from other threads,
+ * rather than using a thread per connection that blocks in Socket::wait.
+ * Handlers are continuations that are called back on the reactor thread
+ * when their socket is ready, their timer expires, or they are posted.
+ * @file ucommon/reactor.h
+ */
+
+#ifndef _UCOMMON_REACTOR_H_
+#define _UCOMMON_REACTOR_H_
+
+#ifndef _UCOMMON_SOCKET_H_
+#include <ucommon/socket.h>
+#endif
+
+#ifndef  _UCOMMON_THREAD_H_
+#include <ucommon/thread.h>
+#endif
+
+namespace ucommon {
+
+/**
+ * A single threaded event loop for sockets, timers, and posted notices.
+ * Socket handlers are registered for input and output readiness, and
+ * are called back from dispatch when the socket is ready.  The reactor is
+ * also a timer queue, so timer events attached to it expire from the same
+ * loop.  Notices may be posted from any thread and are run on the reactor
+ * thread in the order posted, which lets producer threads hand work, such
+ * as items taken from a queue or semaphore, to sessions in the loop.  On
+ * linux the reactor uses epoll, so the number of sockets is not limited
+ * and dispatch cost depends only on how many are ready.  Elsewhere, or if
+ * epoll cannot be set up, select is used.
+ * @author David Sugar <dyfet@gnutelephony.org>
+ */
+class __EXPORT Reactor : public TimerQueue
+{
+public:
+    /**
+     * Readiness events a handler may wait for or be called with.
+     */
+    enum {
+        INPUT = 0x01,
+        OUTPUT = 0x02,
+        HANGUP = 0x04,
+        FAILED = 0x08
+    };
+
+    /**
+     * A socket registered with a reactor.  The derived class implements
+     * ready to continue whatever operation was waiting on the socket,
+     * which should be set non-blocking.  Handlers should be attached,
+     * changed, and detached from the reactor thread, or before the
+     * reactor is run.
+     * @author David Sugar <dyfet@gnutelephony.org>
+     */
+    class __EXPORT handler
+    {
+    private:
+        friend class Reactor;
+
+        Reactor *reactor;
+        socket_t so;
+        unsigned mask;
+        handler *next, *prev;
+
+    protected:
+        /**
+         * Called from the reactor thread when the socket is ready.  The
+         * handler may be changed, detached, or deleted from here.
+         * @param events that are ready.
+         */
+        virtual void ready(unsigned events) = 0;
+
+    public:
+        /**
+         * Create a handler that is not attached.
+         */
+        handler();
+
+        /**
+         * Detach and destroy handler.  The socket is not closed.
+         */
+        virtual ~handler();
+
+        /**
+         * Attach a socket to a reactor.
+         * @param reactor to attach to.
+         * @param socket to watch.
+         * @param events to wait for.
+         * @return true if attached.
+         */
+        bool attach(Reactor *reactor, socket_t socket, unsigned events = INPUT);
+
+        /**
+         * Change the events waited for.
+         * @param events to wait for, or 0 to pause.
+         * @return true if changed.
+         */
+        bool wait(unsigned events);
+
+        /**
+         * Detach from reactor.
+         */
+        void detach(void);
+
+        /**
+         * Get socket of handler.
+         * @return socket or invalid if not attached.
+         */
+        inline socket_t handle(void) const
+            {return so;}
+
+        /**
+         * Get events currently waited for.
+         * @return event mask.
+         */
+        inline unsigned events(void) const
+            {return mask;}
+
+        /**
+         * Get reactor we are attached to.
+         * @return reactor or NULL if not attached.
+         */
+        inline Reactor *list(void) const
+            {return reactor;}
+    };
+
+    /**
+     * Work posted to a reactor from any thread.  The derived class
+     * implements posted, which is called once on the reactor thread.
+     * @author David Sugar <dyfet@gnutelephony.org>
+     */
+    class __EXPORT notice
+    {
+    private:
+        friend class Reactor;
+
+        notice *next;
+
+    protected:
+        /**
+         * Called from the reactor thread after being posted.  The notice
+         * may be deleted or posted again from here.
+         */
+        virtual void posted(void) = 0;
+
+    public:
+        notice();
+        virtual ~notice();
+    };
+
+private:
+    friend class handler;
+
+    Mutex lock;
+    handler *handlers;
+    notice *first, *last;
+    void *pending;
+    unsigned count, ready, limit;
+    int backend;
+    socket_t wakeup[2];
+    volatile bool sleeping, stopped;
+
+    __LOCAL void wake(void);
+    __LOCAL void cancel(handler *object);
+    __LOCAL bool watch(handler *object, unsigned events, bool added);
+    __LOCAL unsigned select(timeout_t timeout);
+
+protected:
+    /**
+     * Timer events are changed from the reactor thread, or from notices,
+     * so the queue itself needs no lock.
+     */
+    void modify(void);
+
+    /**
+     * Wake a sleeping reactor to evaluate the next timer.
+     */
+    void update(void);
+
+public:
+    /**
+     * Create a reactor.
+     */
+    Reactor();
+
+    /**
+     * Destroy reactor.  Handlers still attached are detached.
+     */
+    virtual ~Reactor();
+
+    /**
+     * Wait for and dispatch ready sockets, expired timers, and posted
+     * notices once.
+     * @param timeout to wait in milliseconds, less if a timer is due.
+     * @return number of handlers and notices called, or 0 if stopped.
+     */
+    unsigned dispatch(timeout_t timeout = Timer::inf);
+
+    /**
+     * Dispatch events until stopped.
+     */
+    void run(void);
+
+    /**
+     * Stop a running reactor.  This may be called from any thread.  A
+     * stopped reactor may be dispatched again after reset.
+     */
+    void stop(void);
+
+    /**
+     * Clear a stop so the reactor may be run again.
+     */
+    inline void reset(void)
+        {stopped = false;}
+
+    /**
+     * Post a notice to be run on the reactor thread.  This may be called
+     * from any thread.
+     * @param notice to post.
+     */
+    void post(notice *notice);
+
+    /**
+     * Get number of attached handlers.
+     * @return handlers attached.
+     */
+    inline unsigned size(void) const
+        {return count;}
+
+    /**
+     * Test if reactor has been stopped.
+     * @return true if stopped.
+     */
+    inline bool is_stopped(void) const
+        {return stopped;}
+};
+
+/**
+ * Convenience type for reactor socket handlers.
+ */
+typedef Reactor::handler reactor_handler_t;
+
+} // namespace ucommon
+
+#endif
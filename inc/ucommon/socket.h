@@ -54,6 +54,7 @@ typedef uint32_t in_addr_t;
 #include <net/if.h>
 #include <netinet/in.h>
 #include <netdb.h>
+#include <sys/uio.h>
 #endif
 
 #if defined(__ANDROID__)
@@ -152,6 +153,8 @@ struct sockaddr_storage
 
 namespace ucommon {
 
+class bufpager;
+
 /**
  * A class to hold internet segment routing rules.  This class can be used
  * to provide a stand-alone representation of a cidr block of internet
@@ -1189,6 +1192,17 @@ public:
      */
     size_t writes(const char *string);
 
+#ifndef _MSWINDOWS_
+    /**
+     * Write the text of a buffered pager to the socket.  The pager pages
+     * are sent directly with vectored i/o rather than copied into one
+     * buffer first.
+     * @param buffer to write.
+     * @return number of bytes sent, 0 if none.
+     */
+    size_t writev(const bufpager& buffer);
+#endif
+
     /**
      * Test if socket is valid.
      * @return true if valid socket.
@@ -1409,6 +1423,18 @@ public:
      */
     static ssize_t sendto(socket_t socket, const void *buffer, size_t size, int flags = 0, const struct sockaddr *address = NULL);
 
+#ifndef _MSWINDOWS_
+    /**
+     * Send a vector of memory segments on a connected socket.
+     * @param socket to send to.
+     * @param vector of segments to send.
+     * @param count of segments in vector.
+     * @param flags for i/o operation (MSG_OOB, MSG_DONTWAIT, etc).
+     * @return number of bytes sent, -1 if error.
+     */
+    static ssize_t sendv(socket_t socket, const struct iovec *vector, unsigned count, int flags = 0);
+#endif
+
     /**
      * Send reply on socket.  Used to reply to a recvfrom message.
      * @param socket to send to.
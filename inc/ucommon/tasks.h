@@ -0,0 +1,601 @@
+// Copyright (C) 2006-2014 David Sugar, Tycho Softworks.
+//
+// This file is part of GNU uCommon C++.
+//
+// GNU uCommon C++ is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// GNU uCommon C++ is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with GNU uCommon C++.  If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ * Thread pools and tasks.  A thread pool runs task objects on a fixed set
+ * of worker threads.  Each worker keeps its own deque of tasks, and idle
+ * workers steal from busy ones, so there is no single queue lock shared
+ * by every submission.  Submitted tasks also serve as a handle that can
+ * be waited on for completion.  Parallel for each, transform, reduce,
+ * and sort templates are built on the pool for arrays of objects.
+ * @file ucommon/tasks.h
+ */
+
+#ifndef _UCOMMON_TASKS_H_
+#define _UCOMMON_TASKS_H_
+
+#ifndef _UCOMMON_CONFIG_H_
+#include <ucommon/platform.h>
+#endif
+
+#ifndef  _UCOMMON_THREAD_H_
+#include <ucommon/thread.h>
+#endif
+
+#ifndef _UCOMMON_VECTOR_H_
+#include <ucommon/vector.h>
+#endif
+
+#ifndef _UCOMMON_MAPPED_H_
+#include <ucommon/mapped.h>
+#endif
+
+namespace ucommon {
+
+class ThreadPool;
+
+/**
+ * A unit of work that is run by a thread pool.  A task is created by the
+ * caller, submitted to a pool, and may then be waited on until it has
+ * completed.  The pool never deletes a task; the caller should wait for
+ * completion before deleting it.  A completed task may be submitted again.
+ * @author David Sugar <dyfet@gnutelephony.org>
+ */
+class __EXPORT Task
+{
+private:
+    friend class ThreadPool;
+
+    ThreadPool *pool;
+    volatile unsigned state;
+
+protected:
+    /**
+     * Work performed by the task on a pool worker thread.
+     */
+    virtual void run(void) = 0;
+
+public:
+    /**
+     * Create a task that is not yet submitted.
+     */
+    Task();
+
+    /**
+     * Destroy task.  The task should not still be queued or running.
+     */
+    virtual ~Task();
+
+    /**
+     * Wait for a submitted task to complete.
+     * @param timeout in milliseconds to wait.
+     * @return true if completed, false if timed out.
+     */
+    bool wait(timeout_t timeout = Timer::inf);
+
+    /**
+     * Test if task has run to completion.
+     * @return true if completed.
+     */
+    bool is_done(void) const;
+};
+
+/**
+ * A work stealing thread pool.  Each worker thread owns a bounded
+ * Chase-Lev deque it pushes and pops at one end, while idle workers steal
+ * from the other end.  Tasks submitted from a worker go to its own deque.
+ * Tasks submitted from other threads are spread over per worker inboxes.
+ * The total of queued and running tasks is bounded, and submit blocks
+ * when the pool is full to apply backpressure.  Without gcc atomics the
+ * deques are guarded by a per worker mutex instead.
+ * @author David Sugar <dyfet@gnutelephony.org>
+ */
+class __EXPORT ThreadPool : private ConditionalAccess
+{
+public:
+    class __LOCAL worker;
+
+private:
+    friend class Task;
+    friend class worker;
+
+    worker **workers;
+    unsigned count;
+    unsigned capacity;
+    bool pinned;
+    Semaphore slots;
+    volatile unsigned next;
+    volatile unsigned queued;
+    volatile unsigned outstanding;
+    volatile unsigned sleepers;
+    volatile unsigned joiners;
+    volatile bool stopping;
+
+    __LOCAL Task *take(worker *self);
+    __LOCAL bool park(void);
+    __LOCAL void execute(Task *task, bool slot = true);
+    __LOCAL void wakeup(void);
+
+public:
+    /**
+     * Create and start a thread pool.
+     * @param size of pool in worker threads, or 0 for one per processor.
+     * @param limit of tasks queued or running, or 0 for 256 per worker.
+     * @param pinned to bind each worker to a processor when supported.
+     */
+    ThreadPool(unsigned size = 0, unsigned limit = 0, bool pinned = false);
+
+    /**
+     * Drain pending tasks and stop the pool.
+     */
+    ~ThreadPool();
+
+    /**
+     * Submit a task to the pool.  If the pool is full this waits for a
+     * task to complete first.  A task submitted from a worker thread of a
+     * full pool is run directly by that worker instead.
+     * @param task to run.
+     * @param timeout in milliseconds to wait for room in the pool.
+     * @return true if submitted, false if timed out or shut down.
+     */
+    bool submit(Task *task, timeout_t timeout = Timer::inf);
+
+    /**
+     * Wait until all submitted tasks have completed.
+     */
+    void drain(void);
+
+    /**
+     * Drain pending tasks, stop accepting new ones, and join the worker
+     * threads.  This is also done when the pool is deleted.
+     */
+    void shutdown(void);
+
+    /**
+     * Get number of worker threads.
+     * @return number of workers.
+     */
+    inline unsigned size(void) const
+        {return count;}
+
+    /**
+     * Get number of tasks submitted and not yet completed.
+     * @return tasks outstanding.
+     */
+    inline unsigned pending(void) const
+        {return outstanding;}
+
+    /**
+     * Test if the calling thread is a worker of this pool.
+     * @return true if called from a pool worker.
+     */
+    bool is_worker(void) const;
+
+    /**
+     * Get number of online processors.
+     * @return processor count, at least 1.
+     */
+    static unsigned processors(void);
+};
+
+/**
+ * Partition an indexed range into chunks processed on a thread pool.  The
+ * range is split into fixed size chunks that depend only on the element
+ * count and chunk size, never on the number of workers, so results that
+ * are combined per chunk come out the same on any pool.  Workers and the
+ * calling thread claim chunks in turn.  Small ranges, ranges dispatched
+ * without a pool, and ranges dispatched from inside a pool worker are
+ * processed by the calling thread.  This is the base for the parallel
+ * algorithm templates.
+ * @author David Sugar <dyfet@gnutelephony.org>
+ */
+class __EXPORT Parallel
+{
+public:
+    class __LOCAL helper;
+
+    /**
+     * Default bytes of data processed by one chunk.
+     */
+    static const size_t chunksize;
+
+private:
+    friend class helper;
+
+    ThreadPool *pool;
+    size_t items, grain, parts;
+    volatile size_t next;
+
+    __LOCAL void work(void);
+
+protected:
+    /**
+     * Create partitioning for a pool.
+     * @param pool to run on, or NULL to run in the calling thread.
+     */
+    Parallel(ThreadPool *pool);
+
+    virtual ~Parallel();
+
+    /**
+     * Process one chunk of the range.  This may be called concurrently
+     * for different chunks.
+     * @param first index of chunk.
+     * @param last index past end of chunk.
+     * @param part number of chunk.
+     */
+    virtual void process(size_t first, size_t last, size_t part) = 0;
+
+    /**
+     * Process a range in chunks, returning when all chunks are done.
+     * @param count of elements in range.
+     * @param grain of elements in each chunk.
+     */
+    void dispatch(size_t count, size_t grain);
+
+public:
+    /**
+     * Get elements in each chunk for a size of object.  Chunks span a
+     * fixed number of bytes so each worker streams through its own cache
+     * lines, unless an explicit grain is given.
+     * @param size of element.
+     * @param grain requested, or 0 for default.
+     * @return elements per chunk.
+     */
+    static size_t chunking(size_t size, size_t grain = 0);
+
+    /**
+     * Get number of chunks a range is split into.
+     * @param count of elements.
+     * @param grain of elements per chunk.
+     * @return number of chunks.
+     */
+    inline static size_t partitions(size_t count, size_t grain)
+        {return (count + grain - 1) / grain;}
+};
+
+/**
+ * Apply a function to each member of an array on a thread pool.
+ * @author David Sugar <dyfet@gnutelephony.org>
+ */
+template<typename T, class F>
+class parallel_each : protected Parallel
+{
+private:
+    T *data;
+    F func;
+
+    void process(size_t first, size_t last, size_t)
+        {while(first < last) func(data[first++]);}
+
+public:
+    inline parallel_each(ThreadPool *pool, T *array, F function) :
+        Parallel(pool), func(function) {data = array;}
+
+    inline void operator()(size_t count, size_t grain = 0)
+        {dispatch(count, chunking(sizeof(T), grain));}
+};
+
+/**
+ * Apply a function to each object of a vector on a thread pool.
+ * @author David Sugar <dyfet@gnutelephony.org>
+ */
+template<typename T, class F>
+class parallel_vector : protected Parallel
+{
+private:
+    vectorof<T> *data;
+    F func;
+
+    void process(size_t first, size_t last, size_t)
+        {while(first < last) func(*((*data)((vectorsize_t)(first++))));}
+
+public:
+    inline parallel_vector(ThreadPool *pool, vectorof<T> *vector, F function) :
+        Parallel(pool), func(function) {data = vector;}
+
+    inline void operator()(size_t grain = 0)
+        {dispatch(data->len(), chunking(sizeof(T), grain));}
+};
+
+/**
+ * Store the result of a function for each member of an array on a
+ * thread pool.
+ * @author David Sugar <dyfet@gnutelephony.org>
+ */
+template<typename T, typename R, class F>
+class parallel_transform : protected Parallel
+{
+private:
+    const T *source;
+    R *target;
+    F func;
+
+    void process(size_t first, size_t last, size_t) {
+        while(first < last) {
+            target[first] = func(source[first]);
+            ++first;
+        }
+    }
+
+public:
+    inline parallel_transform(ThreadPool *pool, const T *from, R *to, F function) :
+        Parallel(pool), func(function) {source = from; target = to;}
+
+    inline void operator()(size_t count, size_t grain = 0)
+        {dispatch(count, chunking(sizeof(R), grain));}
+};
+
+/**
+ * Reduce an array with a binary function on a thread pool.  Each chunk
+ * is folded on its own, and the chunk results are then folded in order,
+ * so the result is the same for any pool size even when the function is
+ * not exactly associative, as with floating point sums.
+ * @author David Sugar <dyfet@gnutelephony.org>
+ */
+template<typename T, class F>
+class parallel_reduce : protected Parallel
+{
+private:
+    const T *data;
+    T *partial;
+    F func;
+
+    void process(size_t first, size_t last, size_t part) {
+        T value = data[first];
+        while(++first < last)
+            value = func(value, data[first]);
+        partial[part] = value;
+    }
+
+public:
+    inline parallel_reduce(ThreadPool *pool, const T *array, F function) :
+        Parallel(pool), func(function) {data = array;}
+
+    T operator()(size_t count, T init, size_t grain = 0) {
+        grain = chunking(sizeof(T), grain);
+        if(!count)
+            return init;
+        size_t parts = partitions(count, grain);
+        partial = new T[parts];
+        dispatch(count, grain);
+        for(size_t part = 0; part < parts; ++part)
+            init = func(init, partial[part]);
+        delete[] partial;
+        return init;
+    }
+};
+
+/**
+ * Default ordering used for parallel sorting.
+ * @author David Sugar <dyfet@gnutelephony.org>
+ */
+template<typename T>
+class parallel_less
+{
+public:
+    inline bool operator()(const T& o1, const T& o2) const
+        {return o1 < o2;}
+};
+
+/**
+ * Sort an array on a thread pool.  Chunks are heap sorted in parallel,
+ * and sorted runs are then merged in pairs, with each merge pass run in
+ * parallel, through a scratch array of the same size.  The sort is not
+ * stable.
+ * @author David Sugar <dyfet@gnutelephony.org>
+ */
+template<typename T, class C = parallel_less<T> >
+class parallel_sort : protected Parallel
+{
+private:
+    T *source, *target;
+    size_t total, width;
+    C less;
+
+    void sift(T *heap, size_t root, size_t count) {
+        size_t child;
+        while((child = root * 2 + 1) < count) {
+            if(child + 1 < count && less(heap[child], heap[child + 1]))
+                ++child;
+            if(!less(heap[root], heap[child]))
+                return;
+            T temp = heap[root];
+            heap[root] = heap[child];
+            heap[child] = temp;
+            root = child;
+        }
+    }
+
+    void heapsort(T *heap, size_t count) {
+        size_t pos = count / 2;
+        while(pos)
+            sift(heap, --pos, count);
+        while(count > 1) {
+            T temp = heap[0];
+            heap[0] = heap[--count];
+            heap[count] = temp;
+            sift(heap, 0, count);
+        }
+    }
+
+    void merge(size_t first) {
+        size_t mid = first + width, last = mid + width;
+        size_t left = first, right = mid;
+        if(mid > total)
+            mid = total;
+        if(last > total)
+            last = total;
+        while(left < mid && right < last) {
+            if(less(source[right], source[left]))
+                target[first++] = source[right++];
+            else
+                target[first++] = source[left++];
+        }
+        while(left < mid)
+            target[first++] = source[left++];
+        while(right < last)
+            target[first++] = source[right++];
+    }
+
+    void process(size_t first, size_t last, size_t) {
+        if(!width)
+            heapsort(source + first, last - first);
+        else while(first < last)
+            merge(width * 2 * first++);
+    }
+
+public:
+    inline parallel_sort(ThreadPool *pool, C compare = C()) :
+        Parallel(pool), less(compare) {}
+
+    void operator()(T *array, size_t count, size_t grain = 0) {
+        grain = chunking(sizeof(T), grain);
+        total = count;
+        source = array;
+        width = 0;
+        dispatch(count, grain);
+        if(count <= grain)
+            return;
+
+        T *scratch = new T[count];
+        target = scratch;
+        for(width = grain; width < count; width *= 2) {
+            dispatch(partitions(count, width * 2), 1);
+            T *swap = source;
+            source = target;
+            target = swap;
+        }
+        if(source != array) {
+            for(size_t pos = 0; pos < count; ++pos)
+                array[pos] = source[pos];
+        }
+        delete[] scratch;
+    }
+};
+
+/**
+ * Call a function for each member of an array on a thread pool.  The
+ * function may be called from several threads at once.
+ * @param pool to run on, or NULL for the calling thread.
+ * @param array of members.
+ * @param count of members.
+ * @param func to call with each member.
+ * @param grain of members per chunk, or 0 for default.
+ */
+template<typename T, class F>
+inline void parallel_for(ThreadPool *pool, T *array, size_t count, F func, size_t grain = 0)
+{
+    parallel_each<T, F> each(pool, array, func);
+    each(count, grain);
+}
+
+/**
+ * Call a function for each object of a typed vector on a thread pool.
+ * @param pool to run on, or NULL for the calling thread.
+ * @param vector of objects.
+ * @param func to call with each object.
+ * @param grain of objects per chunk, or 0 for default.
+ */
+template<typename T, class F>
+inline void parallel_for(ThreadPool *pool, vectorof<T>& vector, F func, size_t grain = 0)
+{
+    parallel_vector<T, F> each(pool, &vector, func);
+    each(grain);
+}
+
+/**
+ * Call a function for each member of a mapped array on a thread pool.
+ * @param pool to run on, or NULL for the calling thread.
+ * @param mapped array of members.
+ * @param func to call with each member.
+ * @param grain of members per chunk, or 0 for default.
+ */
+template<typename T, class F>
+inline void parallel_for(ThreadPool *pool, mapped_array<T>& mapped, F func, size_t grain = 0)
+{
+    if(mapped.max())
+        parallel_for(pool, &mapped[0], mapped.max(), func, grain);
+}
+
+/**
+ * Store the result of a function for each member of an array on a
+ * thread pool.  The source and target may be the same array.
+ * @param pool to run on, or NULL for the calling thread.
+ * @param source array of members.
+ * @param target array for results.
+ * @param count of members.
+ * @param func to call with each member.
+ * @param grain of members per chunk, or 0 for default.
+ */
+template<typename T, typename R, class F>
+inline void parallel_map(ThreadPool *pool, const T *source, R *target, size_t count, F func, size_t grain = 0)
+{
+    parallel_transform<T, R, F> transform(pool, source, target, func);
+    transform(count, grain);
+}
+
+/**
+ * Reduce an array on a thread pool.  The result does not depend on the
+ * number of workers in the pool, only on the grain.
+ * @param pool to run on, or NULL for the calling thread.
+ * @param array of members.
+ * @param count of members.
+ * @param init value to fold members into.
+ * @param func to fold two values.
+ * @param grain of members per chunk, or 0 for default.
+ * @return folded value.
+ */
+template<typename T, class F>
+inline T parallel_fold(ThreadPool *pool, const T *array, size_t count, T init, F func, size_t grain = 0)
+{
+    parallel_reduce<T, F> reduce(pool, array, func);
+    return reduce(count, init, grain);
+}
+
+/**
+ * Sort an array on a thread pool in ascending order.
+ * @param pool to run on, or NULL for the calling thread.
+ * @param array of members.
+ * @param count of members.
+ * @param grain of members per chunk, or 0 for default.
+ */
+template<typename T>
+inline void parallel_order(ThreadPool *pool, T *array, size_t count, size_t grain = 0)
+{
+    parallel_sort<T> sort(pool);
+    sort(array, count, grain);
+}
+
+/**
+ * Sort an array on a thread pool with an ordering function.
+ * @param pool to run on, or NULL for the calling thread.
+ * @param less function to compare two members.
+ * @param array of members.
+ * @param count of members.
+ * @param grain of members per chunk, or 0 for default.
+ */
+template<typename T, class C>
+inline void parallel_order(ThreadPool *pool, C less, T *array, size_t count, size_t grain = 0)
+{
+    parallel_sort<T, C> sort(pool, less);
+    sort(array, count, grain);
+}
+
+} // namespace ucommon
+
+#endif
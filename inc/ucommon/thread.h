@@ -73,6 +73,80 @@ namespace ucommon {
 
 class SharedPointer;
 
+/**
+ * Contention profile of a single lock instance.  Profiling is enabled per
+ * lock by calling its profile() method, which attaches a record that is
+ * kept in a process wide list.  Locks that are not profiled carry only a
+ * NULL pointer and pay a single branch.  Counters are updated while the
+ * profiled lock is held, so they need no further locking.  Records are
+ * never freed, which keeps the totals of destroyed locks for a later dump.
+ * @author David Sugar <dyfet@gnutelephony.org>
+ */
+class __EXPORT lockstats
+{
+private:
+    lockstats *next;
+    Timer::tick_t started;
+
+public:
+    enum {HISTOGRAM = 16};
+
+    char name[32];
+    unsigned long acquired, contended;
+
+    /**
+     * Wait and hold times, by power of two microseconds.
+     */
+    unsigned long waits[HISTOGRAM], holds[HISTOGRAM];
+
+    /**
+     * Construct an unregistered profile, such as to copy into.
+     * @param name to tag lock with, or NULL for none.
+     */
+    lockstats(const char *name = NULL);
+
+    /**
+     * Create and register a lock profile.
+     * @param name to tag lock with, or NULL for none.
+     * @return new profile record.
+     */
+    static lockstats *create(const char *name);
+
+    /**
+     * Get monotonic time in 100ns ticks for profile timing, so intervals
+     * are not skewed when the wall clock is adjusted.
+     * @return current tick count.
+     */
+    static Timer::tick_t clock(void);
+
+    /**
+     * Record a lock acquisition.  This also starts hold timing.
+     * @param start time of request from clock().
+     * @param busy if lock had to wait.
+     */
+    void acquire(Timer::tick_t start, bool busy);
+
+    /**
+     * Record release of an exclusive lock.
+     */
+    void release(void);
+
+    /**
+     * Copy most contended locks in the process.
+     * @param list to save copies into.
+     * @param count of entries in list.
+     * @return number of entries saved.
+     */
+    static unsigned top(lockstats *list, unsigned count);
+
+    /**
+     * Print most contended locks in the process.
+     * @param output file to print to.
+     * @param count of locks to print.
+     */
+    static void dump(FILE *output, unsigned count = 10);
+};
+
 /**
  * The conditional is a common base for other thread synchronizing classes.
  * Many of the complex sychronization objects, including barriers, semaphores,
@@ -220,6 +294,7 @@ protected:
 #endif
 
     unsigned pending, waiting, sharing;
+    lockstats *profiler;
 
     /**
      * Conditional wait for signal on millisecond timeout.
@@ -325,6 +400,13 @@ public:
      */
     ~ConditionalAccess();
 
+    /**
+     * Enable contention profiling of this lock.  This should be called
+     * before the lock is shared with other threads.
+     * @param name to tag lock with in profile dumps.
+     */
+    void profile(const char *name = NULL);
+
     /**
      * Access mode shared thread scheduling.
      */
@@ -360,6 +442,8 @@ public:
  * has expired or they are notified through the signal handler.  This can
  * be used to schedule and signal one-time completion handlers or for time
  * synchronized events signaled by an asychrononous I/O or event source.
+ * On Linux waiting threads park on a futex, and signal only makes a system
+ * call when a thread is waiting.
  * @author David Sugar <dyfet@gnutelephony.org>
  */
 class __EXPORT TimedEvent : public Timer
@@ -369,7 +453,7 @@ private:
     HANDLE event;
 #else
     pthread_cond_t cond;
-    bool signalled;
+    unsigned signalled, waiting;
 #endif
     pthread_mutex_t mutex;
 
@@ -457,6 +541,7 @@ protected:
     unsigned waiting;
     unsigned lockers;
     pthread_t locker;
+    lockstats *profiler;
 
     virtual void _lock(void);
     virtual void _unlock(void);
@@ -467,6 +552,13 @@ public:
      */
     RecursiveMutex();
 
+    /**
+     * Enable contention profiling of this lock.  This should be called
+     * before the lock is shared with other threads.
+     * @param name to tag lock with in profile dumps.
+     */
+    void profile(const char *name = NULL);
+
     /**
      * Acquire or increase locking.
      */
@@ -613,6 +705,14 @@ public:
      */
     ThreadLock();
 
+    /**
+     * Enable contention profiling of this lock.  This should be called
+     * before the lock is shared with other threads.
+     * @param name to tag lock with in profile dumps.
+     */
+    inline void profile(const char *name = NULL)
+        {ConditionalAccess::profile(name);}
+
     /**
      * Request modify (write) access through the lock.
      * @param timeout in milliseconds to wait for lock.
@@ -628,13 +728,22 @@ public:
     bool access(timeout_t timeout = Timer::inf);
 
     /**
-     * Specify hash table size for guard protection.  The default is 1.
+     * Specify hash table size for guard protection.  The default is 64.
      * This should be called at initialization time from the main thread
      * of the application before any other threads are created.
      * @param size of hash table used for guarding.
      */
     static void indexing(unsigned size);
 
+    /**
+     * Get contention count of the guard table bucket an object hashes to.
+     * This counts how often a guarded object was found already held or
+     * waited on, and may be used to tune the indexing size.
+     * @param object to check.
+     * @return contention count of the bucket.
+     */
+    static unsigned long contention(const void *object);
+
     /**
       * Write protect access to an arbitrary object.  This is like the
       * protect function of mutex.
@@ -665,6 +774,76 @@ public:
     void release(void);
 };
 
+/**
+ * A big reader lock for read mostly data.  Readers are counted in stripes
+ * that are each on their own cache line and are selected by the calling
+ * thread, so a reader only touches memory shared with the few threads
+ * that map to the same stripe rather than one counter shared by all
+ * readers.  A writer announces itself, which holds off new readers, and
+ * then waits for every stripe to drain, so writers are preferred.  This
+ * makes read access cheap and flat as cores are added at the cost of
+ * slower writes.  Read locks are not recursive, since a pending writer
+ * will block a nested reader.  Writers may recurse.  Both the exclusive
+ * and shared protocols are implimented to support exclusive_lock and
+ * shared_lock referencing.
+ * @author David Sugar <dyfet@gnutelephony.org>
+ */
+class __EXPORT BigReaderLock : private Conditional, public ExclusiveAccess, public SharedAccess
+{
+private:
+    void *slots;
+    unsigned stripes;
+    volatile unsigned writing;
+    unsigned writers;
+    pthread_t writeid;
+
+    __LOCAL bool drained(void);
+    __LOCAL void *stripe(void);
+
+protected:
+    virtual void _lock(void);
+    virtual void _share(void);
+    virtual void _unlock(void);
+
+public:
+    /**
+     * Create a big reader lock.
+     * @param stripes to count readers in, or 0 for one per processor.
+     */
+    BigReaderLock(unsigned stripes = 0);
+
+    /**
+     * Destroy lock.
+     */
+    ~BigReaderLock();
+
+    /**
+     * Request modify (write) access through the lock.
+     * @param timeout in milliseconds to wait for lock.
+     * @return true if locked, false if timeout.
+     */
+    bool modify(timeout_t timeout = Timer::inf);
+
+    /**
+     * Request shared (read) access through the lock.
+     * @param timeout in milliseconds to wait for lock.
+     * @return true if locked, false if timeout.
+     */
+    bool access(timeout_t timeout = Timer::inf);
+
+    /**
+     * Release the lock, whether held for read or write.
+     */
+    void release(void);
+
+    /**
+     * Get number of reader stripes.
+     * @return stripes used.
+     */
+    inline unsigned size(void) const
+        {return stripes;}
+};
+
 /**
  * Class for resource bound memory pools between threads.  This is used to
  * support a memory pool allocation scheme where a pool of reusable objects
@@ -680,6 +859,8 @@ class __EXPORT ReusableAllocator : protected Conditional
 protected:
     ReusableObject *freelist;
     unsigned waiting;
+    memstats stats;
+    size_t unit;
 
     /**
      * Initialize reusable allocator through a conditional.  Zero free list.
@@ -699,6 +880,22 @@ protected:
      * @param object being released.
      */
     void release(ReusableObject *object);
+
+public:
+    /**
+     * Get a snapshot of allocation statistics for the pool.  Objects
+     * carved from backing memory are counted as reserved, and objects
+     * handed out and not yet released are counted as used.
+     * @return copy of current statistics.
+     */
+    memstats statistics(void);
+
+    /**
+     * Enable or disable the histogram of request sizes.
+     * @param enable histogram if true.
+     */
+    inline void histogram(bool enable)
+        {stats.histogram = enable;}
 };
 
 /**
@@ -724,6 +921,8 @@ protected:
     };
 
     LinkedObject *contexts;
+    Context **slots;
+    unsigned slotcount;
 
     virtual void _share(void);
     virtual void _unlock(void);
@@ -782,7 +981,8 @@ public:
  * required can be changed dynamically at runtime, unlike pthread barriers
  * which, when supported, have a fixed limit defined at creation time.  Since
  * we use conditionals, another feature we can add is optional support for a
- * wait with timeout.
+ * wait with timeout.  On Linux released threads wait on a futex generation
+ * count rather than on the conditional.
  * @author David Sugar <dyfet@gnutelephony.org>
  */
 class __EXPORT barrier : private Conditional
@@ -790,6 +990,9 @@ class __EXPORT barrier : private Conditional
 private:
     unsigned count;
     unsigned waits;
+    unsigned generation;
+
+    __LOCAL void wakeup(void);
 
 public:
     /**
@@ -847,18 +1050,23 @@ public:
  * to pass through it until the count is reached, and blocks further threads.
  * Unlike pthread semaphore, our semaphore class supports it's count limit
  * to be altered during runtime and the use of timed waits.  This class also
- * implements the shared_lock protocol.
+ * implements the shared_lock protocol.  On Linux the count is kept with
+ * atomic operations and waiting threads park on a futex, so wait and
+ * release only enter the kernel when a thread actually has to block.
  * @author David Sugar <dyfet@gnutelephony.org>
  */
 class __EXPORT Semaphore : public SharedAccess, protected Conditional
 {
 protected:
     unsigned count, waits, used;
+    unsigned sequence;
+    lockstats *profiler;
 
     virtual void _share(void);
     virtual void _unlock(void);
 
 public:
+
     /**
      * Construct a semaphore with an initial count of threads to permit.
      * @param count of threads to permit, or special case 0 group release.
@@ -872,6 +1080,13 @@ public:
      */
     Semaphore(unsigned count, unsigned avail);
 
+    /**
+     * Enable contention profiling of this semaphore.  This should be
+     * called before the semaphore is shared with other threads.
+     * @param name to tag semaphore with in profile dumps.
+     */
+    void profile(const char *name = NULL);
+
     /**
      * Wait until the semphore usage count is less than the thread limit.
      * Increase used count for our thread when unblocked.
@@ -926,8 +1141,13 @@ public:
  */
 class __EXPORT Mutex : public ExclusiveAccess
 {
+private:
+    void _profile_lock(void);
+    void _profile_unlock(void);
+
 protected:
     pthread_mutex_t mlock;
+    lockstats *profiler;
 
     virtual void _lock(void);
     virtual void _unlock(void);
@@ -995,29 +1215,36 @@ public:
      */
     ~Mutex();
 
+    /**
+     * Enable contention profiling of this mutex.  This should be called
+     * before the mutex is shared with other threads.
+     * @param name to tag mutex with in profile dumps.
+     */
+    void profile(const char *name = NULL);
+
     /**
      * Acquire mutex lock.  This is a blocking operation.
      */
     inline void acquire(void)
-        {pthread_mutex_lock(&mlock);}
+        {if(profiler) _profile_lock(); else pthread_mutex_lock(&mlock);}
 
     /**
      * Acquire mutex lock.  This is a blocking operation.
      */
     inline void lock(void)
-        {pthread_mutex_lock(&mlock);}
+        {if(profiler) _profile_lock(); else pthread_mutex_lock(&mlock);}
 
     /**
      * Release acquired lock.
      */
     inline void unlock(void)
-        {pthread_mutex_unlock(&mlock);}
+        {if(profiler) _profile_unlock(); else pthread_mutex_unlock(&mlock);}
 
     /**
      * Release acquired lock.
      */
     inline void release(void)
-        {pthread_mutex_unlock(&mlock);}
+        {if(profiler) _profile_unlock(); else pthread_mutex_unlock(&mlock);}
 
     /**
      * Convenience function to acquire os native mutex lock directly.
@@ -1034,13 +1261,22 @@ public:
         {pthread_mutex_unlock(lock);}
 
     /**
-     * Specify hash table size for guard protection.  The default is 1.
+     * Specify hash table size for guard protection.  The default is 64.
      * This should be called at initialization time from the main thread
      * of the application before any other threads are created.
      * @param size of hash table used for guarding.
      */
     static void indexing(unsigned size);
 
+    /**
+     * Get contention count of the guard table bucket an object hashes to.
+     * This counts how often a guarded object was found already held or
+     * waited on, and may be used to tune the indexing size.
+     * @param object to check.
+     * @return contention count of the bucket.
+     */
+    static unsigned long contention(const void *object);
+
     /**
      * Specify pointer/object/resource to guard protect.  This uses a
      * dynamically managed mutex.
@@ -1055,6 +1291,222 @@ public:
     static void release(const void *pointer);
 };
 
+/**
+ * Adaptive exclusive lock for short critical sections.  A contended lock
+ * is first spun on with an exponential backoff of cpu pause hints, and
+ * the thread only parks in the kernel if the lock is still held when the
+ * spin limit runs out.  This avoids the cost of parking and waking a
+ * thread when the holder would have released the lock in less time.  On
+ * Linux the lock is a single futex word, elsewhere spinning is done on a
+ * native mutex try lock.  No spinning is done on a single processor.
+ * Statistics are counted while the lock is held, and so are only exact
+ * when read by the holder.  The exclusive protocol is implimented so the
+ * lock can be used as a drop-in replacement for Mutex.
+ * @author David Sugar <dyfet@gnutelephony.org>
+ */
+class __EXPORT SpinMutex : public ExclusiveAccess
+{
+private:
+    unsigned word;
+    unsigned spins;
+    unsigned long acquires, spinning, parking;
+    pthread_mutex_t mlock;
+
+    __LOCAL void contended(void);
+
+protected:
+    virtual void _lock(void);
+    virtual void _unlock(void);
+
+public:
+    /**
+     * Create an adaptive lock.
+     * @param spins to try before parking, or 0 for the process default.
+     */
+    SpinMutex(unsigned spins = 0);
+
+    /**
+     * Destroy lock.
+     */
+    ~SpinMutex();
+
+    /**
+     * Acquire lock, spinning and then parking if busy.
+     */
+    void lock(void);
+
+    /**
+     * Try to acquire lock without waiting.
+     * @return true if acquired.
+     */
+    bool trylock(void);
+
+    /**
+     * Release acquired lock.
+     */
+    void unlock(void);
+
+    /**
+     * Acquire lock, spinning and then parking if busy.
+     */
+    inline void acquire(void)
+        {lock();}
+
+    /**
+     * Release acquired lock.
+     */
+    inline void release(void)
+        {unlock();}
+
+    /**
+     * Set number of spins tried before parking for this lock.
+     * @param spins to try, 0 to always park.
+     */
+    inline void spin(unsigned spins)
+        {this->spins = spins;}
+
+    /**
+     * Set process defaults for new adaptive locks.  This should be called
+     * at initialization before locks are created.  Spinning is always
+     * disabled on a single processor.
+     * @param spins to try before parking, default 64.
+     * @param backoff limit of pause hints between spins, default 64.
+     */
+    static void tuning(unsigned spins, unsigned backoff = 64);
+
+    /**
+     * Get number of times lock was acquired.
+     * @return acquisitions.
+     */
+    inline unsigned long acquired(void) const
+        {return acquires;}
+
+    /**
+     * Get number of contended acquisitions won by spinning.
+     * @return spinning acquisitions.
+     */
+    inline unsigned long spun(void) const
+        {return spinning;}
+
+    /**
+     * Get number of contended acquisitions that had to park.
+     * @return parked acquisitions.
+     */
+    inline unsigned long parked(void) const
+        {return parking;}
+};
+
+/**
+ * Fair exclusive lock for heavily contended resources.  Each thread takes
+ * a ticket and is served in arrival order, so no thread can be starved by
+ * others that repeatedly release and retake the lock.  Waiters spin with a
+ * backoff proportional to their place in line and then park.  On Linux
+ * waiters park on a futex, elsewhere the lock is built from a conditional.
+ * The exclusive protocol is implimented to support exclusive_lock
+ * referencing.
+ * @author David Sugar <dyfet@gnutelephony.org>
+ */
+class __EXPORT TicketMutex : private Conditional, public ExclusiveAccess
+{
+private:
+    unsigned next, serving, waiting;
+    unsigned spins;
+
+protected:
+    virtual void _lock(void);
+    virtual void _unlock(void);
+
+public:
+    /**
+     * Create a ticket lock.
+     * @param spins to try before parking, or 0 for the process default.
+     */
+    TicketMutex(unsigned spins = 0);
+
+    /**
+     * Acquire lock in order of arrival.
+     */
+    void lock(void);
+
+    /**
+     * Release lock to the next thread in line.
+     */
+    void unlock(void);
+
+    /**
+     * Acquire lock in order of arrival.
+     */
+    inline void acquire(void)
+        {lock();}
+
+    /**
+     * Release lock to the next thread in line.
+     */
+    inline void release(void)
+        {unlock();}
+
+    /**
+     * Get number of threads holding or waiting for the lock.
+     * @return threads in line.
+     */
+    inline unsigned queued(void) const
+        {return next - serving;}
+};
+
+/**
+ * Sequence lock for small, frequently read shared state.  A writer bumps
+ * the sequence to odd before changing the state and back to even after.
+ * A reader notes the sequence, copies the state, and retries the copy if
+ * the sequence was odd or has since changed.  Readers never write shared
+ * memory, so any number of them may poll without contending with each
+ * other, and writers are never held off by readers.  Writers are
+ * serialized by a mutex.  Without atomics readers take the writer mutex
+ * instead.  This is used by the seqlock template, which keeps the state.
+ * @author David Sugar <dyfet@gnutelephony.org>
+ */
+class __EXPORT SeqLock
+{
+private:
+    Mutex writer;
+    volatile unsigned sequence;
+
+public:
+    /**
+     * Create a sequence lock.
+     */
+    SeqLock();
+
+    /**
+     * Begin a read, waiting for any writer in progress.
+     * @return sequence to check in retry.
+     */
+    unsigned begin(void);
+
+    /**
+     * End a read.
+     * @param sequence from begin.
+     * @return true if the read overlapped a write and must be repeated.
+     */
+    bool retry(unsigned sequence);
+
+    /**
+     * Begin changing guarded state.
+     */
+    void modify(void);
+
+    /**
+     * Finish changing guarded state.
+     */
+    void commit(void);
+
+    /**
+     * Get current sequence, which is odd while a write is in progress.
+     * @return sequence number.
+     */
+    inline unsigned count(void) const
+        {return sequence;}
+};
+
 /**
  * A mutex locked object smart pointer helper class.  This is particularly
  * useful in referencing objects which will be protected by the mutex
@@ -1233,6 +1685,127 @@ protected:
     SharedObject *share(void);
 };
 
+/**
+ * A read mostly pointer to a shared object, in the manner of read copy
+ * update.  Readers announce an epoch in a per thread, cache line padded
+ * record, so entering and leaving a read never writes a cache line shared
+ * with other threads, and never blocks.  A writer publishes a new object
+ * atomically and then waits a grace period, until every reader that may
+ * still see the prior object has left, before deleting it.  Read sections
+ * may be nested, and may span several epoch pointers.  A reader must not
+ * replace an object while in a read section, since it would wait for
+ * itself.  This class is used by the epoch_pointer and epoch_release
+ * templates rather than directly.
+ * @author David Sugar <dyfet@gnutelephony.org>
+ */
+class __EXPORT EpochPointer
+{
+private:
+    friend class epoch_release;
+
+    Mutex writer;
+    SharedObject *volatile pointer;
+
+protected:
+    /**
+     * Create an empty epoch pointer.  Must be assigned by replace.
+     */
+    EpochPointer();
+
+    /**
+     * Destroy pointer and the object it holds.  There should be no
+     * readers still using the object.
+     */
+    ~EpochPointer();
+
+    /**
+     * Publish a new object, and delete the prior one once no reader can
+     * still be using it.
+     * @param object to publish.
+     */
+    void replace(SharedObject *object);
+
+    /**
+     * Enter a read section and get the current object.
+     * @return current object.
+     */
+    SharedObject *share(void);
+
+    /**
+     * Leave a read section.
+     */
+    void release(void);
+
+public:
+    /**
+     * Wait until every read section active when called has been left.
+     */
+    static void synchronize(void);
+};
+
+/**
+ * A set of processors a thread may be scheduled on.  This is a portable
+ * bitmap of processor numbers that is converted to the native affinity
+ * mask when applied to a thread.
+ * @author David Sugar <dyfet@gnutelephony.org>
+ */
+class __EXPORT cpumask
+{
+public:
+    enum {MAXCPUS = 1024};
+
+private:
+    unsigned long bits[MAXCPUS / (8 * sizeof(unsigned long))];
+
+public:
+    /**
+     * Create an empty processor set.
+     */
+    cpumask();
+
+    /**
+     * Create a processor set for one processor.
+     * @param cpu to include.
+     */
+    cpumask(unsigned cpu);
+
+    /**
+     * Add a processor to the set.
+     * @param cpu to add.
+     */
+    void set(unsigned cpu);
+
+    /**
+     * Remove a processor from the set.
+     * @param cpu to remove.
+     */
+    void clear(unsigned cpu);
+
+    /**
+     * Remove all processors from the set.
+     */
+    void zero(void);
+
+    /**
+     * Test if a processor is in the set.
+     * @param cpu to test.
+     * @return true if in set.
+     */
+    bool is_set(unsigned cpu) const;
+
+    /**
+     * Count processors in the set.
+     * @return number of processors.
+     */
+    unsigned count(void) const;
+
+    inline bool operator!() const
+        {return count() == 0;}
+
+    inline operator bool() const
+        {return count() > 0;}
+};
+
 /**
  * An abstract class for defining classes that operate as a thread.  A derived
  * thread class has a run method that is invoked with the newly created
@@ -1258,6 +1831,14 @@ protected:
     size_t stack;
     int priority;
 
+    class __LOCAL placement;
+
+    placement *place;
+
+private:
+    __LOCAL placement *placing(void);
+
+protected:
     /**
      * Create a thread object that will have a preset stack size.  If 0
      * is used, then the stack size is os defined/default.
@@ -1281,10 +1862,92 @@ public:
      * Set thread priority without disrupting scheduling if possible.
      * Based on scheduling policy.  It is recommended that the process
      * is set for realtime scheduling, and this method is actually for
-     * internal use.
+     * internal use.  Any processor affinity and scheduling class set for
+     * the thread is applied here first, in the context of the thread.  If
+     * the scheduling class cannot be set, the relative priority is used.
      */
     void setPriority(void);
 
+    /**
+     * Set processors the thread may run on.  If set before the thread is
+     * started the thread is created on these processors, so that its stack
+     * is first touched, and placed, on the local memory node.  Otherwise
+     * it takes effect when called from the running thread.
+     * @param mask of processors to run on.
+     * @return false if affinity is not supported, or could not be set
+     * when called from the running thread.
+     */
+    bool affinity(const cpumask& mask);
+
+    /**
+     * Bind thread to the processors of a numa memory node.
+     * @param node to bind to.
+     * @return false if node has no processors or not supported.
+     */
+    bool numa(unsigned node);
+
+    /**
+     * Set the scheduling class of the thread, such as SCHED_FIFO or
+     * SCHED_RR, with an absolute priority for that class.  This replaces
+     * the relative priority adjustment used by start.
+     * @param policy to schedule with.
+     * @param priority within the policy.
+     * @return false if not supported, or could not be set when called
+     * from the running thread.
+     */
+    bool scheduler(int policy, int priority = 0);
+
+    /**
+     * Set earliest deadline scheduling for the thread.  The thread is
+     * given a runtime budget within each period, to be completed by the
+     * deadline.  This is only supported on linux.
+     * @param runtime in microseconds.
+     * @param deadline in microseconds.
+     * @param period in microseconds, or 0 to use the deadline.
+     * @return false if not supported, or could not be set when called
+     * from the running thread.
+     */
+    bool deadline(unsigned long runtime, unsigned long deadline, unsigned long period = 0);
+
+    /**
+     * Get the memory node the thread was bound to.
+     * @return node or -1 if not bound.
+     */
+    int node(void) const;
+
+    /**
+     * Get number of online processors.
+     * @return processor count, at least 1.
+     */
+    static unsigned processors(void);
+
+    /**
+     * Get number of numa memory nodes.
+     * @return node count, 1 if not numa.
+     */
+    static unsigned nodes(void);
+
+    /**
+     * Get the processors of a numa memory node.
+     * @param node to query.
+     * @param mask to fill with processors of the node.
+     * @return true if node found.
+     */
+    static bool topology(unsigned node, cpumask& mask);
+
+    /**
+     * Get the memory node of a processor.
+     * @param cpu to query.
+     * @return node of processor, 0 if not numa.
+     */
+    static unsigned locate(unsigned cpu);
+
+    /**
+     * Get the processor the calling thread is running on.
+     * @return processor or -1 if unknown.
+     */
+    static int cpu(void);
+
     /**
      * Yield execution context of the current thread. This is a static
      * and may be used anywhere.
@@ -1590,6 +2253,54 @@ public:
     shared_release &operator=(SharedPointer &pointer);
 };
 
+/**
+ * Read section for an object held by an epoch pointer.  The object
+ * stays valid until the read section is released, or falls out of scope.
+ * @author David Sugar <dyfet@gnutelephony.org>
+ */
+class __EXPORT epoch_release
+{
+protected:
+    EpochPointer *ptr;
+    SharedObject *object;
+
+    epoch_release();
+
+public:
+    /**
+     * Enter a read section of an epoch pointer.
+     * @param pointer to read.
+     */
+    epoch_release(EpochPointer &pointer);
+
+    /**
+     * Leave read section when falling out of scope.
+     */
+    ~epoch_release();
+
+    /**
+     * Leave read section early.
+     */
+    void release(void);
+
+    /**
+     * Get object being read.
+     * @return object or NULL.
+     */
+    inline SharedObject *get(void) const
+        {return object;}
+
+    /**
+     * Leave any prior read section and read another epoch pointer.
+     * @param pointer to read.
+     * @return read section.
+     */
+    epoch_release &operator=(EpochPointer &pointer);
+
+private:
+    epoch_release(const epoch_release &copy);
+};
+
 /**
  * Templated shared pointer for singleton shared objects of specific type.
  * This is used as typed template for the SharedPointer object reference
@@ -1771,6 +2482,64 @@ public:
         {return static_cast<const T*>(ptr->pointer);}
 };
 
+/**
+ * Typed epoch pointer for read mostly shared objects.  Readers use
+ * epoch_instance, writers publish new objects with replace.
+ * @author David Sugar <dyfet@gnutelephony.org>
+ */
+template<class T>
+class epoch_pointer : public EpochPointer
+{
+public:
+    /**
+     * Create an empty epoch pointer.
+     */
+    inline epoch_pointer() : EpochPointer() {}
+
+    /**
+     * Publish a new typed object.
+     * @param object to publish.
+     */
+    inline void replace(T *object)
+        {EpochPointer::replace(object);}
+
+    /**
+     * Publish a new typed object through assignment.
+     * @param object to publish.
+     */
+    inline void operator=(T *object)
+        {replace(object);}
+};
+
+/**
+ * Typed read section of an epoch pointer.
+ * @author David Sugar <dyfet@gnutelephony.org>
+ */
+template<class T>
+class epoch_instance : public epoch_release
+{
+public:
+    /**
+     * Create a read section that reads nothing.
+     */
+    inline epoch_instance() : epoch_release() {}
+
+    /**
+     * Enter read section of a typed epoch pointer.
+     * @param pointer to read.
+     */
+    inline epoch_instance(epoch_pointer<T> &pointer) : epoch_release(pointer) {}
+
+    inline const T& operator*() const
+        {return *(static_cast<const T*>(object));}
+
+    inline const T* operator->() const
+        {return static_cast<const T*>(object);}
+
+    inline const T* get(void) const
+        {return static_cast<const T*>(object);}
+};
+
 /**
  * Typed smart locked pointer class.  This is used to manage references to
  * objects which are protected by an auto-generated mutex.  The mutex is
@@ -1814,6 +2583,76 @@ public:
         {return static_cast<T*>(auto_protect::object);}
 };
 
+/**
+ * Templated sequence lock to publish a small copyable object to many
+ * readers.  Readers get a consistent copy without writing shared memory.
+ * The object is copied while it may be changing, so it should be plain
+ * data such as counters, timestamps, or addresses, and should not hold
+ * pointers that a writer may free.
+ * @author David Sugar <dyfet@gnutelephony.org>
+ */
+template<typename T>
+class seqlock : private SeqLock
+{
+private:
+    T data;
+
+public:
+    /**
+     * Create sequence locked object.
+     */
+    inline seqlock() : SeqLock() {}
+
+    /**
+     * Create sequence locked object with initial value.
+     * @param value to initialize with.
+     */
+    inline seqlock(const T& value) : SeqLock()
+        {data = value;}
+
+    /**
+     * Get a consistent copy of the object.
+     * @param copy to save into.
+     */
+    inline void get(T& copy)
+        {unsigned seq; do {seq = begin(); copy = data;} while(retry(seq));}
+
+    /**
+     * Get a consistent copy of the object.
+     * @return copy of object.
+     */
+    inline T get(void)
+        {T copy; get(copy); return copy;}
+
+    /**
+     * Publish a new value for the object.
+     * @param value to publish.
+     */
+    inline void set(const T& value)
+        {modify(); data = value; commit();}
+
+    /**
+     * Get a consistent copy of the object.
+     * @return copy of object.
+     */
+    inline operator T()
+        {return get();}
+
+    /**
+     * Publish a new value for the object.
+     * @param value to publish.
+     */
+    inline seqlock<T>& operator=(const T& value)
+        {set(value); return *this;}
+
+    /**
+     * Get current sequence of updates, twice the number of writes.
+     * @return sequence number.
+     */
+    inline unsigned count(void) const
+        {return SeqLock::count();}
+};
+
 /**
  * Convenience function to start a joinable thread.
  * @param thread to start.
@@ -1855,11 +2694,26 @@ typedef Mutex mutex_t;
  */
 typedef ThreadLock rwlock_t;
 
+/**
+ * Convenience type for using big reader locks.
+ */
+typedef BigReaderLock brlock_t;
+
 /**
  * Convenience type for using recursive exclusive locks.
  */
 typedef RecursiveMutex rexlock_t;
 
+/**
+ * Convenience type for using adaptive spinning locks.
+ */
+typedef SpinMutex spinlock_t;
+
+/**
+ * Convenience type for using fair ticket locks.
+ */
+typedef TicketMutex ticketlock_t;
+
 /**
  * Convenience type for using counting semaphores.
  */
@@ -1906,6 +2760,34 @@ inline void acquire(mutex_t &mutex)
 inline void release(mutex_t &mutex)
     {mutex.release();}
 
+/**
+ * Convenience function to acquire an adaptive lock.
+ * @param lock to acquire.
+ */
+inline void acquire(spinlock_t &lock)
+    {lock.lock();}
+
+/**
+ * Convenience function to release an adaptive lock.
+ * @param lock to release.
+ */
+inline void release(spinlock_t &lock)
+    {lock.release();}
+
+/**
+ * Convenience function to acquire a ticket lock.
+ * @param lock to acquire.
+ */
+inline void acquire(ticketlock_t &lock)
+    {lock.lock();}
+
+/**
+ * Convenience function to release a ticket lock.
+ * @param lock to release.
+ */
+inline void release(ticketlock_t &lock)
+    {lock.release();}
+
 /**
  * Convenience function to exclusively schedule conditional access.
  * @param lock to make exclusive.
@@ -2001,6 +2883,31 @@ inline bool share(rwlock_t &lock, timeout_t timeout = Timer::inf)
 inline void release(rwlock_t &lock)
     {lock.release();}
 
+/**
+ * Convenience function for exclusive big reader lock.
+ * @param lock to make exclusive.
+ * @param timeout to wait for exclusive.
+ * @return true if exclusive, false if timeout.
+ */
+inline bool exclusive(brlock_t &lock, timeout_t timeout = Timer::inf)
+    {return lock.modify(timeout);}
+
+/**
+ * Convenience function for shared big reader lock.
+ * @param lock to share.
+ * @param timeout to wait for shared.
+ * @return true if shared, false if timeout.
+ */
+inline bool share(brlock_t &lock, timeout_t timeout = Timer::inf)
+    {return lock.access(timeout);}
+
+/**
+ * Convenience function to release a big reader lock.
+ * @param lock to release.
+ */
+inline void release(brlock_t &lock)
+    {lock.release();}
+
 /**
  * Convenience function to lock a shared recursive mutex lock.
  * @param lock to acquire.
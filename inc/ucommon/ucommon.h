@@ -104,6 +104,8 @@
 #include <ucommon/socket.h>
 #include <ucommon/thread.h>
 #include <ucommon/containers.h>
+#include <ucommon/tasks.h>
+#include <ucommon/reactor.h>
 #include <ucommon/fsys.h>
 #include <ucommon/file.h>
 #include <ucommon/buffer.h>
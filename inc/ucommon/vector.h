@@ -445,10 +445,10 @@ public:
     inline vectorof(vectorsize_t size) : Vector(size) {}
 
     inline T& operator[](int index)
-        {return static_cast<T&>(Vector::get(index));}
+        {return *(static_cast<T *>(Vector::get(index)));}
 
     inline const T& at(int index)
-        {return static_cast<const T&>(Vector::get(index));}
+        {return *(static_cast<const T *>(Vector::get(index)));}
 
     /**
      * Retrieve a typed member of the vector directly.
@@ -506,19 +506,33 @@ public:
     inline array_reuse(unsigned count, void *memory) :
         ArrayReuse(sizeof(T), count, memory) {}
 
+    /**
+     * Get a snapshot of allocation statistics for the typed heap.
+     * @return copy of current statistics.
+     */
+    inline memstats statistics(void)
+        {return ReusableAllocator::statistics();}
+
+    /**
+     * Enable or disable the histogram of request sizes.
+     * @param enable histogram if true.
+     */
+    inline void histogram(bool enable)
+        {ReusableAllocator::histogram(enable);}
+
     /**
      * Test if typed objects available in heap or re-use list.
      * @return true if objects still are available.
      */
     inline operator bool() const
-        {return avail();}
+        {return const_cast<array_reuse*>(this)->avail();}
 
     /**
      * Test if the entire heap has been allocated.
      * @return true if no objects are available.
      */
     inline bool operator!() const
-        {return !avail();}
+        {return !const_cast<array_reuse*>(this)->avail();}
 
     /**
      * Request immediately next available typed object from the heap.
@@ -605,19 +619,33 @@ public:
     inline paged_reuse(mempager *pager, unsigned count) :
         PagerReuse(pager, sizeof(T), count) {}
 
+    /**
+     * Get a snapshot of allocation statistics for the typed pool.
+     * @return copy of current statistics.
+     */
+    inline memstats statistics(void)
+        {return ReusableAllocator::statistics();}
+
+    /**
+     * Enable or disable the histogram of request sizes.
+     * @param enable histogram if true.
+     */
+    inline void histogram(bool enable)
+        {ReusableAllocator::histogram(enable);}
+
     /**
      * Test if typed objects available from the pager or re-use list.
      * @return true if objects still are available.
      */
     inline operator bool() const
-        {return PagerReuse::avail();}
+        {return const_cast<paged_reuse*>(this)->PagerReuse::avail();}
 
     /**
      * Test if no objects are available for reuse or the pager.
      * @return true if no objects are available.
      */
     inline bool operator!() const
-        {return !PagerReuse::avail();}
+        {return !const_cast<paged_reuse*>(this)->PagerReuse::avail();}
 
     /**
      * Get a typed object from the pager heap.  This function blocks when the
@@ -37,6 +37,54 @@ public:
     unsigned value;
 };
 
+class keyed : public NamedObject
+{
+public:
+    char name[16];
+
+    inline keyed() : NamedObject() {}
+
+    inline ~keyed() {Id = NULL;}
+
+    void clearId(void) {}
+};
+
+class event : public LinkedObject
+{
+public:
+    inline event() : LinkedObject() {}
+
+    unsigned source, serial;
+};
+
+static atomicfifo<event> events;
+static pushstack<event> spares;
+static event posted[3][2000];
+
+class postThread : public JoinableThread
+{
+public:
+    unsigned id;
+
+    postThread(unsigned index) : JoinableThread() {id = index;};
+
+    ~postThread() {
+        join();
+    }
+
+    void run(void) {
+        for(unsigned pos = 0; pos < 2000; ++pos) {
+            posted[id][pos].source = id;
+            posted[id][pos].serial = pos;
+            events.push(&posted[id][pos]);
+            // cycle spare objects through the shared stack as well
+            event *spare = spares.pull();
+            if(spare)
+                spares.push(spare);
+        }
+    };
+};
+
 extern "C" int main()
 {
     linked_pointer<ints> ptr;
@@ -89,5 +137,78 @@ extern "C" int main()
     assert(mv != NULL);
 //  assert(mv->value == 1);
 
+    // growable table moves entries as it resizes
+    NamedTable table;
+    keyed *keys = new keyed[5000];
+    for(unsigned pos = 0; pos < 5000; ++pos) {
+        snprintf(keys[pos].name, sizeof(keys[pos].name), "key%u", pos);
+        NamedObject *prior = table.add(&keys[pos], keys[pos].name);
+        assert(prior == NULL);
+    }
+    assert(table.count() == 5000);
+    assert(table.map("key4999") == &keys[4999]);
+    assert(table.map("key5000") == NULL);
+    for(unsigned pos = 0; pos < 5000; pos += 2) {
+        NamedObject *removed = table.remove(keys[pos].name);
+        assert(removed == &keys[pos]);
+    }
+    assert(table.count() == 2500);
+    assert(table.map("key100") == NULL);
+    assert(table.map("key101") == &keys[101]);
+    count = 0;
+    NamedObject *node = table.skip(NULL);
+    while(node) {
+        ++count;
+        node = table.skip(node);
+    }
+    assert(count == 2500);
+    keyed other;
+    snprintf(other.name, sizeof(other.name), "key101");
+    NamedObject *replaced = table.add(&other, other.name);
+    assert(replaced == &keys[101]);
+    assert(table.map("key101") == &other);
+    table.clear();
+    assert(table.map("key101") == NULL);
+    delete[] keys;
+
+    // lock free fifo from several producers with batched delivery
+    event pool[16];
+    for(unsigned pos = 0; pos < 16; ++pos)
+        spares.push(&pool[pos]);
+    assert(events.is_empty());
+    event *none = events.pull();
+    assert(none == NULL);
+    postThread *posters[3];
+    for(unsigned pos = 0; pos < 3; ++pos) {
+        posters[pos] = new postThread(pos);
+        start(posters[pos]);
+    }
+    unsigned next[3] = {0, 0, 0};
+    count = 0;
+    while(count < 6000) {
+        event *ev = events.drain(count % 2 ? 0 : 10);
+        if(!ev)
+            Thread::yield();
+        while(ev) {
+            assert(ev->source < 3 && ev->serial == next[ev->source]);
+            ++next[ev->source];
+            ++count;
+            ev = (event *)ev->getNext();
+        }
+    }
+    for(unsigned pos = 0; pos < 3; ++pos)
+        delete posters[pos];
+    assert(events.is_empty());
+
+    // every spare object is still on the stack exactly once
+    count = 0;
+    event *ev = spares.drain();
+    while(ev) {
+        ++count;
+        ev = (event *)ev->getNext();
+    }
+    none = spares.pop();
+    assert(count == 16 && none == NULL);
+
     return 0;
 }
@@ -25,6 +25,67 @@
 
 using namespace ucommon;
 
+class keyedObject : public NamedObject
+{
+public:
+    keyedObject() : NamedObject() {}
+
+    void clearId(void) {}
+};
+
+class pooledObject : public PagerObject
+{
+public:
+    unsigned value;
+};
+
+static pager<pooledObject> pooled;
+
+static void hold(pooledObject *obj)
+{
+    static_cast<CountedObject *>(obj)->retain();
+}
+
+static void drop(pooledObject *obj)
+{
+    static_cast<CountedObject *>(obj)->release();
+}
+
+class poolThread : public JoinableThread
+{
+public:
+    poolThread() : JoinableThread() {}
+
+    ~poolThread() {join();}
+
+    void run(void) {
+        pooledObject *objects[100];
+        for(unsigned count = 0; count < 100; ++count) {
+            objects[count] = *pooled;
+            hold(objects[count]);
+        }
+        for(unsigned count = 0; count < 100; ++count)
+            drop(objects[count]);
+    }
+};
+
+class shardThread : public JoinableThread
+{
+public:
+    shardpager *heap;
+
+    shardThread(shardpager *pager) : JoinableThread() {heap = pager;}
+
+    ~shardThread() {join();}
+
+    void run(void) {
+        for(unsigned count = 0; count < 100; ++count) {
+            void *mem = heap->_alloc(64);
+            assert(mem != NULL);
+        }
+    }
+};
+
 extern "C" int main()
 {
     stringlist_t mylist;
@@ -52,5 +113,235 @@ extern "C" int main()
     assert(eq(list[1], "300"));
 
     assert(list[2] == NULL);
+
+    // tail space of older pages is reused without growing the heap
+    memalloc heap(1024);
+    heap._alloc(600);
+    heap._alloc(600);
+    assert(heap.pages() == 2);
+    heap._alloc(300);
+    heap._alloc(300);
+    assert(heap.pages() == 2);
+    heap._alloc(600);
+    assert(heap.pages() == 3);
+
+    // rewinding keeps acquired pages for re-use
+    memalloc::mark_t point = heap.mark();
+    for(unsigned pos = 0; pos < 8; ++pos)
+        heap._alloc(600);
+    assert(heap.pages() == 11);
+    heap.rewind(point);
+    for(unsigned pos = 0; pos < 8; ++pos)
+        heap._alloc(600);
+    assert(heap.pages() == 11);
+
+    // a rewind releases older page tails used since the mark, and repeated
+    // request cycles do not grow the pager
+    memalloc arena(1024);
+    caddr_t first = (caddr_t)arena._alloc(504);
+    arena._alloc(600);
+    memstats before = arena.statistics();
+    for(unsigned cycle = 0; cycle < 100; ++cycle) {
+        memalloc::mark_t cycled = arena.mark();
+        for(unsigned pos = 0; pos < 6; ++pos)
+            arena._alloc(300);
+        arena.rewind(cycled);
+        assert(arena.statistics().used == before.used);
+    }
+    assert(arena.pages() == 4);
+    caddr_t tail = (caddr_t)arena._alloc(450);
+    assert(tail == first + 504);
+
+    // pages carved from huge page regions
+    memalloc mapped;
+    bool backed = mapped.backing(memalloc::HUGEPAGES | memalloc::PREFAULT, 4096 * 1024);
+    assert(backed);
+    for(unsigned pos = 0; pos < 1000; ++pos) {
+        void *part = mapped._alloc(mapped.size() / 2);
+        assert(part != NULL);
+    }
+    assert(mapped.pages() == 1000);
+    backed = mapped.backing(0);
+    assert(!backed);
+    mapped.purge();
+    assert(mapped.pages() == 0);
+
+    StringPager::mark_t strpoint = mylist.mark();
+    mylist.add("400");
+    mylist.add("500");
+    assert(mylist.count() == 4);
+    mylist.rewind(strpoint);
+    assert(mylist.count() == 2);
+    assert(eq(mylist[1u], "300"));
+    mylist.add("600");
+    assert(eq(mylist[2u], "600"));
+
+    // interned strings share storage and compare by pointer
+    StringPager tokens;
+    const char *host = tokens.intern("Host");
+    tokens.intern("Accept");
+    const char *again = tokens.intern("Host");
+    assert(again == host);
+    assert(tokens.count() == 2);
+    assert(tokens.find("Accept") == tokens[1u]);
+    assert(tokens.find("Date") == NULL);
+    tokens.add("Date");
+    assert(tokens.find("Date") == tokens[2u]);
+    char tbuf[32];
+    for(unsigned pos = 0; pos < 200; ++pos) {
+        snprintf(tbuf, sizeof(tbuf), "key%u", pos % 100);
+        tokens.intern(tbuf);
+    }
+    assert(tokens.count() == 103);
+    assert(eq(tokens.find("key42"), "key42"));
+    tokens.pull();
+    assert(tokens.find("Host") == NULL);
+
+    // large sorts use radix on cached prefixes of the strings
+    StringPager sorted;
+    for(unsigned pos = 0; pos < 2000; ++pos) {
+        snprintf(tbuf, sizeof(tbuf), "%s%u", (pos & 1) ? "prefixed/" : "p", (pos * 7919) % 1000);
+        sorted.add(tbuf);
+    }
+    sorted.sort();
+    sorted.add("zzz");
+    assert(sorted.count() == 2001);
+    const char *prior = "";
+    StringPager::iterator sp = sorted.begin();
+    while(is(sp)) {
+        assert(strcmp(prior, sp->get()) <= 0);
+        prior = sp->get();
+        sp.next();
+    }
+    assert(eq(prior, "zzz"));
+
+    // associations without a fixed size hash map
+    assoc_pointer<int, 0, 32, 4096> assoc;
+    static int values[1000];
+    for(unsigned pos = 0; pos < 1000; ++pos) {
+        snprintf(tbuf, sizeof(tbuf), "value%u", pos);
+        bool created = assoc.create(tbuf, &values[pos]);
+        assert(created);
+    }
+    assert(assoc.count() == 1000);
+    assert(assoc["value999"] == &values[999]);
+    snprintf(tbuf, sizeof(tbuf), "value500");
+    assoc.remove(tbuf);
+    assert(assoc["value500"] == NULL);
+    bool assigned = assoc.assign(tbuf, &values[0]);
+    assert(assigned);
+    assert(assoc["value500"] == &values[0]);
+    assert(assoc.count() == 1000);
+
+    keypager<keyedObject, 0> cache(4096);
+    keyedObject *entry = cache["first"];
+    keyedObject *found = cache["first"];
+    assert(found == entry);
+    cache["second"];
+    assert(cache.test("second") && !cache.test("third"));
+    assert(cache.count() == 2);
+
+    bufpager buf(1024);
+    buf << "hello";
+    bufpager::mark_t bufpoint = buf.mark();
+    buf << " world";
+    assert(buf.used() == 11);
+    buf.rewind(bufpoint);
+    assert(buf.used() == 5);
+    buf << "!";
+    char *text = buf.dup();
+    assert(eq(text, "hello!"));
+    free(text);
+
+    // export buffer pages for vectored i/o without copying
+    bufpager chunks(128);
+    for(unsigned pos = 0; pos < 100; ++pos)
+        chunks << "0123456789";
+    unsigned segs = chunks.segments();
+    assert(segs > 1);
+    struct iovec iov[32];
+    unsigned gathered = chunks.gather(iov, 32);
+    assert(gathered == segs);
+    size_t total = 0;
+    for(unsigned pos = 0; pos < segs; ++pos) {
+        assert(((char *)iov[pos].iov_base)[0] == (char)('0' + total % 10));
+        total += iov[pos].iov_len;
+    }
+    assert(total == 1000);
+    gathered = chunks.gather(iov, 32, 995);
+    assert(gathered == 1);
+    assert(iov[0].iov_len == 5 && ((char *)iov[0].iov_base)[0] == '5');
+    gathered = chunks.gather(iov, 32, 1000);
+    assert(gathered == 0);
+
+    // each thread gets a sub-arena, released arenas are adopted again
+    shardpager shared(1024);
+    void *mem = shared._alloc(64);
+    assert(mem != NULL);
+    assert(shared.shards() == 1);
+    shardThread *thr = new shardThread(&shared);
+    start(thr);
+    delete thr;
+    assert(shared.shards() == 2);
+    thr = new shardThread(&shared);
+    start(thr);
+    delete thr;
+    assert(shared.shards() == 2);
+    assert(shared.pages() > 2);
+    shared.purge();
+    assert(shared.pages() == 0);
+
+    // statistics are kept as we allocate, rather than walking pages
+    memalloc counted(1024);
+    counted.histogram(true);
+    counted._alloc(30);
+    counted._alloc(100);
+    memstats stats = counted.statistics();
+    assert(stats.allocs == 2);
+    assert(stats.requested == 130);
+    assert(stats.pages == 1);
+    assert(stats.reserved == 1024);
+    assert(stats.peak == stats.used);
+    assert(stats.sizes[4] == 1 && stats.sizes[6] == 1);
+    assert(counted.utilization() == stats.utilization());
+    memstats combined = stats;
+    combined += stats;
+    assert(combined.used == stats.used * 2 && combined.peak == combined.used);
+    combined.used = 0;
+    combined += stats;
+    assert(combined.peak == stats.used * 2);
+    counted.purge();
+    assert(counted.statistics().used == 0);
+
+    // objects recycle through per thread magazines and the shared list
+    pooledObject *pobj = *pooled;
+    hold(pobj);
+    drop(pobj);
+    pooledObject *recycled = *pooled;
+    assert(recycled == pobj);
+    hold(pobj);
+    poolThread *pthr = new poolThread();
+    start(pthr);
+    delete pthr;
+    assert(pooled.statistics().pages == 101);
+    pooledObject *pobjs[100];
+    for(unsigned pos = 0; pos < 100; ++pos) {
+        pobjs[pos] = *pooled;
+        hold(pobjs[pos]);
+    }
+    stats = pooled.statistics();
+    assert(stats.pages == 101);
+    assert(stats.allocs == 202);
+    for(unsigned pos = 0; pos < 100; ++pos)
+        drop(pobjs[pos]);
+    drop(pobj);
+
+    array_reuse<ReusableObject> objects(4);
+    ReusableObject *obj = objects.create();
+    objects.release(obj);
+    objects.create();
+    stats = objects.statistics();
+    assert(stats.allocs == 2 && stats.pages == 1);
+    assert(stats.used == sizeof(ReusableObject));
     return 0;
 }
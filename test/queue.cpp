@@ -36,6 +36,44 @@ public:
         {count = ++reused;};
 };
 
+typedef struct {
+    unsigned source, serial;
+} item_t;
+
+static ringbufferof<item_t> ring(8);
+static unsigned received[2] = {0, 0};
+
+class ringThread : public JoinableThread
+{
+public:
+    unsigned id;
+    bool producer;
+
+    ringThread(unsigned index, bool put) : JoinableThread() {id = index; producer = put;};
+
+    ~ringThread() {
+        join();
+    }
+
+    void run(void) {
+        item_t item;
+        unsigned last[2] = {0, 0};
+
+        for(unsigned pos = 1; pos <= 5000; ++pos) {
+            if(producer) {
+                item.source = id;
+                item.serial = pos;
+                ring.put(&item);
+                continue;
+            }
+            ring.copy(&item);
+            assert(item.source < 2 && item.serial > last[item.source]);
+            last[item.source] = item.serial;
+            ++received[id];
+        }
+    };
+};
+
 static mempager pool;
 static paged_reuse<myobject> myobjects(&pool, 100);
 static queueof<myobject> mycache(&pool, 10);
@@ -66,6 +104,36 @@ extern "C" int main()
         myobjects.release(x);
     }
 
+    // ring with two producers and two consumers claiming slots unlocked
+    ringThread *threads[4];
+    for(i = 0; i < 4; ++i) {
+        threads[i] = new ringThread(i % 2, i < 2);
+        start(threads[i]);
+    }
+    for(i = 0; i < 4; ++i)
+        delete threads[i];
+    assert(received[0] == 5000 && received[1] == 5000);
+    assert(!ring && ring.size() == 8);
+
+    // single producer and consumer ring in batches
+    ringbufferof<unsigned> batch(5, RingBuffer::SINGLE);
+    unsigned list[10];
+    for(i = 0; i < 10; ++i)
+        list[i] = i;
+    assert(batch.size() == 8);
+    unsigned moved = batch.push(list, 10);
+    assert(moved == 8);
+    bool done = batch.put(&list[0], 0);
+    assert(!done && batch.count() == 8);
+    moved = batch.pull(list, 3);
+    assert(moved == 3 && list[2] == 2);
+    done = batch.get(&list[0], 0);
+    assert(done && list[0] == 3);
+    moved = batch.pull(list, 10);
+    assert(moved == 4 && list[3] == 7);
+    done = batch.get(&list[0], 10);
+    assert(!done);
+
     x = init<myobject>(NULL);
     assert(x == NULL);
     assert(reused == 11);
@@ -33,6 +33,64 @@ static Socket::address testing6("44:022:66::1", 4444);
 static Socket::address localhost6("::1", 4444);
 #endif
 
+#ifndef _MSWINDOWS_
+static unsigned received = 0, expires = 0;
+
+class testHandler : public Reactor::handler
+{
+protected:
+    void ready(unsigned events) {
+        char buf[8];
+        if((events & Reactor::INPUT) && ::recv(handle(), buf, sizeof(buf), 0) > 0)
+            ++received;
+        if(received == 2)
+            detach();
+    };
+};
+
+class testTimer : public TimerQueue::event
+{
+public:
+    testTimer(Reactor *reactor) : TimerQueue::event(reactor, 20) {};
+
+protected:
+    void expired(void) {
+        if(++expires < 3)
+            arm(20);
+    };
+};
+
+class testStop : public Reactor::notice
+{
+public:
+    Reactor *reactor;
+
+protected:
+    void posted(void) {
+        reactor->stop();
+    };
+};
+
+class testPoster : public JoinableThread
+{
+public:
+    testStop stopper;
+
+    testPoster(Reactor *reactor) : JoinableThread() {
+        stopper.reactor = reactor;
+    };
+
+    ~testPoster() {
+        join();
+    };
+
+    void run(void) {
+        Thread::sleep(200);
+        stopper.reactor->post(&stopper);
+    };
+};
+#endif
+
 extern "C" int main()
 {
     struct sockaddr_internet addr;
@@ -93,5 +151,33 @@ extern "C" int main()
         assert(0 == strcmp(addrbuf, "44:22:66::1"));
     }
 #endif
+
+#ifndef _MSWINDOWS_
+    // dispatch a socket, a repeating timer, and a notice from one thread
+    int pair[2];
+    Reactor reactor;
+    testHandler reader;
+    int rtn = ::socketpair(AF_UNIX, SOCK_DGRAM, 0, pair);
+    assert(rtn == 0);
+    bool attached = reader.attach(&reactor, pair[0]);
+    assert(attached);
+    assert(reactor.size() == 1);
+    ssize_t sent = ::send(pair[1], "a", 1, 0);
+    assert(sent == 1);
+    sent = ::send(pair[1], "b", 1, 0);
+    assert(sent == 1);
+    testTimer timer(&reactor);
+    testPoster *poster = new testPoster(&reactor);
+    poster->start();
+    reactor.run();
+    delete poster;
+    assert(reactor.is_stopped());
+    assert(received == 2);
+    assert(expires == 3);
+    assert(reactor.size() == 0);
+    assert(reader.list() == NULL);
+    ::close(pair[0]);
+    ::close(pair[1]);
+#endif
     return 0;
 }
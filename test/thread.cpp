@@ -38,6 +38,375 @@ public:
     };
 };
 
+static unsigned guarded[4] = {0, 0, 0, 0};
+static unsigned shared[4] = {0, 0, 0, 0};
+
+class guardThread : public JoinableThread
+{
+public:
+    guardThread() : JoinableThread() {};
+
+    ~guardThread() {
+        join();
+    }
+
+    void run(void) {
+        for(unsigned pos = 0; pos < 4000; ++pos) {
+            unsigned *obj = &guarded[pos % 4];
+            if(pos % 2) {
+                Mutex::protect(obj);
+                ++*obj;
+                Mutex::release(obj);
+            }
+            else {
+                obj = &shared[pos % 4];
+                ThreadLock::writer(obj);
+                ++*obj;
+                ThreadLock::release(obj);
+            }
+        }
+    };
+};
+
+static ConditionalLock condlock;
+static unsigned condcount = 0;
+
+class condThread : public JoinableThread
+{
+public:
+    condThread() : JoinableThread() {};
+
+    ~condThread() {
+        join();
+    }
+
+    void run(void) {
+        for(unsigned pos = 0; pos < 1000; ++pos) {
+            condlock.access();
+            condlock.access();
+            condlock.release();
+            condlock.exclusive();
+            ++condcount;
+            condlock.share();
+            condlock.release();
+            condlock.modify();
+            ++condcount;
+            condlock.commit();
+        }
+    };
+};
+
+static Mutex profiled;
+
+class profileThread : public JoinableThread
+{
+public:
+    profileThread() : JoinableThread() {};
+
+    ~profileThread() {
+        join();
+    }
+
+    void run(void) {
+        for(unsigned pos = 0; pos < 5; ++pos) {
+            profiled.lock();
+            Thread::sleep(2);
+            profiled.unlock();
+        }
+    };
+};
+
+static SpinMutex spinning;
+static TicketMutex ticketing;
+static unsigned spincount = 0, ticketcount = 0;
+
+class spinThread : public JoinableThread
+{
+public:
+    spinThread() : JoinableThread() {};
+
+    ~spinThread() {
+        join();
+    }
+
+    void run(void) {
+        for(unsigned pos = 0; pos < 10000; ++pos) {
+            spinning.exclusive_lock();
+            ++spincount;
+            spinning.release_exclusive();
+            ticketing.exclusive_lock();
+            ++ticketcount;
+            ticketing.release_exclusive();
+        }
+    };
+};
+
+static BigReaderLock routes;
+static unsigned route[2] = {0, 0};
+
+class routeThread : public JoinableThread
+{
+public:
+    routeThread() : JoinableThread() {};
+
+    ~routeThread() {
+        join();
+    }
+
+    void run(void) {
+        for(unsigned pos = 0; pos < 2000; ++pos) {
+            routes.shared_lock();
+            assert(route[0] == route[1]);
+            routes.release_share();
+            if(pos % 100)
+                continue;
+            routes.exclusive_lock();
+            ++route[0];
+            Thread::yield();
+            ++route[1];
+            routes.release_exclusive();
+        }
+    };
+};
+
+class handoffThread : public JoinableThread
+{
+public:
+    handoffThread() : JoinableThread() {};
+
+    ~handoffThread() {
+        join();
+    }
+
+    // a past writer takes and drops a read hold while others enter modify
+    void run(void) {
+        for(unsigned pos = 0; pos < 2000; ++pos) {
+            routes.modify();
+            ++route[0];
+            Thread::yield();
+            ++route[1];
+            routes.release();
+            routes.access();
+            assert(route[0] == route[1]);
+            routes.release();
+        }
+    };
+};
+
+typedef struct {
+    unsigned serial, check;
+} stamp_t;
+
+static seqlock<stamp_t> stamps;
+
+class stampThread : public JoinableThread
+{
+public:
+    bool writer;
+
+    stampThread(bool write) : JoinableThread() {writer = write;};
+
+    ~stampThread() {
+        join();
+    }
+
+    void run(void) {
+        stamp_t stamp;
+        unsigned last = 0;
+        for(unsigned pos = 1; pos <= 5000; ++pos) {
+            if(writer) {
+                stamp.serial = stamp.check = pos;
+                stamps = stamp;
+                continue;
+            }
+            stamp = stamps;
+            assert(stamp.serial == stamp.check && stamp.serial >= last);
+            last = stamp.serial;
+        }
+    };
+};
+
+static atomic::aligned<unsigned long> hits;
+static atomic::flag started;
+
+class hitThread : public JoinableThread
+{
+public:
+    hitThread() : JoinableThread() {};
+
+    ~hitThread() {
+        join();
+    }
+
+    void run(void) {
+        started.set(atomic::RELAXED);
+        for(unsigned pos = 0; pos < 10000; ++pos)
+            hits.fetch_add(1, atomic::RELAXED);
+    };
+};
+
+static Semaphore slots(2);
+static barrier meeting(4);
+static TimedEvent ready;
+static unsigned inside = 0, peak = 0, met = 0;
+
+class slotThread : public JoinableThread
+{
+public:
+    slotThread() : JoinableThread() {};
+
+    ~slotThread() {
+        join();
+    }
+
+    void run(void) {
+        for(unsigned pos = 0; pos < 200; ++pos) {
+            slots.wait();
+            Mutex::protect(&inside);
+            if(++inside > peak)
+                peak = inside;
+            Mutex::release(&inside);
+            Thread::yield();
+            Mutex::protect(&inside);
+            --inside;
+            Mutex::release(&inside);
+            slots.release();
+        }
+        meeting.wait();
+        Mutex::protect(&met);
+        ++met;
+        Mutex::release(&met);
+        ready.signal();
+    };
+};
+
+static unsigned tasked = 0;
+
+class countTask : public Task
+{
+public:
+    void run(void) {
+        Mutex::protect(&tasked);
+        ++tasked;
+        Mutex::release(&tasked);
+    };
+};
+
+class spawnTask : public Task
+{
+public:
+    ThreadPool *pool;
+    countTask children[8];
+
+    void run(void) {
+        for(unsigned pos = 0; pos < 8; ++pos) {
+            bool submitted = pool->submit(&children[pos]);
+            assert(submitted);
+        }
+    };
+};
+
+static unsigned snapshots = 0, reads[4];
+
+class snapshot : public SharedObject
+{
+public:
+    unsigned value, check;
+
+    snapshot(unsigned v) {
+        value = check = v;
+        Mutex::protect(&snapshots);
+        ++snapshots;
+        Mutex::release(&snapshots);
+    }
+
+    ~snapshot() {
+        value = check = 0;
+        Mutex::protect(&snapshots);
+        --snapshots;
+        Mutex::release(&snapshots);
+    }
+};
+
+static epoch_pointer<snapshot> current;
+
+class readerThread : public JoinableThread
+{
+public:
+    unsigned id;
+
+    readerThread(unsigned index) : JoinableThread() {id = index;};
+
+    ~readerThread() {
+        join();
+    }
+
+    void run(void) {
+        unsigned last = 0;
+        while(last < 100) {
+            epoch_instance<snapshot> snap(current);
+            epoch_instance<snapshot> nested(current);
+            assert(snap->value == snap->check && snap->value >= last);
+            Thread::yield();
+            assert(snap->value == snap->check && snap->value >= last);
+            last = snap->value;
+            ++reads[id];
+        }
+    };
+};
+
+static int placed = -2;
+static bool rescheduled = false, refused = false;
+
+class placeThread : public JoinableThread
+{
+public:
+    placeThread() : JoinableThread() {};
+
+    ~placeThread() {
+        join();
+    }
+
+    void run(void) {
+        placed = Thread::cpu();
+        rescheduled = scheduler(SCHED_OTHER, 0);
+        refused = !scheduler(SCHED_OTHER, 99);
+    };
+};
+
+class countedValue : public CountedObject
+{
+public:
+    int value;
+
+    countedValue(int init) : CountedObject() {value = init;}
+};
+
+class doubler
+{
+public:
+    void operator()(int& value)
+        {value *= 2;}
+
+    void operator()(countedValue& item)
+        {item.value *= 2;}
+};
+
+static double halve(int value)
+{
+    return value / 2.0;
+}
+
+static double sum(double o1, double o2)
+{
+    return o1 + o2;
+}
+
+static bool greater(const int& o1, const int& o2)
+{
+    return o1 > o2;
+}
+
 extern "C" int main()
 {
     time_t now, later;
@@ -57,6 +426,289 @@ extern "C" int main()
     evt.wait(2000);
     time(&later);
     assert(later >= now + 1);
+
+    // guard objects from several threads through the pointer lock tables
+    guardThread *guards[4];
+    for(unsigned pos = 0; pos < 4; ++pos) {
+        guards[pos] = new guardThread();
+        start(guards[pos]);
+    }
+    for(unsigned pos = 0; pos < 4; ++pos)
+        delete guards[pos];
+    for(unsigned pos = 0; pos < 4; ++pos)
+        assert(guarded[pos] + shared[pos] == 4000);
+
+    bool locked = ThreadLock::reader(&shared[0]);
+    assert(locked);
+    locked = ThreadLock::reader(&shared[0]);
+    assert(locked);
+    assert(ThreadLock::contention(&shared[0]) > 0);
+    ThreadLock::release(&shared[0]);
+    ThreadLock::release(&shared[0]);
+    locked = ThreadLock::reader(NULL);
+    assert(!locked);
+
+    // shared locks from many threads, with recursive readers
+    condThread *conds[8];
+    for(unsigned pos = 0; pos < 8; ++pos) {
+        conds[pos] = new condThread();
+        start(conds[pos]);
+    }
+    for(unsigned pos = 0; pos < 8; ++pos)
+        delete conds[pos];
+    assert(condcount == 16000);
+
+    // profile a contended mutex and find it as the top lock
+    ThreadLock unused;
+    unused.profile("unused");
+    unused.access();
+    unused.release();
+    profiled.profile("profiled");
+    profileThread *profs[3];
+    for(unsigned pos = 0; pos < 3; ++pos) {
+        profs[pos] = new profileThread();
+        start(profs[pos]);
+    }
+    for(unsigned pos = 0; pos < 3; ++pos)
+        delete profs[pos];
+
+    lockstats top[2];
+    unsigned found = lockstats::top(top, 2);
+    assert(found == 2);
+    assert(eq(top[0].name, "profiled"));
+    assert(top[0].acquired == 15);
+    assert(top[0].contended > 0);
+    assert(eq(top[1].name, "unused"));
+    assert(top[1].acquired == 1 && top[1].contended == 0);
+
+    // semaphore limits, barrier release, and event signalling
+    slotThread *users[3];
+    for(unsigned pos = 0; pos < 3; ++pos) {
+        users[pos] = new slotThread();
+        start(users[pos]);
+    }
+    meeting.wait();
+    bool signalled = ready.wait(5000);
+    assert(signalled);
+    for(unsigned pos = 0; pos < 3; ++pos)
+        delete users[pos];
+    assert(peak > 0 && peak <= 2);
+    assert(inside == 0);
+    assert(met == 3);
+    bool taken = slots.wait(10);
+    assert(taken);
+    taken = slots.wait(10);
+    assert(taken);
+    taken = slots.wait(10);
+    assert(!taken);
+    slots.release();
+    slots.release();
+    signalled = meeting.wait(10);
+    assert(!signalled);
+
+    // work stealing pool with nested submission and a small task limit
+    ThreadPool *pool = new ThreadPool(3, 16);
+    countTask counted[100];
+    spawnTask spawned[10];
+    assert(pool->size() == 3);
+    bool submitted;
+    for(unsigned pos = 0; pos < 100; ++pos) {
+        submitted = pool->submit(&counted[pos]);
+        assert(submitted);
+    }
+    for(unsigned pos = 0; pos < 10; ++pos) {
+        spawned[pos].pool = pool;
+        submitted = pool->submit(&spawned[pos]);
+        assert(submitted);
+    }
+    bool finished = counted[99].wait(5000);
+    assert(finished);
+    assert(counted[99].is_done());
+    pool->drain();
+    assert(pool->pending() == 0);
+    assert(tasked == 180);
+    assert(spawned[0].children[7].is_done());
+    submitted = pool->submit(&counted[0]);
+    assert(submitted);
+    delete pool;
+    assert(tasked == 181);
+
+    // parallel algorithms over a plain array, with small chunks to split
+    pool = new ThreadPool(3);
+    unsigned items = 50000;
+    int *values = new int[items];
+    double *halves = new double[items];
+    for(unsigned pos = 0; pos < items; ++pos)
+        values[pos] = (int)((pos * 7919u) % 10007u);
+    parallel_for(pool, values, items, doubler(), 1000);
+    assert(values[1] == 2 * 7919);
+    parallel_map(pool, values, halves, items, halve, 1000);
+    assert(halves[1] == 7919.0);
+    double total = parallel_fold(pool, halves, items, 0.0, sum, 333);
+    double serial = parallel_fold((ThreadPool *)NULL, halves, items, 0.0, sum, 333);
+    assert(total == serial);
+    parallel_order(pool, values, items, 1000);
+    for(unsigned pos = 1; pos < items; ++pos)
+        assert(values[pos - 1] <= values[pos]);
+    parallel_order(pool, greater, values, items, 777);
+    for(unsigned pos = 1; pos < items; ++pos)
+        assert(values[pos - 1] >= values[pos]);
+    double empty = parallel_fold(pool, halves, 0, 1.5, sum);
+    assert(empty == 1.5);
+    delete[] values;
+    delete[] halves;
+
+    // parallel loops over typed vectors and mapped arrays
+    vectorof<countedValue> objects(2000);
+    for(unsigned pos = 0; pos < 2000; ++pos)
+        objects.add(new countedValue(pos));
+    assert(objects.len() == 2000);
+    parallel_for(pool, objects, doubler(), 100);
+    assert(objects[1].value == 2 && objects(1999)->value == 3998);
+    mapped_array<int> table("ucommon-parallel", 2000);
+    if(table.max()) {
+        assert(table.max() == 2000);
+        for(unsigned pos = 0; pos < 2000; ++pos)
+            table[pos] = pos;
+        parallel_for(pool, table, doubler(), 100);
+        assert(table[1] == 2 && table[1999] == 3998);
+    }
+    delete pool;
+
+    // adaptive and ticket locks as exclusive access
+    spinThread *spinners[4];
+    for(unsigned pos = 0; pos < 4; ++pos) {
+        spinners[pos] = new spinThread();
+        start(spinners[pos]);
+    }
+    for(unsigned pos = 0; pos < 4; ++pos)
+        delete spinners[pos];
+    assert(spincount == 40000 && ticketcount == 40000);
+    assert(spinning.acquired() == 40000);
+    assert(spinning.spun() + spinning.parked() <= 40000);
+    bool spun = spinning.trylock();
+    assert(spun);
+    spun = spinning.trylock();
+    assert(!spun);
+    spinning.release();
+    assert(ticketing.queued() == 0);
+
+    // big reader lock with writers mixed in
+    routeThread *routers[4];
+    for(unsigned pos = 0; pos < 4; ++pos) {
+        routers[pos] = new routeThread();
+        start(routers[pos]);
+    }
+    for(unsigned pos = 0; pos < 4; ++pos)
+        delete routers[pos];
+    assert(route[0] == 80 && route[1] == 80);
+    bool held = routes.modify();
+    assert(held);
+    held = routes.modify();
+    assert(held);
+    routes.release();
+    routes.release();
+    held = routes.access(0);
+    assert(held);
+    routes.release();
+    handoffThread *handoffs[4];
+    for(unsigned pos = 0; pos < 4; ++pos) {
+        handoffs[pos] = new handoffThread();
+        start(handoffs[pos]);
+    }
+    for(unsigned pos = 0; pos < 4; ++pos)
+        delete handoffs[pos];
+    assert(route[0] == 8080 && route[1] == 8080);
+
+    // sequence locked state polled while written
+    stampThread *stampers[4];
+    stamp_t initial = {0, 0};
+    stamps = initial;
+    for(unsigned pos = 0; pos < 4; ++pos) {
+        stampers[pos] = new stampThread(pos == 0);
+        start(stampers[pos]);
+    }
+    for(unsigned pos = 0; pos < 4; ++pos)
+        delete stampers[pos];
+    assert(stamps.get().serial == 5000);
+    assert(stamps.count() == 5001 * 2);
+
+    // typed atomics with explicit ordering
+    atomic::value<int> level(3);
+    int expected = 2;
+    bool swapped = level.cas(expected, 5);
+    assert(!swapped && expected == 3);
+    swapped = level.cas(expected, 5, atomic::ACQ_REL);
+    assert(swapped && level.get(atomic::ACQUIRE) == 5);
+    int prior = level.fetch_or(8, atomic::RELAXED);
+    assert(prior == 5 && level == 13);
+    prior = level.exchange(1);
+    ++level;
+    assert(prior == 13 && level == 2);
+    assert(sizeof(hits) % 64 == 0);
+    atomic::pointer<int> target;
+    int *none = NULL;
+    swapped = target.cas(none, &expected, atomic::RELEASE);
+    assert(swapped && *target == 3);
+    hitThread *hitters[4];
+    assert(!started);
+    for(unsigned pos = 0; pos < 4; ++pos) {
+        hitters[pos] = new hitThread();
+        start(hitters[pos]);
+    }
+    for(unsigned pos = 0; pos < 4; ++pos)
+        delete hitters[pos];
+    assert(hits.get(atomic::RELAXED) == 40000 && started.is_set());
+    started.clear();
+    bool already = started.set();
+    assert(!already);
+
+    // epoch readers never see a snapshot reclaimed under them
+    readerThread *readers[4];
+    current = new snapshot(1);
+    for(unsigned pos = 0; pos < 4; ++pos) {
+        readers[pos] = new readerThread(pos);
+        start(readers[pos]);
+    }
+    for(unsigned pos = 2; pos <= 100; ++pos) {
+        current = new snapshot(pos);
+        Thread::yield();
+    }
+    for(unsigned pos = 0; pos < 4; ++pos) {
+        delete readers[pos];
+        assert(reads[pos] > 0);
+    }
+    assert(snapshots == 1);
+    EpochPointer::synchronize();
+
+    // processor sets, topology, and placing a thread on a processor
+    cpumask mask(3);
+    assert(mask.is_set(3) && !mask.is_set(2) && mask.count() == 1);
+    mask.set(cpumask::MAXCPUS);
+    mask.clear(3);
+    assert(!mask);
+    assert(Thread::processors() >= 1);
+    assert(Thread::nodes() >= 1);
+    bool mapped = Thread::topology(0, mask);
+    assert(mapped && mask.count() >= 1);
+    assert(Thread::locate(0) < Thread::nodes());
+    placeThread *placer = new placeThread();
+    assert(placer->node() == -1);
+    if(placer->affinity(cpumask(0))) {
+        start(placer);
+        delete placer;
+        assert(placed == 0 || placed == -1);
+        placer = new placeThread();
+    }
+    if(placer->numa(0))
+        assert(placer->node() == 0);
+    if(placer->scheduler(SCHED_OTHER, 0)) {
+        start(placer);
+        delete placer;
+        placer = NULL;
+        assert(rescheduled && refused);
+    }
+    delete placer;
     return 0;
 }
 
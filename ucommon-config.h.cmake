@@ -35,6 +35,8 @@
 #cmakedefine HAVE_WCHAR_H 1
 #cmakedefine HAVE_REGEX_H 1
 #cmakedefine HAVE_SYS_INOTIFY_H 1
+#cmakedefine HAVE_LINUX_FUTEX_H 1
+#cmakedefine HAVE_SYS_EPOLL_H 1
 #cmakedefine HAVE_SYS_EVENT_H 1
 #cmakedefine HAVE_SYSLOG_H 1
 #cmakedefine HAVE_LIBINTL_H 1
@@ -66,6 +68,9 @@
 #cmakedefine HAVE_PTHREAD_DELAY_NP 1
 #cmakedefine HAVE_PTHREAD_SETCONCURRENCY 1
 #cmakedefine HAVE_PTHREAD_SETSCHEDPRIO 1
+#cmakedefine HAVE_PTHREAD_SETAFFINITY_NP 1
+#cmakedefine HAVE_PTHREAD_ATTR_SETAFFINITY_NP 1
+#cmakedefine HAVE_SCHED_GETCPU 1
 #cmakedefine HAVE_PTHREAD_YIELD 1
 #cmakedefine HAVE_PTHREAD_YIELD_NP 1
 #cmakedefine HAVE_SHL_LOAD 1